@@ -0,0 +1,32 @@
+/**
+ * The robot of params/local_planner.yaml and the helpers of the benchmarks
+ */
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <chrono>
+#include <vector>
+#include <costmap_view.h>
+
+namespace mpnet_local_planner{
+    namespace bench{
+        // The footprint of params/local_planner.yaml
+        const std::vector<Point2D> robot_footprint{
+            Point2D(0.4064, 0.122), Point2D(-0.1524, 0.122), Point2D(-0.1524, -0.122), Point2D(0.4064, -0.122)};
+
+        // The inflation layer of the costmaps of the robot (m)
+        const double inscribed_radius = 0.122;
+        const double inflation_radius = 0.5;
+        const double cost_scaling_factor = 3.0;
+
+        /**
+         * @brief The wall time since start (s)
+         */
+        inline double elapsed(std::chrono::steady_clock::time_point start)
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+}
+
+#endif /* BENCH_COMMON_H */
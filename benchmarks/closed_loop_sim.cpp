@@ -0,0 +1,709 @@
+/**
+ * Drives a kinematic bicycle model through scripted scenarios with the local
+ * planner and the Controller in lockstep, without a simulator, RViz or a ROS
+ * master, and reports how planning cadence and MPC solve time play out:
+ * time to goal, replans, RRT* fallbacks, deadline misses and CPU time per
+ * simulated second, as JSON.
+ *
+ * Usage: closed_loop_sim <model file> [scene file or directory]... [options]
+ *
+ * Without scenes the built in scenarios are run, the last of them with an
+ * MPC deadline no solve meets so that every control step falls back to pure
+ * pursuit. A scene is a world: its costmap is the static map and each query
+ * a start and a goal.
+ *
+ * Options:
+ *   --jobs <n>              Scenarios run in parallel (default: the number of cores)
+ *   --dt <s>                Simulation and control step (default 0.05, the MPC dt)
+ *   --planner-rate <Hz>     controller_frequency of move_base (default 5)
+ *   --plan-freq <n>         replanning_freq, planner cycles between replans (default 20)
+ *   --budget <S>x<P>        num_samples and num_paths (default 5x10)
+ *   --target-plan-time <s>  Adapt the budget to this plan time, with the bounds of local_planner.yaml (default off)
+ *   --mpc-backend <name>    ipopt or rti (default ipopt)
+ *   --mpc-horizon <n>       One of the compiled horizons (default 40)
+ *   --adaptive-horizon      Shorter horizons near the end of the plan
+ *   --mpc-deadline <s>      0 waits for every solve (default 0.04)
+ *   --predict-state         Propagate the state by the expected solve time
+ *   --timeout <s>           Simulated time before giving up (default 120)
+ *   --seed <n>              Seed of OMPL, the planners and the built in clutter (default 1)
+ *   --output <file>         Write the JSON to a file instead of stdout
+ *
+ * The MPC solves, and their deadline, run in wall time while the simulated
+ * clock waits, so a slow solve shows up as a deadline miss and a pure
+ * pursuit step, as on the robot.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <ompl/util/Console.h>
+#include <ompl/util/RandomNumbers.h>
+
+#include <Controller.h>
+#include <local_plan.h>
+#include <mpnet_core.h>
+#include <planning_budget.h>
+#include <planning_scene.h>
+
+#include "bench_common.h"
+
+using namespace mpnet_local_planner;
+
+namespace{
+    struct SimConfig{
+        std::string model_file;
+        double dt = ::dt;
+        double planner_rate = 5.0;
+        int plan_freq = 20;
+        int num_samples = 5, num_paths = 10;
+        double target_plan_time = 0;
+        double xy_goal_tolerance = 0.2, yaw_goal_tolerance = 0.3; /** @brief Of params/local_planner.yaml */
+        std::string mpc_backend = "ipopt";
+        int mpc_horizon = N;
+        bool adaptive_horizon = false;
+        double mpc_deadline = 0.04;
+        bool predict_state = false;
+        double compact_plan_ds = 0.05;
+        double timeout = 120.0;
+        unsigned int seed = 1;
+    };
+
+    struct Scenario{
+        std::string name;
+        const PlanningScene* world;
+        SE2Pose start, goal;
+        double mpc_deadline = -1; /** @brief Overrides the one of the configuration if not negative */
+    };
+
+    struct SimResult{
+        std::string name;
+        std::string outcome; /** @brief goal, collision, timeout or no_global_plan */
+        double mpc_deadline = 0;
+        double sim_time = 0, wall_time = 0, distance = 0, distance_to_goal = 0;
+        unsigned long planner_cycles = 0, replans = 0, mpnet_plans = 0, rrt_star_plans = 0, planner_failures = 0;
+        unsigned long planner_deadline_misses = 0, mpc_solves = 0, mpc_deadline_misses = 0;
+        double planner_time = 0, planner_max = 0;
+        PlanningBudget::Settings budget; /** @brief The settings at the end */
+        unsigned long budget_changes = 0;
+    };
+
+    /**
+     * @brief The global planner: Dijkstra over the cells the robot center can
+     * be on, weighted by their cost as navfn does, from start to goal
+     */
+    bool globalPlan(const PlanningScene& world, const SE2Pose& start, const SE2Pose& goal, std::vector<SE2Pose>& plan)
+    {
+        CostmapView view = world.view();
+        unsigned int sx, sy, gx, gy;
+        if (!view.worldToMap(start.x, start.y, sx, sy) || !view.worldToMap(goal.x, goal.y, gx, gy))
+            return false;
+        int size_x = world.size_x, size_y = world.size_y;
+        std::vector<double> distance(world.cells.size(), 1e30);
+        std::vector<int> parent(world.cells.size(), -1);
+        typedef std::pair<double, int> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+        int source = sy * size_x + sx, target = gy * size_x + gx;
+        distance[source] = 0;
+        open.push(Entry(0, source));
+        while (!open.empty())
+        {
+            Entry e = open.top();
+            open.pop();
+            if (e.first > distance[e.second])
+                continue;
+            if (e.second == target)
+                break;
+            int x = e.second % size_x, y = e.second / size_x;
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int nx = x + dx, ny = y + dy;
+                    if ((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= size_x || ny >= size_y)
+                        continue;
+                    int n = ny * size_x + nx;
+                    unsigned char cost = world.cells[n];
+                    if (cost >= INSCRIBED_INFLATED_OBSTACLE)
+                        continue;
+                    double d = e.first + std::hypot(dx, dy) * (1.0 + cost / 50.0);
+                    if (d < distance[n])
+                    {
+                        distance[n] = d;
+                        parent[n] = e.second;
+                        open.push(Entry(d, n));
+                    }
+                }
+        }
+        if (parent[target] < 0 && target != source)
+            return false;
+
+        std::vector<int> cells;
+        for (int c = target; c >= 0; c = parent[c])
+            cells.push_back(c);
+        std::reverse(cells.begin(), cells.end());
+        plan.clear();
+        plan.push_back(start);
+        for (size_t i = 1; i + 1 < cells.size(); i++)
+        {
+            double x = world.origin_x + (cells[i] % size_x + 0.5) * world.resolution;
+            double y = world.origin_y + (cells[i] / size_x + 0.5) * world.resolution;
+            plan.push_back(SE2Pose(x, y, std::atan2(y - plan.back().y, x - plan.back().x)));
+        }
+        plan.push_back(goal);
+        return true;
+    }
+
+    /**
+     * @class SimPlanner
+     * @brief MpnetLocalPlanner::computeVelocityCommands on the simulated
+     * world: a rolling local costmap around the robot, the goal where the
+     * global plan leaves it, and the same replanning, RRT* fallback and
+     * local plan pruning
+     */
+    class SimPlanner{
+        public:
+        SimPlanner(const SimConfig& config, const PlanningScene& world, const std::vector<SE2Pose>& global_plan, SimResult& result):
+        config_(config),
+        world_(world),
+        global_plan_(global_plan),
+        result_(result),
+        core_(config.model_file, config.xy_goal_tolerance / 2, config.yaw_goal_tolerance, config.num_samples, config.num_paths, bench::robot_footprint),
+        local_(120, 120, world.resolution, 0, 0),
+        path_cost_(-1),
+        plan_freq_(config.plan_freq),
+        plan_freq_count_(0),
+        progress_(0),
+        reached_goal_(false)
+        {
+            result_.budget = PlanningBudget::Settings(config.num_samples, config.num_paths, 0, config.plan_freq);
+            if (config.target_plan_time > 0)
+            {
+                // The bounds of params/local_planner.yaml
+                budget_.reset(new PlanningBudget(PlanningBudget::Settings(config.num_samples, config.num_paths, 0.05, config.plan_freq),
+                    PlanningBudget::Settings(2, 1, 0.005, 5), PlanningBudget::Settings(10, 20, 0.05, 40), config.target_plan_time));
+                applyBudget();
+            }
+        }
+
+        /**
+         * @brief One planner cycle
+         * @return True once the robot is at the goal
+         */
+        bool cycle(const SE2Pose& pose)
+        {
+            updateLocalCostmap(pose);
+            SE2Pose goal = localGoal(pose);
+
+            double xy_from_goal = std::hypot(goal.x - pose.x, goal.y - pose.y);
+            double yaw_from_goal = std::fabs(std::remainder(goal.yaw - pose.yaw, 2 * M_PI));
+            if ((yaw_from_goal <= config_.yaw_goal_tolerance && xy_from_goal <= config_.xy_goal_tolerance) || reached_goal_)
+            {
+                reached_goal_ = true;
+                local_plan_.clear();
+                return true;
+            }
+
+            if (plan_freq_count_ % plan_freq_ == 0)
+            {
+                plan_freq_count_ = 0;
+                result_.replans++;
+                CostmapView local = local_.view(), world = world_.view();
+                core_.setCostmap(local, &world);
+                // The failures return before counting the cycle, so the
+                // next cycle plans again
+                if (!core_.isStateValid(pose, bench::robot_footprint))
+                {
+                    result_.planner_failures++;
+                    path_.clear();
+                    local_plan_.clear();
+                    return false;
+                }
+                double cost = core_.plan(pose, goal, bounds_, new_path_);
+                if (budget_)
+                {
+                    double plan_time, simplify_time;
+                    core_.getLastPlanTimes(plan_time, simplify_time);
+                    if (budget_->addPlan(plan_time, simplify_time, new_path_.size() > 1))
+                    {
+                        applyBudget();
+                        result_.budget_changes++;
+                    }
+                }
+                if (new_path_.size() > 1)
+                {
+                    // Keep the old path if the new one ends at the same goal and is longer
+                    bool same_goal = path_.size() > 1 &&
+                        std::hypot(goal.x - path_.back().x, goal.y - path_.back().y) < 0.01 &&
+                        std::fabs(std::remainder(goal.yaw - path_.back().yaw, 2 * M_PI)) < 0.1;
+                    if (!same_goal || cost <= path_cost_ || path_cost_ < 0)
+                    {
+                        path_.swap(new_path_);
+                        path_cost_ = cost;
+                    }
+                    result_.mpnet_plans++;
+                    local_plan_ = path_;
+                }
+                else if (local_plan_.size() > 50)
+                    pruneLocalPlan(pose);
+                else
+                {
+                    result_.rrt_star_plans++;
+                    if (core_.planRRTStar(pose, goal, new_path_) && new_path_.size() > 1)
+                    {
+                        path_.swap(new_path_);
+                        path_cost_ = -1;
+                        local_plan_ = path_;
+                    }
+                    else
+                    {
+                        result_.planner_failures++;
+                        return false;
+                    }
+                }
+            }
+            plan_freq_count_++;
+            if (!local_plan_.empty())
+                pruneLocalPlan(pose);
+            return false;
+        }
+
+        /**
+         * @brief The local plan as the plugin hands it to the controller
+         */
+        void compactPlan(mpnet_plan::LocalPlan& plan)
+        {
+            poses_.resize(local_plan_.size());
+            for (size_t i = 0; i < local_plan_.size(); i++)
+            {
+                poses_[i].pose.position.x = local_plan_[i].x;
+                poses_[i].pose.position.y = local_plan_[i].y;
+                poses_[i].pose.orientation.z = std::sin(local_plan_[i].yaw / 2);
+                poses_[i].pose.orientation.w = std::cos(local_plan_[i].yaw / 2);
+            }
+            plan.header.frame_id = "odom";
+            plan.ds = config_.compact_plan_ds;
+            resamplePlan(poses_, plan.ds, plan);
+        }
+
+        private:
+        /**
+         * @brief Plan with the settings of the budget, as MpnetLocalPlanner::applyBudget
+         */
+        void applyBudget()
+        {
+            const PlanningBudget::Settings& settings = budget_->getSettings();
+            core_.setRollouts(settings.num_samples, settings.num_paths);
+            core_.setSimplifyTime(settings.simplify_time);
+            plan_freq_ = settings.replanning_freq;
+            result_.budget = settings;
+        }
+
+        /**
+         * @brief Copy the window of the world around the robot, as the rolling local costmap
+         */
+        void updateLocalCostmap(const SE2Pose& pose)
+        {
+            double resolution = world_.resolution;
+            int cell_x = (int)std::floor((pose.x - world_.origin_x) / resolution) - (int)local_.size_x / 2;
+            int cell_y = (int)std::floor((pose.y - world_.origin_y) / resolution) - (int)local_.size_y / 2;
+            local_.origin_x = world_.origin_x + cell_x * resolution;
+            local_.origin_y = world_.origin_y + cell_y * resolution;
+            for (int y = 0; y < (int)local_.size_y; y++)
+                for (int x = 0; x < (int)local_.size_x; x++)
+                {
+                    int wx = cell_x + x, wy = cell_y + y;
+                    bool inside = wx >= 0 && wy >= 0 && wx < (int)world_.size_x && wy < (int)world_.size_y;
+                    local_.cells[y * local_.size_x + x] = inside ? world_.cells[wy * world_.size_x + wx] : NO_INFORMATION;
+                }
+            bounds_ = local_.bounds();
+        }
+
+        /**
+         * @brief The last pose of the global plan within half the local costmap, as transformGlobalPlan
+         */
+        SE2Pose localGoal(const SE2Pose& pose)
+        {
+            // Progress is the closest pose ahead of the last one, as prunePlan
+            double best = 1e30;
+            size_t end = std::min(global_plan_.size(), progress_ + 200);
+            size_t closest = progress_;
+            for (size_t i = progress_; i < end; i++)
+            {
+                double d = std::hypot(global_plan_[i].x - pose.x, global_plan_[i].y - pose.y);
+                if (d < best)
+                {
+                    best = d;
+                    closest = i;
+                }
+            }
+            progress_ = closest;
+            double radius = local_.size_x * local_.resolution / 2;
+            size_t last = progress_;
+            while (last + 1 < global_plan_.size() &&
+                std::hypot(global_plan_[last + 1].x - pose.x, global_plan_[last + 1].y - pose.y) < radius)
+                last++;
+            if (last + 1 == global_plan_.size())
+                return global_plan_.back();
+            SE2Pose goal = global_plan_[last];
+            if (last > 0)
+                goal.yaw = std::atan2(goal.y - global_plan_[last - 1].y, goal.x - global_plan_[last - 1].x);
+            return goal;
+        }
+
+        /**
+         * @brief Drop the local plan up to the robot, as MpnetLocalPlanner::pruneLocalPlan
+         */
+        void pruneLocalPlan(const SE2Pose& pose)
+        {
+            size_t i = 0;
+            while (i < local_plan_.size())
+            {
+                double dx = local_plan_[i].x - pose.x, dy = local_plan_[i].y - pose.y;
+                if (dx * dx + dy * dy < 0.001)
+                    break;
+                i++;
+            }
+            local_plan_.erase(local_plan_.begin(), local_plan_.begin() + i);
+        }
+
+        const SimConfig& config_;
+        const PlanningScene& world_;
+        const std::vector<SE2Pose>& global_plan_;
+        SimResult& result_;
+        MpnetCore core_;
+        PlanningScene local_;
+        std::vector<double> bounds_;
+        std::vector<SE2Pose> path_, new_path_, local_plan_;
+        std::vector<geometry_msgs::PoseStamped> poses_;
+        double path_cost_;
+        std::unique_ptr<PlanningBudget> budget_;
+        int plan_freq_, plan_freq_count_;
+        size_t progress_;
+        bool reached_goal_;
+    };
+
+    void simulate(const SimConfig& config, const Scenario& scenario, SimResult& result)
+    {
+        result.name = scenario.name;
+        result.mpc_deadline = scenario.mpc_deadline >= 0 ? scenario.mpc_deadline : config.mpc_deadline;
+        std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+        std::vector<SE2Pose> global_plan;
+        if (!globalPlan(*scenario.world, scenario.start, scenario.goal, global_plan))
+        {
+            result.outcome = "no_global_plan";
+            return;
+        }
+
+        tf2_ros::Buffer tf;
+        Controller controller(false, config.mpc_backend, config.mpc_horizon, config.adaptive_horizon, result.mpc_deadline, &tf);
+        controller.setPredictState(config.predict_state);
+        SimPlanner planner(config, *scenario.world, global_plan, result);
+        CostmapView world = scenario.world->view();
+
+        SE2Pose pose = scenario.start;
+        double v = 0, steer = 0;
+        int steps_per_cycle = std::max(1, (int)std::lround(1.0 / (config.planner_rate * config.dt)));
+        double planner_period = 1.0 / config.planner_rate;
+        result.outcome = "timeout";
+        for (long step = 0; step * config.dt < config.timeout; step++)
+        {
+            result.sim_time = step * config.dt;
+            if (step % steps_per_cycle == 0)
+            {
+                result.planner_cycles++;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                bool at_goal = planner.cycle(pose);
+                double seconds = bench::elapsed(start);
+                result.planner_time += seconds;
+                result.planner_max = std::max(result.planner_max, seconds);
+                if (seconds > planner_period)
+                    result.planner_deadline_misses++;
+                if (at_goal)
+                {
+                    result.outcome = "goal";
+                    break;
+                }
+                // The plugin publishes the local plan every cycle
+                mpnet_plan::LocalPlan::Ptr plan = boost::make_shared<mpnet_plan::LocalPlan>();
+                planner.compactPlan(*plan);
+                controller.get_plan(plan);
+            }
+
+            OdomSnapshot odom;
+            odom.x = pose.x;
+            odom.y = pose.y;
+            odom.yaw = pose.yaw;
+            odom.vx = v;
+            odom.vy = 0;
+            odom.wz = v * std::tan(steer) / Lf;
+            odom.stamp = result.sim_time;
+            controller.observe(odom);
+            ackermann_msgs::AckermannDriveStamped cmd;
+            controller.control(cmd);
+
+            // Kinematic bicycle, with the wheelbase and steering limit of the MPC
+            v = cmd.drive.speed;
+            steer = std::max(-BicycleModel::max_steer, std::min(BicycleModel::max_steer, (double)cmd.drive.steering_angle));
+            pose.x += v * std::cos(pose.yaw) * config.dt;
+            pose.y += v * std::sin(pose.yaw) * config.dt;
+            pose.yaw = std::remainder(pose.yaw + v * std::tan(steer) / Lf * config.dt, 2 * M_PI);
+            result.distance += std::fabs(v) * config.dt;
+            if (footprintCost(world, pose, bench::robot_footprint) < 0)
+            {
+                result.outcome = "collision";
+                break;
+            }
+        }
+        result.distance_to_goal = std::hypot(scenario.goal.x - pose.x, scenario.goal.y - pose.y);
+        result.mpc_solves = controller.getSolveCount();
+        result.mpc_deadline_misses = controller.getDeadlineMisses();
+        result.wall_time = bench::elapsed(wall_start);
+    }
+
+    /**
+     * @brief An empty world with walls around it
+     */
+    PlanningScene emptyWorld(const std::string& name, double width, double height)
+    {
+        const double resolution = 0.05;
+        PlanningScene world((unsigned int)(width / resolution), (unsigned int)(height / resolution), resolution, 0, 0);
+        world.name = name;
+        for (unsigned int x = 0; x < world.size_x; x++)
+            world.cells[x] = world.cells[(world.size_y - 1) * world.size_x + x] = LETHAL_OBSTACLE;
+        for (unsigned int y = 0; y < world.size_y; y++)
+            world.cells[y * world.size_x] = world.cells[y * world.size_x + world.size_x - 1] = LETHAL_OBSTACLE;
+        return world;
+    }
+
+    void addBox(PlanningScene& world, double x0, double y0, double x1, double y1)
+    {
+        for (unsigned int y = 0; y < world.size_y; y++)
+            for (unsigned int x = 0; x < world.size_x; x++)
+            {
+                double wx = world.origin_x + (x + 0.5) * world.resolution, wy = world.origin_y + (y + 0.5) * world.resolution;
+                if (wx >= x0 && wx <= x1 && wy >= y0 && wy <= y1)
+                    world.cells[y * world.size_x + x] = LETHAL_OBSTACLE;
+            }
+    }
+
+    /**
+     * @brief Open floor, an L shaped corridor, a slalom and a cluttered room
+     */
+    void builtinScenarios(unsigned int seed, std::vector<PlanningScene>& worlds)
+    {
+        PlanningScene open = emptyWorld("open", 12, 12);
+        open.queries.push_back(PlanningQuery(SE2Pose(1.5, 1.5, 0), SE2Pose(10.5, 10.5, M_PI / 2)));
+        worlds.push_back(open);
+
+        PlanningScene corridor = emptyWorld("corridor", 12, 12);
+        addBox(corridor, 0, 2.2, 9.8, 12);
+        addBox(corridor, 11.2, 0, 12, 12);
+        corridor.queries.push_back(PlanningQuery(SE2Pose(1.0, 1.1, 0), SE2Pose(10.5, 10.5, M_PI / 2)));
+        worlds.push_back(corridor);
+
+        PlanningScene slalom = emptyWorld("slalom", 16, 6);
+        for (int i = 0; i < 4; i++)
+        {
+            double x = 3.5 + 3 * i;
+            if (i % 2 == 0)
+                addBox(slalom, x, 0, x + 0.3, 3.8);
+            else
+                addBox(slalom, x, 2.2, x + 0.3, 6);
+        }
+        slalom.queries.push_back(PlanningQuery(SE2Pose(1.0, 4.5, 0), SE2Pose(15.0, 3.0, 0)));
+        worlds.push_back(slalom);
+
+        PlanningScene clutter = emptyWorld("clutter", 12, 12);
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (int i = 0; i < 25; i++)
+        {
+            double x = 1 + 10 * uniform(rng), y = 1 + 10 * uniform(rng), size = 0.2 + 0.5 * uniform(rng);
+            if (std::hypot(x - 1.5, y - 1.5) < 1.2 || std::hypot(x - 10.5, y - 10.5) < 1.2)
+                continue;
+            addBox(clutter, x, y, x + size, y + size);
+        }
+        clutter.queries.push_back(PlanningQuery(SE2Pose(1.5, 1.5, M_PI / 4), SE2Pose(10.5, 10.5, M_PI / 4)));
+        worlds.push_back(clutter);
+
+        for (size_t i = 0; i < worlds.size(); i++)
+            worlds[i].inflate(bench::inscribed_radius, bench::inflation_radius, bench::cost_scaling_factor);
+    }
+
+    double cpuTime()
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    // The controller throttles its warnings with ros::Time, which throws
+    // from the solver fallback unless the clock is set up, there is no node
+    ros::Time::init();
+    if (argc < 2)
+    {
+        std::cerr << "usage: closed_loop_sim <model file> [scene file or directory]... [--jobs n] [--dt s] [--planner-rate Hz]"
+                  << " [--plan-freq n] [--budget SxP] [--target-plan-time s] [--mpc-backend name] [--mpc-horizon n] [--adaptive-horizon]"
+                  << " [--mpc-deadline s] [--predict-state] [--timeout s] [--seed n] [--output file]" << std::endl;
+        return 1;
+    }
+    SimConfig config;
+    config.model_file = argv[1];
+    std::vector<PlanningScene> worlds;
+    int jobs = std::max(1u, boost::thread::hardware_concurrency());
+    std::string output;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--jobs" && has_value)
+            jobs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--dt" && has_value)
+            config.dt = std::atof(argv[++i]);
+        else if (arg == "--planner-rate" && has_value)
+            config.planner_rate = std::atof(argv[++i]);
+        else if (arg == "--plan-freq" && has_value)
+            config.plan_freq = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--budget" && has_value)
+        {
+            if (std::sscanf(argv[++i], "%dx%d", &config.num_samples, &config.num_paths) != 2)
+            {
+                std::cerr << "bad budget " << argv[i] << ", expected <num_samples>x<num_paths>" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--target-plan-time" && has_value)
+            config.target_plan_time = std::atof(argv[++i]);
+        else if (arg == "--mpc-backend" && has_value)
+            config.mpc_backend = argv[++i];
+        else if (arg == "--mpc-horizon" && has_value)
+            config.mpc_horizon = std::atoi(argv[++i]);
+        else if (arg == "--adaptive-horizon")
+            config.adaptive_horizon = true;
+        else if (arg == "--mpc-deadline" && has_value)
+            config.mpc_deadline = std::atof(argv[++i]);
+        else if (arg == "--predict-state")
+            config.predict_state = true;
+        else if (arg == "--timeout" && has_value)
+            config.timeout = std::atof(argv[++i]);
+        else if (arg == "--seed" && has_value)
+            config.seed = std::atoi(argv[++i]);
+        else if (arg == "--output" && has_value)
+            output = argv[++i];
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+        else if (!PlanningScene::loadAll(arg, worlds))
+            return 1;
+    }
+    bool builtin = worlds.empty();
+    if (builtin)
+        builtinScenarios(config.seed, worlds);
+
+    std::vector<Scenario> scenarios;
+    for (size_t w = 0; w < worlds.size(); w++)
+        for (size_t q = 0; q < worlds[w].queries.size(); q++)
+        {
+            Scenario scenario;
+            scenario.name = worlds[w].queries.size() > 1 ? worlds[w].name + "_" + std::to_string(q) : worlds[w].name;
+            scenario.world = &worlds[w];
+            scenario.start = worlds[w].queries[q].start;
+            scenario.goal = worlds[w].queries[q].goal;
+            scenarios.push_back(scenario);
+        }
+    if (builtin)
+    {
+        // The open floor again, on pure pursuit only
+        Scenario scenario = scenarios[0];
+        scenario.name += "_missed_deadlines";
+        scenario.mpc_deadline = 1e-6;
+        scenarios.push_back(scenario);
+    }
+
+    ompl::RNG::setSeed(config.seed);
+    ompl::msg::setLogLevel(ompl::msg::LOG_WARN);
+    // Scenarios are the parallelism, one thread each for the network
+    if (jobs > 1)
+        torch::set_num_threads(1);
+
+    std::vector<SimResult> results(scenarios.size());
+    std::atomic<size_t> next(0);
+    double cpu_start = cpuTime();
+    std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+    boost::thread_group workers;
+    for (int j = 0; j < std::min<int>(jobs, scenarios.size()); j++)
+        workers.create_thread([&]()
+        {
+            for (size_t i = next++; i < scenarios.size(); i = next++)
+            {
+                simulate(config, scenarios[i], results[i]);
+                std::cerr << scenarios[i].name << ": " << results[i].outcome << " after " << results[i].sim_time << " s" << std::endl;
+            }
+        });
+    workers.join_all();
+    double cpu = cpuTime() - cpu_start, wall = bench::elapsed(wall_start);
+
+    double sim_time = 0;
+    size_t reached = 0;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        sim_time += results[i].sim_time;
+        reached += results[i].outcome == "goal";
+    }
+
+    FILE* out = stdout;
+    if (!output.empty() && (out = std::fopen(output.c_str(), "w")) == NULL)
+    {
+        std::cerr << "could not write " << output << std::endl;
+        return 1;
+    }
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"model\": \"%s\",\n", config.model_file.c_str());
+    std::fprintf(out, "  \"dt\": %g, \"planner_rate\": %g, \"plan_freq\": %d, \"num_samples\": %d, \"num_paths\": %d,\n",
+        config.dt, config.planner_rate, config.plan_freq, config.num_samples, config.num_paths);
+    std::fprintf(out, "  \"mpc_backend\": \"%s\", \"mpc_horizon\": %d, \"adaptive_horizon\": %s, \"mpc_deadline\": %g,\n",
+        config.mpc_backend.c_str(), config.mpc_horizon, config.adaptive_horizon ? "true" : "false", config.mpc_deadline);
+    std::fprintf(out, "  \"target_plan_time\": %g,\n", config.target_plan_time);
+    std::fprintf(out, "  \"jobs\": %d, \"seed\": %u,\n", jobs, config.seed);
+    std::fprintf(out, "  \"success_rate\": %.4f,\n", scenarios.empty() ? 0.0 : (double)reached / scenarios.size());
+    std::fprintf(out, "  \"simulated_s\": %.2f, \"wall_s\": %.2f, \"cpu_s\": %.2f, \"cpu_per_simulated_s\": %.4f,\n",
+        sim_time, wall, cpu, sim_time > 0 ? cpu / sim_time : 0.0);
+    std::fprintf(out, "  \"scenarios\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const SimResult& r = results[i];
+        std::fprintf(out, "    {\"name\": \"%s\", \"outcome\": \"%s\", \"time_s\": %.2f, \"distance_m\": %.2f, \"distance_to_goal_m\": %.2f, "
+            "\"planner_cycles\": %lu, \"replans\": %lu, \"mpnet_plans\": %lu, \"rrt_star_fallbacks\": %lu, \"planner_failures\": %lu, "
+            "\"planner_deadline_misses\": %lu, \"planner_mean_ms\": %.2f, \"planner_max_ms\": %.2f, "
+            "\"budget\": {\"num_samples\": %d, \"num_paths\": %d, \"simplify_time\": %g, \"replanning_freq\": %d, \"changes\": %lu}, "
+            "\"mpc_deadline\": %g, \"mpc_solves\": %lu, \"mpc_deadline_misses\": %lu, \"wall_per_simulated_s\": %.4f}%s\n",
+            r.name.c_str(), r.outcome.c_str(), r.sim_time, r.distance, r.distance_to_goal,
+            r.planner_cycles, r.replans, r.mpnet_plans, r.rrt_star_plans, r.planner_failures,
+            r.planner_deadline_misses, r.planner_cycles > 0 ? r.planner_time / r.planner_cycles * 1e3 : 0.0, r.planner_max * 1e3,
+            r.budget.num_samples, r.budget.num_paths, r.budget.simplify_time, r.budget.replanning_freq, r.budget_changes,
+            r.mpc_deadline, r.mpc_solves, r.mpc_deadline_misses, r.sim_time > 0 ? r.wall_time / r.sim_time : 0.0,
+            i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,428 @@
+/**
+ * Measures the throughput of the collision checkers on random SE2 states
+ * and Dubins motions over recorded costmaps, and compares their answers
+ * with an exact rasterization of the footprint, as JSON.
+ *
+ * Usage: collision_bench [<scene file or directory>...] [--log <query log>]... [options]
+ *
+ *   --log <query log>      Take the costmaps and footprints of a query log, repeatable
+ *   --max-costmaps <n>     Costmaps taken from each log (default 20)
+ *   --states <n>           Random states per costmap (default 20000)
+ *   --motions <n>          Random motions per costmap (default 2000)
+ *   --motion-length <m>    Largest distance between the ends of a motion (default 1.0)
+ *   --oracle-step <cells>  Step of the reference along a motion, in cells (default 0.25)
+ *   --seed <n>             Seed of the states and motions (default 1)
+ *   --output <file>        Write the JSON to a file instead of stdout
+ *
+ * The states are checked as MpnetCore::isStateValid checks them on the
+ * local costmap. The motions are checked with each checker by two motion
+ * validators: "discrete", the default of OMPL at the longest valid segment
+ * of the planner, and "dubins", the DubinsMotionValidator of the planner at
+ * the step for the resolution and footprint of each costmap. The reference
+ * for a motion is the exact check of states sampled along the Dubins curve
+ * at the oracle step. A false valid answer is a collision the checker
+ * misses, a false invalid answer a free state or motion it rejects.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ompl/base/ScopedState.h>
+#include <ompl/base/SpaceInformation.h>
+#include <ompl/base/spaces/DubinsStateSpace.h>
+
+#include <costmap_view.h>
+#include <dubins_motion_validator.h>
+#include <mpnet_core.h>
+#include <planning_scene.h>
+#include <query_log.h>
+
+#include "bench_common.h"
+
+namespace ob = ompl::base;
+
+using namespace mpnet_local_planner;
+
+namespace{
+    // The motion validators compared
+    const int num_validators = 2;
+    const char* validator_names[num_validators] = {"discrete", "dubins"};
+
+    /**
+     * @brief A costmap and the footprint checked on it
+     */
+    struct Workload{
+        std::string name;
+        CostmapView costmap;
+        std::vector<Point2D> footprint;
+        std::vector<SE2Pose> states;
+        std::vector<bool> states_valid; /** @brief The answers of the reference */
+        std::vector<std::pair<SE2Pose, SE2Pose> > motions;
+        std::vector<bool> motions_valid;
+    };
+
+    typedef std::function<bool(const CostmapView&, const SE2Pose&, const std::vector<Point2D>&)> CheckFunction;
+
+    /**
+     * @brief The motions checked by one motion validator
+     */
+    struct MotionResult{
+        MotionResult():
+        motions(0),
+        time(0),
+        checks(0),
+        false_valid(0),
+        false_invalid(0)
+        {
+        }
+
+        unsigned long motions;
+        double time;
+        unsigned long checks;
+        unsigned long false_valid, false_invalid;
+    };
+
+    /**
+     * @brief A state checker and its results over all costmaps
+     */
+    struct Checker{
+        Checker(const std::string& name, const CheckFunction& valid):
+        name(name),
+        valid(valid),
+        states(0),
+        states_time(0),
+        states_false_valid(0),
+        states_false_invalid(0),
+        motions(num_validators)
+        {
+        }
+
+        std::string name;
+        CheckFunction valid;
+        unsigned long states;
+        double states_time;
+        unsigned long states_false_valid, states_false_invalid;
+        std::vector<MotionResult> motions; /** @brief One per motion validator */
+    };
+
+    /**
+     * @brief The checkers to compare. The first is the reference.
+     */
+    std::vector<Checker> checkers()
+    {
+        std::vector<Checker> checkers;
+        checkers.push_back(Checker("exact", [](const CostmapView& costmap, const SE2Pose& pose, const std::vector<Point2D>& footprint)
+        {
+            return footprintCostExact(costmap, pose, footprint) >= 0;
+        }));
+        // The path of MpnetCore::isStateValid on the local costmap
+        checkers.push_back(Checker("footprint_cost", [](const CostmapView& costmap, const SE2Pose& pose, const std::vector<Point2D>& footprint)
+        {
+            return footprintCost(costmap, pose, footprint) >= 0;
+        }));
+        // The center cell only, as for a circular robot
+        checkers.push_back(Checker("center_cell", [](const CostmapView& costmap, const SE2Pose& pose, const std::vector<Point2D>& footprint)
+        {
+            return footprintCost(costmap, pose, std::vector<Point2D>()) >= 0;
+        }));
+        return checkers;
+    }
+
+    void setPose(ob::State* state, const SE2Pose& pose)
+    {
+        ob::SE2StateSpace::StateType* s = state->as<ob::SE2StateSpace::StateType>();
+        s->setXY(pose.x, pose.y);
+        s->setYaw(pose.yaw);
+    }
+
+    SE2Pose getPose(const ob::State* state)
+    {
+        const ob::SE2StateSpace::StateType* s = state->as<ob::SE2StateSpace::StateType>();
+        return SE2Pose(s->getX(), s->getY(), s->getYaw());
+    }
+
+    /**
+     * @brief Random states and motions over the costmap of a workload, with
+     * the answers of the reference. Motions start from free states.
+     */
+    void sample(Workload& workload, ob::SpaceInformation& si, std::mt19937& rng,
+                int num_states, int num_motions, double motion_length, double oracle_step)
+    {
+        const CostmapView& costmap = workload.costmap;
+        auto exact = [](const CostmapView& costmap, const SE2Pose& pose, const std::vector<Point2D>& footprint)
+        {
+            return footprintCostExact(costmap, pose, footprint) >= 0;
+        };
+        // Keep the robot center far enough in that most footprints stay on the map
+        double margin = 0;
+        for (size_t i = 0; i < workload.footprint.size(); i++)
+            margin = std::max(margin, std::hypot(workload.footprint[i].x, workload.footprint[i].y));
+        double width = std::max(0.0, costmap.size_x * costmap.resolution - 2 * margin);
+        double height = std::max(0.0, costmap.size_y * costmap.resolution - 2 * margin);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        auto randomPose = [&]()
+        {
+            return SE2Pose(costmap.origin_x + margin + width * uniform(rng), costmap.origin_y + margin + height * uniform(rng),
+                M_PI * (2 * uniform(rng) - 1));
+        };
+
+        for (int i = 0; i < num_states; i++)
+        {
+            workload.states.push_back(randomPose());
+            workload.states_valid.push_back(exact(costmap, workload.states.back(), workload.footprint));
+        }
+
+        ob::StateSpacePtr space = si.getStateSpace();
+        ob::ScopedState<> from(space), to(space), state(space);
+        ob::DubinsStateSpace::DubinsPath path;
+        double step = oracle_step * costmap.resolution;
+        for (int i = 0, tries = 0; i < num_motions && tries < 100 * num_motions; tries++)
+        {
+            SE2Pose start = randomPose();
+            if (!exact(costmap, start, workload.footprint))
+                continue;
+            double r = motion_length * uniform(rng), direction = M_PI * (2 * uniform(rng) - 1);
+            SE2Pose end(start.x + r * std::cos(direction), start.y + r * std::sin(direction), M_PI * (2 * uniform(rng) - 1));
+            setPose(from.get(), start);
+            setPose(to.get(), end);
+            int steps = std::max(1, (int)std::ceil(space->distance(from.get(), to.get()) / step));
+            bool valid = true, first_time = true;
+            for (int k = 1; k <= steps && valid; k++)
+            {
+                space->as<ob::DubinsStateSpace>()->interpolate(from.get(), to.get(), (double)k / steps, first_time, path, state.get());
+                valid = exact(costmap, getPose(state.get()), workload.footprint);
+            }
+            workload.motions.push_back(std::make_pair(start, end));
+            workload.motions_valid.push_back(valid);
+            i++;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> scene_paths, logs;
+    size_t max_costmaps = 20;
+    int num_states = 20000, num_motions = 2000;
+    double motion_length = 1.0, oracle_step = 0.25;
+    unsigned int seed = 1;
+    std::string output;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--log" && i + 1 < argc)
+            logs.push_back(argv[++i]);
+        else if (arg == "--max-costmaps" && i + 1 < argc)
+            max_costmaps = std::atol(argv[++i]);
+        else if (arg == "--states" && i + 1 < argc)
+            num_states = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--motions" && i + 1 < argc)
+            num_motions = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--motion-length" && i + 1 < argc)
+            motion_length = std::atof(argv[++i]);
+        else if (arg == "--oracle-step" && i + 1 < argc)
+            oracle_step = std::atof(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = std::atoi(argv[++i]);
+        else if (arg == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg.compare(0, 2, "--") != 0)
+            scene_paths.push_back(arg);
+        else
+        {
+            std::cerr << "usage: collision_bench [<scene file or directory>...] [--log <query log>]... [--max-costmaps <n>]\n"
+                         "                       [--states <n>] [--motions <n>] [--motion-length <m>] [--oracle-step <cells>]\n"
+                         "                       [--seed <n>] [--output <file>]" << std::endl;
+            return 1;
+        }
+    }
+    if (oracle_step <= 0)
+    {
+        std::cerr << "the oracle step must be positive" << std::endl;
+        return 1;
+    }
+
+    // The scenes and logs own the cells the workloads point to
+    std::vector<PlanningScene> scenes;
+    for (size_t i = 0; i < scene_paths.size(); i++)
+        if (!PlanningScene::loadAll(scene_paths[i], scenes))
+            return 1;
+    std::vector<std::unique_ptr<QueryLog> > query_logs;
+    std::vector<Workload> workloads;
+    for (size_t i = 0; i < scenes.size(); i++)
+    {
+        Workload workload;
+        workload.name = scenes[i].name;
+        workload.costmap = scenes[i].view();
+        workload.footprint = bench::robot_footprint;
+        workloads.push_back(workload);
+    }
+    for (size_t i = 0; i < logs.size(); i++)
+    {
+        query_logs.emplace_back(new QueryLog());
+        QueryLog& log = *query_logs.back();
+        if (!log.open(logs[i]))
+            return 1;
+        PlanningRecord record;
+        for (size_t r = 0; r < log.size() && r < max_costmaps; r++)
+        {
+            log.get(r, record);
+            Workload workload;
+            workload.name = logs[i] + ":" + std::to_string(r);
+            workload.costmap = record.costmap;
+            workload.footprint = record.footprint;
+            workloads.push_back(workload);
+        }
+    }
+    if (workloads.empty())
+    {
+        std::cerr << "no costmaps, give scenes or --log" << std::endl;
+        return 1;
+    }
+
+    // The space of MpnetCore, checked with either motion validator
+    ob::StateSpacePtr space(std::make_shared<ob::DubinsStateSpace>(MpnetCore::turning_radius));
+    ob::RealVectorBounds space_bounds(2);
+    space_bounds.setLow(0, -100);
+    space_bounds.setLow(1, -100);
+    space_bounds.setHigh(0, 100);
+    space_bounds.setHigh(1, 100);
+    space->as<ob::SE2StateSpace>()->setBounds(space_bounds);
+    space->setLongestValidSegmentFraction(0.0005);
+    ob::SpaceInformation si(space), si_dubins(space);
+    // The checker and workload the motion validators check with
+    Checker* checker = NULL;
+    const Workload* workload = NULL;
+    unsigned long* motion_checks = NULL;
+    auto valid = [&](const ob::State* state) -> bool
+    {
+        (*motion_checks)++;
+        return checker->valid(workload->costmap, getPose(state), workload->footprint);
+    };
+    si.setStateValidityChecker(valid);
+    si.setup();
+    si_dubins.setStateValidityChecker(valid);
+    std::shared_ptr<DubinsMotionValidator> dubins = std::make_shared<DubinsMotionValidator>(&si_dubins, MpnetCore::turning_radius, 0.05);
+    si_dubins.setMotionValidator(dubins);
+    si_dubins.setup();
+    ob::SpaceInformation* validators[num_validators] = {&si, &si_dubins};
+
+    std::mt19937 rng(seed);
+    unsigned long num_invalid_states = 0, num_invalid_motions = 0, total_states = 0, total_motions = 0;
+    for (size_t w = 0; w < workloads.size(); w++)
+    {
+        sample(workloads[w], si, rng, num_states, num_motions, motion_length, oracle_step);
+        total_states += workloads[w].states.size();
+        total_motions += workloads[w].motions.size();
+        num_invalid_states += std::count(workloads[w].states_valid.begin(), workloads[w].states_valid.end(), false);
+        num_invalid_motions += std::count(workloads[w].motions_valid.begin(), workloads[w].motions_valid.end(), false);
+    }
+
+    std::vector<Checker> results = checkers();
+    ob::ScopedState<> from(space), to(space);
+    for (size_t c = 0; c < results.size(); c++)
+    {
+        checker = &results[c];
+        for (size_t w = 0; w < workloads.size(); w++)
+        {
+            workload = &workloads[w];
+            const std::vector<SE2Pose>& states = workload->states;
+            std::vector<bool> answers(states.size());
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < states.size(); i++)
+                answers[i] = checker->valid(workload->costmap, states[i], workload->footprint);
+            checker->states_time += bench::elapsed(start);
+            checker->states += states.size();
+            for (size_t i = 0; i < states.size(); i++)
+            {
+                checker->states_false_valid += answers[i] && !workload->states_valid[i];
+                checker->states_false_invalid += !answers[i] && workload->states_valid[i];
+            }
+
+            const std::vector<std::pair<SE2Pose, SE2Pose> >& motions = workload->motions;
+            answers.resize(motions.size());
+            dubins->setStep(DubinsMotionValidator::stepFor(workload->costmap.resolution, workload->footprint, MpnetCore::turning_radius));
+            for (int v = 0; v < num_validators; v++)
+            {
+                MotionResult& result = checker->motions[v];
+                motion_checks = &result.checks;
+                for (size_t i = 0; i < motions.size(); i++)
+                {
+                    setPose(from.get(), motions[i].first);
+                    setPose(to.get(), motions[i].second);
+                    start = std::chrono::steady_clock::now();
+                    answers[i] = validators[v]->checkMotion(from.get(), to.get());
+                    result.time += bench::elapsed(start);
+                }
+                result.motions += motions.size();
+                for (size_t i = 0; i < motions.size(); i++)
+                {
+                    result.false_valid += answers[i] && !workload->motions_valid[i];
+                    result.false_invalid += !answers[i] && workload->motions_valid[i];
+                }
+            }
+        }
+        std::fprintf(stderr, "%-16s %12.0f states/s, %lu missed collisions\n", checker->name.c_str(),
+            checker->states_time > 0 ? checker->states / checker->states_time : 0.0, checker->states_false_valid);
+        for (int v = 0; v < num_validators; v++)
+        {
+            const MotionResult& result = checker->motions[v];
+            std::fprintf(stderr, "  %-14s %12.0f motions/s %8.1f checks/motion, %lu missed collisions\n", validator_names[v],
+                result.time > 0 ? result.motions / result.time : 0.0,
+                result.motions > 0 ? (double)result.checks / result.motions : 0.0, result.false_valid);
+        }
+    }
+
+    FILE* out = stdout;
+    if (!output.empty())
+    {
+        out = std::fopen(output.c_str(), "w");
+        if (!out)
+        {
+            std::cerr << "could not write " << output << std::endl;
+            return 1;
+        }
+    }
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"seed\": %u,\n", seed);
+    std::fprintf(out, "  \"costmaps\": %zu,\n", workloads.size());
+    std::fprintf(out, "  \"states\": %lu,\n", total_states);
+    std::fprintf(out, "  \"invalid_states\": %lu,\n", num_invalid_states);
+    std::fprintf(out, "  \"motions\": %lu,\n", total_motions);
+    std::fprintf(out, "  \"invalid_motions\": %lu,\n", num_invalid_motions);
+    std::fprintf(out, "  \"motion_length_m\": %.6g,\n", motion_length);
+    std::fprintf(out, "  \"oracle_step_cells\": %.6g,\n", oracle_step);
+    std::fprintf(out, "  \"checkers\": [\n");
+    for (size_t c = 0; c < results.size(); c++)
+    {
+        const Checker& r = results[c];
+        std::fprintf(out, "    {\n");
+        std::fprintf(out, "      \"name\": \"%s\",\n", r.name.c_str());
+        std::fprintf(out, "      \"states_per_s\": %.6g,\n", r.states_time > 0 ? r.states / r.states_time : 0.0);
+        std::fprintf(out, "      \"states_false_valid\": %lu,\n", r.states_false_valid);
+        std::fprintf(out, "      \"states_false_invalid\": %lu,\n", r.states_false_invalid);
+        std::fprintf(out, "      \"motions\": [\n");
+        for (int v = 0; v < num_validators; v++)
+        {
+            const MotionResult& m = r.motions[v];
+            std::fprintf(out, "        {\"validator\": \"%s\", \"motions_per_s\": %.6g, \"checks_per_motion\": %.6g, "
+                "\"false_valid\": %lu, \"false_invalid\": %lu}%s\n", validator_names[v],
+                m.time > 0 ? m.motions / m.time : 0.0, m.motions > 0 ? (double)m.checks / m.motions : 0.0,
+                m.false_valid, m.false_invalid, v + 1 < num_validators ? "," : "");
+        }
+        std::fprintf(out, "      ]\n");
+        std::fprintf(out, "    }%s\n", c + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
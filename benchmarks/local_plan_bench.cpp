@@ -0,0 +1,91 @@
+/**
+ * Compares the size and deserialization time of the nav_msgs/Path local plan
+ * with the compact LocalPlan message for the same plan.
+ *
+ * Usage: local_plan_bench [plan length (m)] [pose spacing (m)] [ds (m)] [iterations]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <ros/serialization.h>
+#include <nav_msgs/Path.h>
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+
+#include <local_plan.h>
+
+template <class M>
+std::vector<uint8_t> serialize(const M& msg)
+{
+    std::vector<uint8_t> buffer(ros::serialization::serializationLength(msg));
+    ros::serialization::OStream stream(buffer.data(), buffer.size());
+    ros::serialization::serialize(stream, msg);
+    return buffer;
+}
+
+// Mean time (us) to deserialize the buffer into a fresh message
+template <class M>
+double deserializeTime(std::vector<uint8_t>& buffer, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        M msg;
+        ros::serialization::IStream stream(buffer.data(), buffer.size());
+        ros::serialization::deserialize(stream, msg);
+        // Keep the message alive for the optimizer
+        volatile uint32_t seq = msg.header.seq;
+        (void)seq;
+    }
+    double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return elapsed / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    double length = argc > 1 ? std::atof(argv[1]) : 3.0;
+    double spacing = argc > 2 ? std::atof(argv[2]) : 0.01;
+    double ds = argc > 3 ? std::atof(argv[3]) : 0.05;
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 10000;
+
+    // An arc like the Dubins curves of the planner, stamped as it publishes them
+    nav_msgs::Path path;
+    path.header.frame_id = "odom";
+    const double radius = 1.5;
+    int poses = (int)(length / spacing) + 1;
+    for (int i = 0; i < poses; i++)
+    {
+        double angle = i * spacing / radius;
+        geometry_msgs::PoseStamped pose;
+        pose.header.frame_id = "odom";
+        pose.pose.position.x = radius * std::sin(angle);
+        pose.pose.position.y = radius * (1 - std::cos(angle));
+        tf2::Quaternion q;
+        q.setRPY(0, 0, angle);
+        tf2::convert(q, pose.pose.orientation);
+        path.poses.push_back(pose);
+    }
+
+    mpnet_plan::LocalPlan plan;
+    plan.header.frame_id = "odom";
+    plan.ds = ds;
+    auto start = std::chrono::steady_clock::now();
+    mpnet_local_planner::resamplePlan(path.poses, ds, plan);
+    double resample_time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint8_t> path_buffer = serialize(path);
+    std::vector<uint8_t> plan_buffer = serialize(plan);
+    double path_time = deserializeTime<nav_msgs::Path>(path_buffer, iterations);
+    double plan_time = deserializeTime<mpnet_plan::LocalPlan>(plan_buffer, iterations);
+
+    std::printf("plan: %.2f m, %d poses every %.3f m, LocalPlan ds %.3f m (%zu samples)\n", length, poses, spacing, ds, plan.x.size());
+    std::printf("%-22s %10s %16s\n", "message", "bytes", "deserialize (us)");
+    std::printf("%-22s %10zu %16.2f\n", "nav_msgs/Path", path_buffer.size(), path_time);
+    std::printf("%-22s %10zu %16.2f\n", "mpnet_plan/LocalPlan", plan_buffer.size(), plan_time);
+    std::printf("size ratio %.1fx, deserialize ratio %.1fx, resample %.1f us\n",
+        (double)path_buffer.size() / plan_buffer.size(), path_time / plan_time, resample_time);
+    return 0;
+}
@@ -0,0 +1,476 @@
+/**
+ * Tracks synthetic and recorded reference paths with the MPC in closed loop
+ * on the model, and reports for each solver configuration the solve time
+ * percentiles, the solver iterations, the failed solves, the solves that
+ * stopped at the iteration limit of the solver and the tracking error, per
+ * kind of reference, as JSON.
+ *
+ * Usage: mpc_bench [options]
+ *
+ *   --solver <backend>:<horizon>[:<option>=<value>,...]
+ *                        A configuration, repeatable (default ipopt and rti
+ *                        at every horizon of mpc_horizons). The options are
+ *                        IPOPT options, retape=yes to record the IPOPT tape
+ *                        on every solve, or max_qp_iterations for rti.
+ *   --log <query log>    Also track the paths of the successful plans of a log, repeatable
+ *   --max-paths <n>      Paths taken from each log (default 50)
+ *   --cycles <n>         Control cycles per reference at most (default 400)
+ *   --repeat <n>         Runs over each reference (default 1)
+ *   --warmup <n>         Solves before timing each configuration (default 5)
+ *   --cold               Reset the solver before every solve
+ *   --output <file>      Write the JSON to a file instead of stdout
+ *
+ * The references are sampled as the controller samples a local plan, one
+ * point per MPC step, and are given to the solver in the robot frame from
+ * the nearest point on, padded with the last point up to the horizon. The
+ * kinds are straight, arc, s_curve, near_goal (shorter than the horizons)
+ * and recorded.
+ *
+ * The tracking cost is the position term of the cost of FG_eval over the
+ * predicted trajectory, the cross track error is the distance of the
+ * simulated robot to the reference at every cycle.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <LatencyStats.h>
+#include <MPC.h>
+#include <query_log.h>
+
+using namespace mpnet_local_planner;
+
+namespace{
+    // Distance between the reference points, the distance the model covers in dt
+    const double step = ref_v * dt;
+
+    const char* kinds[] = {"straight", "arc", "s_curve", "near_goal", "recorded"};
+    const int num_kinds = sizeof(kinds) / sizeof(kinds[0]);
+
+    /**
+     * @brief A reference path and the pose the robot starts from
+     */
+    struct Reference{
+        std::string name;
+        int kind;
+        std::vector<double> x, y;
+        double start_x, start_y, start_yaw;
+    };
+
+    /**
+     * @brief A reference made of constant curvature pieces, from the origin
+     * along x
+     * @param pieces Curvature (1/m) and length (m) of each piece
+     * @param lateral Offset of the start of the robot to the left (m)
+     * @param heading Offset of the heading of the robot (rad)
+     */
+    Reference curve(const std::string& name, int kind, const std::vector<std::pair<double, double> >& pieces,
+                    double lateral = 0, double heading = 0)
+    {
+        Reference reference;
+        reference.name = name;
+        reference.kind = kind;
+        double x = 0, y = 0, yaw = 0;
+        reference.x.push_back(x);
+        reference.y.push_back(y);
+        for (size_t i = 0; i < pieces.size(); i++)
+        {
+            int points = (int)std::round(pieces[i].second / step);
+            for (int k = 0; k < points; k++)
+            {
+                x += step * std::cos(yaw);
+                y += step * std::sin(yaw);
+                yaw += step * pieces[i].first;
+                reference.x.push_back(x);
+                reference.y.push_back(y);
+            }
+        }
+        reference.start_x = 0;
+        reference.start_y = lateral;
+        reference.start_yaw = heading;
+        return reference;
+    }
+
+    std::vector<Reference> syntheticReferences()
+    {
+        typedef std::pair<double, double> Piece;
+        // The tightest turn the steering allows has a radius of Lf / max_steer
+        double tightest = BicycleModel::max_steer / Lf;
+        std::vector<Reference> references;
+        references.push_back(curve("straight", 0, {Piece(0, 2)}));
+        references.push_back(curve("straight_offset", 0, {Piece(0, 2)}, 0.1, 0.2));
+        references.push_back(curve("arc_r2_left", 1, {Piece(0.5, 2)}));
+        references.push_back(curve("arc_r1_left", 1, {Piece(1, 2)}));
+        references.push_back(curve("arc_r1_right", 1, {Piece(-1, 2)}, 0.05, 0.1));
+        references.push_back(curve("arc_tightest", 1, {Piece(0.95 * tightest, 1.5)}));
+        references.push_back(curve("s_curve_r2", 2, {Piece(0.5, 1.5), Piece(-0.5, 1.5)}));
+        references.push_back(curve("s_curve_r1", 2, {Piece(1, 1), Piece(-1, 1), Piece(1, 1)}));
+        references.push_back(curve("lane_change", 2, {Piece(0, 0.5), Piece(2, 0.3), Piece(-2, 0.3), Piece(0, 0.5)}));
+        references.push_back(curve("stub_5cm", 3, {Piece(0, 0.05)}));
+        references.push_back(curve("stub_20cm", 3, {Piece(0, 0.2)}, 0.03, 0.1));
+        references.push_back(curve("stub_turn", 3, {Piece(1.5, 0.15)}));
+        return references;
+    }
+
+    /**
+     * @brief The paths of the successful plans of a query log, sampled
+     * along their segments
+     */
+    bool recordedReferences(const std::string& file_name, size_t max_paths, std::vector<Reference>& references)
+    {
+        QueryLog log;
+        if (!log.open(file_name))
+            return false;
+        PlanningRecord record;
+        size_t taken = 0;
+        for (size_t i = 0; i < log.size() && taken < max_paths; i++)
+        {
+            log.get(i, record);
+            if (!record.success || record.path.size() < 2)
+                continue;
+            Reference reference;
+            char name[32];
+            std::snprintf(name, sizeof(name), "record_%zu", i);
+            reference.name = name;
+            reference.kind = 4;
+            reference.x.push_back(record.path[0].x);
+            reference.y.push_back(record.path[0].y);
+            // Distance along the segment of the next point
+            double along = step;
+            for (size_t k = 1; k < record.path.size(); k++)
+            {
+                double dx = record.path[k].x - record.path[k-1].x, dy = record.path[k].y - record.path[k-1].y;
+                double length = std::hypot(dx, dy);
+                for (; along <= length; along += step)
+                {
+                    reference.x.push_back(record.path[k-1].x + dx * along / length);
+                    reference.y.push_back(record.path[k-1].y + dy * along / length);
+                }
+                along -= length;
+            }
+            reference.start_x = record.path[0].x;
+            reference.start_y = record.path[0].y;
+            reference.start_yaw = record.path[0].yaw;
+            references.push_back(reference);
+            taken++;
+        }
+        std::cerr << file_name << ": " << taken << " paths" << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief Results of a configuration on one kind of reference
+     */
+    struct Stats{
+        Stats(size_t solves):
+        solve_time(solves),
+        iterations(solves),
+        cost(solves),
+        cross_track(solves),
+        solves(0),
+        failures(0),
+        unconverged(0),
+        solve_time_sum(0),
+        iterations_sum(0),
+        cost_sum(0),
+        cross_track_sum(0)
+        {
+        }
+
+        LatencyStats solve_time, iterations, cost, cross_track;
+        unsigned long solves, failures, unconverged;
+        double solve_time_sum, iterations_sum, cost_sum, cross_track_sum;
+    };
+
+    /**
+     * @brief A backend, horizon and options
+     */
+    struct Configuration{
+        std::string name, backend;
+        int horizon;
+        std::vector<std::pair<std::string, std::string> > options;
+        std::vector<Stats> stats;
+    };
+
+    bool parseConfiguration(const std::string& spec, Configuration& configuration)
+    {
+        configuration.name = spec;
+        size_t colon = spec.find(':');
+        if (colon == std::string::npos)
+            return false;
+        configuration.backend = spec.substr(0, colon);
+        size_t next = spec.find(':', colon + 1);
+        configuration.horizon = std::atoi(spec.substr(colon + 1, next - colon - 1).c_str());
+        while (next != std::string::npos)
+        {
+            size_t begin = next + 1;
+            next = spec.find(',', begin);
+            std::string option = spec.substr(begin, next == std::string::npos ? std::string::npos : next - begin);
+            size_t equals = option.find('=');
+            if (equals == std::string::npos)
+                return false;
+            configuration.options.push_back(std::make_pair(option.substr(0, equals), option.substr(equals + 1)));
+        }
+        return true;
+    }
+
+    MPCSolver* createSolver(const Configuration& configuration)
+    {
+        MPCSolver* solver = createMPCSolver(configuration.backend, configuration.horizon);
+        if (!solver)
+        {
+            std::cerr << configuration.name << ": unknown backend or horizon" << std::endl;
+            return NULL;
+        }
+        for (size_t i = 0; i < configuration.options.size(); i++)
+            if (!solver->SetOption(configuration.options[i].first, configuration.options[i].second))
+            {
+                std::cerr << configuration.name << ": bad option " << configuration.options[i].first << std::endl;
+                delete solver;
+                return NULL;
+            }
+        return solver;
+    }
+
+    /**
+     * @brief Track a reference as the controller does, on the model
+     * @param stats Where to add the solves, NULL to only warm up
+     * @param max_solves Stop after this many solves
+     */
+    void track(MPCSolver& solver, const Reference& reference, int max_cycles, bool cold, Stats* stats, int max_solves = -1)
+    {
+        int horizon = solver.horizon();
+        int n = reference.x.size();
+        double x = reference.start_x, y = reference.start_y, yaw = reference.start_yaw;
+        double steering = 0;
+        int curr = 0;
+        HorizonVector ptsx, ptsy;
+        MPCSolution solution;
+        solver.Reset();
+        for (int cycle = 0; cycle < max_cycles && cycle != max_solves; cycle++)
+        {
+            // Nearest point from the previous one on
+            double nearest = std::hypot(reference.x[curr] - x, reference.y[curr] - y);
+            for (int i = curr + 1; i < n; i++)
+            {
+                double distance = std::hypot(reference.x[i] - x, reference.y[i] - y);
+                if (distance < nearest)
+                {
+                    nearest = distance;
+                    curr = i;
+                }
+            }
+            if (curr == n - 1 && cycle > 0)
+                break;
+
+            // The reference in the robot frame, padded with the last point
+            ptsx.resize(horizon);
+            ptsy.resize(horizon);
+            for (int i = 0; i < horizon; i++)
+            {
+                int j = std::min(curr + i, n - 1);
+                double dx = reference.x[j] - x, dy = reference.y[j] - y;
+                ptsx[i] = dx * std::cos(yaw) + dy * std::sin(yaw);
+                ptsy[i] = dy * std::cos(yaw) - dx * std::sin(yaw);
+            }
+            // The state the solution is applied from, as the controller predicts it
+            MPCState state;
+            state.x = ref_v * dt;
+            state.y = 0;
+            state.psi = ref_v * steering / Lf * dt;
+            state.v = ref_v;
+
+            if (cold)
+                solver.Reset();
+            bool ok = solver.Solve(state, ptsx, ptsy, solution);
+            if (ok)
+                steering = std::max(-BicycleModel::max_steer, std::min(BicycleModel::max_steer, solution.steering));
+
+            if (stats)
+            {
+                double cost = 0;
+                for (int t = 1; t < horizon && t - 1 < solution.x.size(); t++)
+                    cost += 500 * (std::pow(solution.x[t-1] - ptsx[t], 2) + std::pow(solution.y[t-1] - ptsy[t], 2));
+                stats->solves++;
+                stats->failures += !ok;
+                stats->unconverged += !solver.lastConverged();
+                stats->solve_time.add(solver.lastSolveTime());
+                stats->solve_time_sum += solver.lastSolveTime();
+                stats->iterations.add(solver.lastIterations());
+                stats->iterations_sum += solver.lastIterations();
+                stats->cost.add(cost);
+                stats->cost_sum += cost;
+                stats->cross_track.add(nearest);
+                stats->cross_track_sum += nearest;
+            }
+
+            // A step of the model with the steering applied
+            x += ref_v * std::cos(yaw) * dt;
+            y += ref_v * std::sin(yaw) * dt;
+            yaw += ref_v * steering / Lf * dt;
+        }
+    }
+
+    void printSummary(FILE* out, const char* key, LatencyStats& stats, double sum, double scale, const char* trailer)
+    {
+        double mean = stats.size() > 0 ? sum / stats.size() : 0;
+        std::fprintf(out, "          \"%s\": {\"mean\": %.6g, \"p50\": %.6g, \"p95\": %.6g, \"p99\": %.6g, \"max\": %.6g}%s\n",
+            key, mean * scale, stats.percentile(50) * scale, stats.percentile(95) * scale, stats.percentile(99) * scale, stats.max() * scale, trailer);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<Configuration> configurations;
+    std::vector<std::string> logs;
+    size_t max_paths = 50;
+    int max_cycles = 400, repeat = 1, warmup = 5;
+    bool cold = false;
+    std::string output;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--solver" && i + 1 < argc)
+        {
+            Configuration configuration;
+            if (!parseConfiguration(argv[++i], configuration))
+            {
+                std::cerr << "bad solver " << argv[i] << ", expected <backend>:<horizon>[:<option>=<value>,...]" << std::endl;
+                return 1;
+            }
+            configurations.push_back(configuration);
+        }
+        else if (arg == "--log" && i + 1 < argc)
+            logs.push_back(argv[++i]);
+        else if (arg == "--max-paths" && i + 1 < argc)
+            max_paths = std::atol(argv[++i]);
+        else if (arg == "--cycles" && i + 1 < argc)
+            max_cycles = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--repeat" && i + 1 < argc)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--cold")
+            cold = true;
+        else if (arg == "--output" && i + 1 < argc)
+            output = argv[++i];
+        else
+        {
+            std::cerr << "usage: mpc_bench [--solver <backend>:<horizon>[:<option>=<value>,...]]... [--log <query log>]...\n"
+                         "                 [--max-paths <n>] [--cycles <n>] [--repeat <n>] [--warmup <n>] [--cold] [--output <file>]" << std::endl;
+            return 1;
+        }
+    }
+    if (configurations.empty())
+    {
+        const char* backends[] = {"ipopt", "rti"};
+        for (int b = 0; b < 2; b++)
+            for (size_t h = 0; h < sizeof(mpc_horizons) / sizeof(mpc_horizons[0]); h++)
+            {
+                Configuration configuration;
+                configuration.name = std::string(backends[b]) + ":" + std::to_string(mpc_horizons[h]);
+                configuration.backend = backends[b];
+                configuration.horizon = mpc_horizons[h];
+                configurations.push_back(configuration);
+            }
+    }
+
+    std::vector<Reference> references = syntheticReferences();
+    for (size_t i = 0; i < logs.size(); i++)
+        if (!recordedReferences(logs[i], max_paths, references))
+            return 1;
+
+    // Enough room in the percentile windows for every solve of a kind
+    std::vector<size_t> solves_per_kind(num_kinds, 0);
+    for (size_t r = 0; r < references.size(); r++)
+        solves_per_kind[references[r].kind] += std::min<size_t>(max_cycles, references[r].x.size()) * repeat;
+
+    for (size_t c = 0; c < configurations.size(); c++)
+    {
+        Configuration& configuration = configurations[c];
+        std::unique_ptr<MPCSolver> solver(createSolver(configuration));
+        if (!solver)
+            return 1;
+        for (int k = 0; k < num_kinds; k++)
+            configuration.stats.push_back(Stats(std::max<size_t>(1, solves_per_kind[k])));
+
+        // Warm the allocations and caches of the solver up
+        track(*solver, references[0], max_cycles, cold, NULL, warmup);
+        for (int run = 0; run < repeat; run++)
+            for (size_t r = 0; r < references.size(); r++)
+                track(*solver, references[r], max_cycles, cold, &configuration.stats[references[r].kind]);
+
+        unsigned long solves = 0, failures = 0, unconverged = 0;
+        double solve_time = 0;
+        for (int k = 0; k < num_kinds; k++)
+        {
+            solves += configuration.stats[k].solves;
+            failures += configuration.stats[k].failures;
+            unconverged += configuration.stats[k].unconverged;
+            solve_time += configuration.stats[k].solve_time_sum;
+        }
+        std::fprintf(stderr, "%-24s %8lu solves, %6lu failed, %6lu unconverged, %8.3f ms mean\n", configuration.name.c_str(),
+            solves, failures, unconverged, solves > 0 ? solve_time / solves * 1e3 : 0.0);
+    }
+
+    FILE* out = stdout;
+    if (!output.empty())
+    {
+        out = std::fopen(output.c_str(), "w");
+        if (!out)
+        {
+            std::cerr << "could not write " << output << std::endl;
+            return 1;
+        }
+    }
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"references\": %zu,\n", references.size());
+    std::fprintf(out, "  \"max_cycles\": %d,\n", max_cycles);
+    std::fprintf(out, "  \"repeat\": %d,\n", repeat);
+    std::fprintf(out, "  \"cold\": %s,\n", cold ? "true" : "false");
+    std::fprintf(out, "  \"solvers\": [\n");
+    for (size_t c = 0; c < configurations.size(); c++)
+    {
+        Configuration& configuration = configurations[c];
+        std::fprintf(out, "    {\n");
+        std::fprintf(out, "      \"name\": \"%s\",\n", configuration.name.c_str());
+        std::fprintf(out, "      \"backend\": \"%s\",\n", configuration.backend.c_str());
+        std::fprintf(out, "      \"horizon\": %d,\n", configuration.horizon);
+        std::fprintf(out, "      \"options\": {");
+        for (size_t i = 0; i < configuration.options.size(); i++)
+            std::fprintf(out, "%s\"%s\": \"%s\"", i > 0 ? ", " : "", configuration.options[i].first.c_str(), configuration.options[i].second.c_str());
+        std::fprintf(out, "},\n");
+        std::fprintf(out, "      \"kinds\": [\n");
+        bool first = true;
+        for (int k = 0; k < num_kinds; k++)
+        {
+            Stats& stats = configuration.stats[k];
+            if (stats.solves == 0)
+                continue;
+            std::fprintf(out, "%s        {\n", first ? "" : ",\n");
+            first = false;
+            std::fprintf(out, "          \"kind\": \"%s\",\n", kinds[k]);
+            std::fprintf(out, "          \"solves\": %lu,\n", stats.solves);
+            std::fprintf(out, "          \"failures\": %lu,\n", stats.failures);
+            std::fprintf(out, "          \"unconverged\": %lu,\n", stats.unconverged);
+            printSummary(out, "solve_ms", stats.solve_time, stats.solve_time_sum, 1e3, ",");
+            printSummary(out, "iterations", stats.iterations, stats.iterations_sum, 1, ",");
+            printSummary(out, "tracking_cost", stats.cost, stats.cost_sum, 1, ",");
+            printSummary(out, "cross_track_m", stats.cross_track, stats.cross_track_sum, 1, "");
+            std::fprintf(out, "        }");
+        }
+        std::fprintf(out, "\n      ]\n");
+        std::fprintf(out, "    }%s\n", c + 1 < configurations.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,419 @@
+/**
+ * Plans the queries of a corpus of scenes offline and reports, for MPNet at
+ * each rollout budget, MPNet with the RRT* fallback of the plugin, and RRT*
+ * alone: success rate, path length, collision checks and latency
+ * percentiles, as JSON.
+ *
+ * Usage:
+ *   planner_bench generate <directory> [scenes] [queries per scene] [seed]
+ *   planner_bench run <model file> <scene file or directory>... [options]
+ *
+ * Options of run:
+ *   --budget <num_samples>x<num_paths>  An MPNet budget, repeatable (default 5x10)
+ *   --seed <n>                          Seed of OMPL and torch (default 1)
+ *   --repeat <n>                        Plans per query (default 1)
+ *   --warmup <n>                        Plans before timing each planner (default 3)
+ *   --xy-tol <m>, --yaw-tol <rad>       Goal tolerances (default 0.2, 0.3)
+ *   --library <file>                    Also run each budget with a path library, see below
+ *   --rrt-iterations <n>                RRT* iterations per plan (default 2000), 0 for the
+ *                                       0.1 s of the plugin, see below
+ *   --output <file>                     Write the JSON to a file instead of stdout
+ *
+ * With a library each budget is also run as the plugin runs with
+ * path_library: the stored paths near the query are repaired first, MPNet
+ * plans when none repairs, and every path found is stored. The scenes are
+ * taken as the map frame. The library file is kept, a later run starts
+ * from the paths of the earlier ones, and the budgets share it, so use
+ * --repeat to plan each query again within a run.
+ *
+ * The runs are deterministic for a seed: OMPL is seeded before any planner
+ * is made and the core seeds torch before every plan. RRT* stops after a
+ * number of iterations and simplifies its path fully, where the plugin
+ * plans for 0.1 s and simplifies for 0.05 s. With --rrt-iterations 0 the
+ * RRT* results are for the time budget of the plugin, and depend on the
+ * speed and load of the machine, so they are not repeatable.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <ompl/util/Console.h>
+#include <ompl/util/RandomNumbers.h>
+
+#include <LatencyStats.h>
+#include <mpnet_core.h>
+#include <path_library.h>
+#include <planning_scene.h>
+
+#include "bench_common.h"
+
+using namespace mpnet_local_planner;
+
+namespace{
+    /**
+     * @brief Results of one planner over the corpus
+     */
+    struct Result{
+        Result(const std::string& name, size_t plans):
+        name(name),
+        num_samples(0),
+        num_paths(0),
+        latency(plans),
+        checks(plans),
+        length(plans),
+        attempts(0),
+        successes(0),
+        fallbacks(0),
+        library_hits(0),
+        latency_sum(0),
+        checks_sum(0),
+        length_sum(0)
+        {
+        }
+
+        void add(bool success, double seconds, unsigned long plan_checks, const std::vector<SE2Pose>& path)
+        {
+            attempts++;
+            latency.add(seconds);
+            latency_sum += seconds;
+            checks.add(plan_checks);
+            checks_sum += plan_checks;
+            if (!success)
+                return;
+            successes++;
+            double path_length = 0;
+            for (size_t i = 1; i < path.size(); i++)
+                path_length += std::hypot(path[i].x - path[i-1].x, path[i].y - path[i-1].y);
+            length.add(path_length);
+            length_sum += path_length;
+        }
+
+        std::string name;
+        int num_samples, num_paths;
+        LatencyStats latency, checks, length;
+        unsigned long attempts, successes, fallbacks;
+        unsigned long library_hits; /** @brief Plans repaired from the path library */
+        double latency_sum, checks_sum, length_sum;
+    };
+
+    /**
+     * @brief A local costmap with random boxes and discs, inflated as the
+     * inflation layer does, and queries from its center to free poses
+     */
+    PlanningScene randomScene(std::mt19937& rng, const std::string& name, int num_queries)
+    {
+        const unsigned int size = 120;
+        const double resolution = 0.05;
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        double robot_x = -20 + 40 * uniform(rng), robot_y = -20 + 40 * uniform(rng);
+        PlanningScene scene(size, size, resolution, robot_x - size * resolution / 2, robot_y - size * resolution / 2);
+        scene.name = name;
+
+        // Obstacles, leaving the robot clear
+        int num_obstacles = 3 + (int)(6 * uniform(rng));
+        for (int k = 0; k < num_obstacles; k++)
+        {
+            double cx = 6 * uniform(rng), cy = 6 * uniform(rng);
+            double w = 0.2 + 0.8 * uniform(rng), h = 0.2 + 0.8 * uniform(rng);
+            bool disc = uniform(rng) < 0.3;
+            if (std::hypot(cx - 3, cy - 3) < 0.6 + std::max(w, h) / 2)
+                continue;
+            for (unsigned int y = 0; y < size; y++)
+                for (unsigned int x = 0; x < size; x++)
+                {
+                    double dx = (x + 0.5) * resolution - cx, dy = (y + 0.5) * resolution - cy;
+                    bool inside = disc ? std::hypot(dx, dy) <= w / 2 : std::fabs(dx) <= w / 2 && std::fabs(dy) <= h / 2;
+                    if (inside)
+                        scene.cells[y * size + x] = LETHAL_OBSTACLE;
+                }
+        }
+        scene.inflate(bench::inscribed_radius, bench::inflation_radius, bench::cost_scaling_factor);
+
+        CostmapView view = scene.view();
+        for (int q = 0, tries = 0; q < num_queries && tries < 1000 * num_queries; tries++)
+        {
+            PlanningQuery query(SE2Pose(robot_x, robot_y, M_PI * (2 * uniform(rng) - 1)),
+                SE2Pose(scene.origin_x + 0.4 + 5.2 * uniform(rng), scene.origin_y + 0.4 + 5.2 * uniform(rng), M_PI * (2 * uniform(rng) - 1)));
+            if (std::hypot(query.goal.x - robot_x, query.goal.y - robot_y) < 1.0)
+                continue;
+            if (footprintCost(view, query.start, bench::robot_footprint) < 0 || footprintCost(view, query.goal, bench::robot_footprint) < 0)
+                continue;
+            scene.queries.push_back(query);
+            q++;
+        }
+        return scene;
+    }
+
+    int generate(int argc, char** argv)
+    {
+        if (argc < 3)
+        {
+            std::cerr << "usage: planner_bench generate <directory> [scenes] [queries per scene] [seed]" << std::endl;
+            return 1;
+        }
+        boost::filesystem::path directory(argv[2]);
+        int num_scenes = argc > 3 ? std::atoi(argv[3]) : 20;
+        int num_queries = argc > 4 ? std::atoi(argv[4]) : 5;
+        std::mt19937 rng(argc > 5 ? std::atoi(argv[5]) : 1);
+        boost::filesystem::create_directories(directory);
+        for (int i = 0; i < num_scenes; i++)
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "random_%03d", i);
+            PlanningScene scene = randomScene(rng, name, num_queries);
+            std::string file_name = (directory / (std::string(name) + ".scene")).string();
+            if (!scene.save(file_name))
+            {
+                std::cerr << "could not write " << file_name << std::endl;
+                return 1;
+            }
+        }
+        std::cerr << "wrote " << num_scenes << " scenes to " << directory.string() << std::endl;
+        return 0;
+    }
+
+    void printSummary(FILE* out, const char* key, LatencyStats& stats, double sum, double scale, const char* trailer)
+    {
+        double mean = stats.size() > 0 ? sum / stats.size() : 0;
+        std::fprintf(out, "      \"%s\": {\"mean\": %.6g, \"p50\": %.6g, \"p95\": %.6g, \"p99\": %.6g, \"max\": %.6g}%s\n",
+            key, mean * scale, stats.percentile(50) * scale, stats.percentile(95) * scale, stats.percentile(99) * scale, stats.max() * scale, trailer);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::strcmp(argv[1], "generate") == 0)
+        return generate(argc, argv);
+    if (argc < 4 || std::strcmp(argv[1], "run") != 0)
+    {
+        std::cerr << "usage: planner_bench generate <directory> [scenes] [queries per scene] [seed]\n"
+                  << "       planner_bench run <model file> <scene file or directory>... [--budget SxP]... [--seed n]"
+                  << " [--repeat n] [--warmup n] [--xy-tol m] [--yaw-tol rad] [--library file] [--rrt-iterations n] [--output file]" << std::endl;
+        return 1;
+    }
+
+    std::string model_file = argv[2];
+    std::vector<PlanningScene> scenes;
+    std::vector<std::pair<int, int> > budgets;
+    unsigned int seed = 1;
+    int repeat = 1, warmup = 3;
+    unsigned int rrt_iterations = 2000;
+    double xy_tolerance = 0.2, yaw_tolerance = 0.3;
+    std::string output, library_file;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--budget" && has_value)
+        {
+            int num_samples, num_paths;
+            if (std::sscanf(argv[++i], "%dx%d", &num_samples, &num_paths) != 2)
+            {
+                std::cerr << "bad budget " << argv[i] << ", expected <num_samples>x<num_paths>" << std::endl;
+                return 1;
+            }
+            budgets.push_back(std::make_pair(num_samples, num_paths));
+        }
+        else if (arg == "--seed" && has_value)
+            seed = std::atoi(argv[++i]);
+        else if (arg == "--repeat" && has_value)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup" && has_value)
+            warmup = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--xy-tol" && has_value)
+            xy_tolerance = std::atof(argv[++i]);
+        else if (arg == "--yaw-tol" && has_value)
+            yaw_tolerance = std::atof(argv[++i]);
+        else if (arg == "--library" && has_value)
+            library_file = argv[++i];
+        else if (arg == "--rrt-iterations" && has_value)
+            rrt_iterations = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--output" && has_value)
+            output = argv[++i];
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+        else if (!PlanningScene::loadAll(arg, scenes))
+            return 1;
+    }
+    if (budgets.empty())
+        budgets.push_back(std::make_pair(5, 10));
+
+    size_t num_queries = 0;
+    for (size_t s = 0; s < scenes.size(); s++)
+        num_queries += scenes[s].queries.size();
+    if (num_queries == 0)
+    {
+        std::cerr << "no queries in the scenes" << std::endl;
+        return 1;
+    }
+    size_t plans = num_queries * repeat;
+
+    // Before any planner, so every RNG OMPL makes comes from this seed
+    ompl::RNG::setSeed(seed);
+    ompl::msg::setLogLevel(ompl::msg::LOG_WARN);
+
+    PathLibrary library;
+    if (!library_file.empty() && !library.open(library_file))
+        return 1;
+    std::vector<PathLibrary::Match> matches;
+
+    std::vector<Result> results;
+    std::vector<SE2Pose> path;
+    unsigned long invalid_starts = 0;
+    for (size_t b = 0; b <= budgets.size(); b++)
+    {
+        // The last pass is RRT* alone
+        bool rrt_only = b == budgets.size();
+        int num_samples = rrt_only ? 1 : budgets[b].first;
+        int num_paths = rrt_only ? 1 : budgets[b].second;
+        MpnetCore core(model_file, xy_tolerance, yaw_tolerance, num_samples, num_paths, bench::robot_footprint);
+        PlannerMetrics& metrics = core.getMetrics();
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "mpnet_%dx%d", num_samples, num_paths);
+        Result mpnet(rrt_only ? "rrt_star" : name, plans);
+        Result fallback(std::string(name) + "_rrt_star", plans);
+        Result from_library(std::string(name) + "_library", plans);
+        mpnet.num_samples = fallback.num_samples = from_library.num_samples = rrt_only ? 0 : num_samples;
+        mpnet.num_paths = fallback.num_paths = from_library.num_paths = rrt_only ? 0 : num_paths;
+        std::cerr << "running " << mpnet.name << " on " << plans << " plans" << std::endl;
+
+        // The first plans pay for loading the network onto the device
+        const PlanningScene& first = *std::find_if(scenes.begin(), scenes.end(),
+            [](const PlanningScene& scene) { return !scene.queries.empty(); });
+        core.setCostmap(first.view());
+        for (int i = 0; i < warmup; i++)
+        {
+            if (rrt_only)
+                core.planRRTStar(first.queries[0].start, first.queries[0].goal, path, rrt_iterations);
+            else
+                core.plan(first.queries[0].start, first.queries[0].goal, first.bounds(), path);
+        }
+
+        uint64_t plan_index = 0;
+        invalid_starts = 0;
+        for (size_t s = 0; s < scenes.size(); s++)
+        {
+            const PlanningScene& scene = scenes[s];
+            core.setCostmap(scene.view());
+            std::vector<double> bounds = scene.bounds();
+            for (size_t q = 0; q < scene.queries.size(); q++)
+            {
+                const PlanningQuery& query = scene.queries[q];
+                // The plugin does not plan from a pose in collision
+                if (!core.isStateValid(query.start, bench::robot_footprint))
+                {
+                    invalid_starts++;
+                    continue;
+                }
+                for (int r = 0; r < repeat; r++)
+                {
+                    uint64_t plan_seed = seed + plan_index++;
+                    core.setSeed(plan_seed);
+                    unsigned long checks = metrics.getCollisionChecks();
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    bool success;
+                    if (rrt_only)
+                        success = core.planRRTStar(query.start, query.goal, path, rrt_iterations);
+                    else
+                        success = core.plan(query.start, query.goal, bounds, path) >= 0;
+                    double seconds = bench::elapsed(start);
+                    unsigned long plan_checks = metrics.getCollisionChecks() - checks;
+                    mpnet.add(success, seconds, plan_checks, path);
+                    if (rrt_only)
+                        continue;
+
+                    // As computeVelocityCommands, RRT* when MPNet finds nothing
+                    if (!success)
+                    {
+                        fallback.fallbacks++;
+                        start = std::chrono::steady_clock::now();
+                        success = core.planRRTStar(query.start, query.goal, path, rrt_iterations);
+                        seconds += bench::elapsed(start);
+                        plan_checks = metrics.getCollisionChecks() - checks;
+                    }
+                    fallback.add(success, seconds, plan_checks, path);
+                    if (!library.isOpen())
+                        continue;
+
+                    // As getPath with a library, MPNet with the same seed on a miss
+                    core.setSeed(plan_seed);
+                    checks = metrics.getCollisionChecks();
+                    start = std::chrono::steady_clock::now();
+                    double cost = -1;
+                    library.find(query.start, query.goal, 3, matches);
+                    size_t repaired = 0;
+                    for (size_t m = 0; m < matches.size() && cost < 0; m++)
+                    {
+                        cost = core.planFromPath(query.start, query.goal, matches[m].poses, path);
+                        if (cost >= 0)
+                        {
+                            library.markUsed(matches[m].slot);
+                            from_library.library_hits++;
+                            repaired = m;
+                        }
+                    }
+                    if (cost >= 0)
+                        library.replace(matches[repaired].slot, path);
+                    else if ((cost = core.plan(query.start, query.goal, bounds, path)) >= 0)
+                        library.add(path);
+                    from_library.add(cost >= 0, bench::elapsed(start), metrics.getCollisionChecks() - checks, path);
+                }
+            }
+        }
+        results.push_back(mpnet);
+        if (!rrt_only)
+            results.push_back(fallback);
+        if (!rrt_only && library.isOpen())
+            results.push_back(from_library);
+    }
+
+    FILE* out = stdout;
+    if (!output.empty() && (out = std::fopen(output.c_str(), "w")) == NULL)
+    {
+        std::cerr << "could not write " << output << std::endl;
+        return 1;
+    }
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"model\": \"%s\",\n", model_file.c_str());
+    std::fprintf(out, "  \"seed\": %u,\n", seed);
+    std::fprintf(out, "  \"scenes\": %zu,\n", scenes.size());
+    std::fprintf(out, "  \"queries\": %zu,\n", num_queries);
+    std::fprintf(out, "  \"invalid_starts\": %lu,\n", invalid_starts);
+    std::fprintf(out, "  \"repeat\": %d,\n", repeat);
+    std::fprintf(out, "  \"rrt_iterations\": %u,\n", rrt_iterations);
+    if (library.isOpen())
+        std::fprintf(out, "  \"library_paths\": %zu,\n", library.size());
+    std::fprintf(out, "  \"planners\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        Result& r = results[i];
+        std::fprintf(out, "    {\n");
+        std::fprintf(out, "      \"name\": \"%s\",\n", r.name.c_str());
+        std::fprintf(out, "      \"num_samples\": %d,\n", r.num_samples);
+        std::fprintf(out, "      \"num_paths\": %d,\n", r.num_paths);
+        std::fprintf(out, "      \"plans\": %lu,\n", r.attempts);
+        std::fprintf(out, "      \"success_rate\": %.4f,\n", r.attempts > 0 ? (double)r.successes / r.attempts : 0.0);
+        std::fprintf(out, "      \"fallbacks\": %lu,\n", r.fallbacks);
+        std::fprintf(out, "      \"library_hits\": %lu,\n", r.library_hits);
+        printSummary(out, "latency_ms", r.latency, r.latency_sum, 1e3, ",");
+        printSummary(out, "collision_checks", r.checks, r.checks_sum, 1, ",");
+        printSummary(out, "path_length_m", r.length, r.length_sum, 1, "");
+        std::fprintf(out, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
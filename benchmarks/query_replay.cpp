@@ -0,0 +1,166 @@
+/**
+ * Plans the queries of a query log again with this build, as fast as it
+ * can, and compares the results with the recorded ones.
+ *
+ * Usage: query_replay <model file> <query log> [--record <index>] [--scene <file>] [--quiet]
+ *
+ *   --record <index>  Only this record
+ *   --scene <file>    Write the record as a scene for planner_bench, with --record
+ *   --quiet           Only the summary
+ *
+ * The network is seeded with the recorded seed, and paths are simplified
+ * with the recorded budget. OMPL, and so RRT* and the
+ * path simplification, is seeded once, so their paths can differ from the
+ * recorded ones.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <ompl/util/Console.h>
+#include <ompl/util/RandomNumbers.h>
+#include <boost/shared_ptr.hpp>
+
+#include <mpnet_core.h>
+#include <query_log.h>
+
+using namespace mpnet_local_planner;
+
+namespace{
+    bool sameParameters(const PlanningRecord& a, const PlanningRecord& b)
+    {
+        if (a.xy_tolerance != b.xy_tolerance || a.yaw_tolerance != b.yaw_tolerance ||
+            a.num_samples != b.num_samples || a.num_paths != b.num_paths || a.footprint.size() != b.footprint.size())
+            return false;
+        for (size_t i = 0; i < a.footprint.size(); i++)
+            if (a.footprint[i].x != b.footprint[i].x || a.footprint[i].y != b.footprint[i].y)
+                return false;
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: query_replay <model file> <query log> [--record <index>] [--scene <file>] [--quiet]" << std::endl;
+        return 1;
+    }
+    std::string model_file = argv[1];
+    long only = -1;
+    std::string scene_file;
+    bool quiet = false;
+    for (int i = 3; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            only = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            scene_file = argv[++i];
+        else if (std::strcmp(argv[i], "--quiet") == 0)
+            quiet = true;
+        else
+        {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    QueryLog log;
+    if (!log.open(argv[2]))
+        return 1;
+    if (only >= (long)log.size())
+    {
+        std::cerr << "the log has " << log.size() << " records" << std::endl;
+        return 1;
+    }
+    size_t first = only < 0 ? 0 : only;
+    size_t last = only < 0 ? log.size() : only + 1;
+
+    PlanningRecord record;
+    if (!scene_file.empty())
+    {
+        if (only < 0)
+        {
+            std::cerr << "--scene needs --record" << std::endl;
+            return 1;
+        }
+        log.get(first, record);
+        char name[32];
+        std::snprintf(name, sizeof(name), "record_%zu", first);
+        if (!record.toScene(name).save(scene_file))
+        {
+            std::cerr << "could not write " << scene_file << std::endl;
+            return 1;
+        }
+        std::cerr << "wrote " << scene_file << std::endl;
+        return 0;
+    }
+
+    ompl::RNG::setSeed(1);
+    ompl::msg::setLogLevel(ompl::msg::LOG_WARN);
+
+    // A core per set of parameters, made again when they change
+    boost::shared_ptr<MpnetCore> core;
+    PlanningRecord core_parameters;
+    std::vector<SE2Pose> path;
+    size_t replayed = 0, same = 0, recorded_success = 0, replay_success = 0;
+    double recorded_time = 0, replay_time = 0;
+    if (!quiet)
+        std::printf("%8s %8s | %8s %10s %8s | %8s %10s %8s\n", "record", "planner", "success", "time (ms)", "checks", "success", "time (ms)", "checks");
+    std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+    for (size_t i = first; i < last; i++)
+    {
+        log.get(i, record);
+        if (!core || !sameParameters(record, core_parameters))
+        {
+            core.reset(new MpnetCore(model_file, record.xy_tolerance, record.yaw_tolerance, record.num_samples, record.num_paths, record.footprint));
+            core_parameters = record;
+            // Load the network onto the device before timing
+            core->setCostmap(record.costmap);
+            if (record.planner == PlanningRecord::MPNET)
+                core->plan(record.start, record.goal, record.bounds, path);
+        }
+        if (record.fallback.empty())
+            core->setCostmap(record.costmap);
+        else
+            core->setCostmap(record.costmap, &record.fallback);
+        core->setSimplifyTime(record.simplify_time);
+
+        PlannerMetrics& metrics = core->getMetrics();
+        unsigned long checks = metrics.getCollisionChecks();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool success;
+        if (record.planner == PlanningRecord::MPNET)
+        {
+            core->setSeed(record.seed);
+            success = core->plan(record.start, record.goal, record.bounds, path) >= 0;
+        }
+        else
+            success = core->planRRTStar(record.start, record.goal, path);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        checks = metrics.getCollisionChecks() - checks;
+
+        replayed++;
+        same += success == record.success;
+        recorded_success += record.success;
+        replay_success += success;
+        recorded_time += record.plan_time;
+        replay_time += seconds;
+        if (!quiet)
+            std::printf("%8zu %8s | %8s %10.2f %8lu | %8s %10.2f %8lu%s\n", i,
+                record.planner == PlanningRecord::MPNET ? "mpnet" : "rrt_star",
+                record.success ? "yes" : "no", record.plan_time * 1e3, (unsigned long)record.collision_checks,
+                success ? "yes" : "no", seconds * 1e3, checks,
+                success == record.success ? "" : "  differs");
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    std::printf("%zu records: %zu recorded successes, %zu replayed, %zu with the same outcome\n",
+        replayed, recorded_success, replay_success, same);
+    std::printf("planning time: recorded %.1f ms, replayed %.1f ms, %.1f records/s\n",
+        recorded_time * 1e3, replay_time * 1e3, replayed / wall);
+    return 0;
+}
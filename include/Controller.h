@@ -8,6 +8,7 @@
 #include "geometry_msgs/Pose.h"
 #include <ros/package.h>
 #include "nav_msgs/Path.h"
+#include <mpnet_plan/LocalPlan.h>
 #include "geometry_msgs/PoseStamped.h"
 #include "geometry_msgs/Pose.h"
 #include <base_local_planner/trajectory.h>
@@ -21,9 +22,19 @@
 
 // for MPC
 #include "MPC.h"
+#include "PurePursuit.h"
+#include <trace_recorder.h>
+#include <Eigen/Geometry>
 #include <cppad/cppad.hpp>
 
+// for the solver thread
+#include <boost/thread.hpp>
+#include <boost/chrono.hpp>
+#include <boost/scoped_ptr.hpp>
+
 #include <vector>
+#include <memory>
+#include <string>
 
 // for readcsv
 // #include "utils.h"
@@ -32,16 +43,28 @@ namespace mpnet_local_planner{
 	class Controller
 	{
 	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 		/**
 		 * @brief:
 		 */
 		void observe(geometry_msgs::PoseStamped& robot_vel, nav_msgs::Odometry& base_odom);
 
+		/**
+		 * @brief: Take the pose and velocity from an odometry snapshot
+		 */
+		void observe(const OdomSnapshot& odom);
+
 		/**
 		 * @brief: 
 		 */
 		void get_path(const nav_msgs::Path::ConstPtr& msg);
 
+		/**
+		 * @brief: Take the reference from a compact plan, sampled at the MPC step length
+		 */
+		void get_plan(const mpnet_plan::LocalPlan::ConstPtr& msg);
+
 		// void control(geometry_msgs::Twist& cmd_vel);
 		/**
 		 * @brief: 
@@ -59,6 +82,7 @@ namespace mpnet_local_planner{
 		// vector<double> path_y = {};
 		std::vector<double> path_x = vector<double>(N);
 		std::vector<double> path_y = vector<double>(N);
+		std::vector<double> path_th = vector<double>(N);
 		std::vector<double> path_goal = vector<double>(2);
 
 		/**
@@ -74,9 +98,29 @@ namespace mpnet_local_planner{
 		/**
 		 * @brief: Constructor that toggles debugging info
 		 * @param verbose: Toggles the cmd_vel set when called
+		 * @param mpc_backend: The MPC solver to use, "ipopt" or "rti"
+		 * @param mpc_horizon: The MPC horizon, one of mpc_horizons
+		 * @param adaptive_horizon: Use shorter compiled horizons when little path is left
+		 * @param mpc_deadline: Time (s) a control cycle waits for the MPC before falling back to pure pursuit, 0 waits for every solve
+		 * @param tf: A tf buffer kept up to date by the caller, the controller listens itself if NULL
 		 */
-		Controller(bool verbose);
+		Controller(bool verbose, const std::string& mpc_backend = "ipopt", int mpc_horizon = N, bool adaptive_horizon = false, double mpc_deadline = 0, tf2_ros::Buffer* tf = NULL);
 		
+		/**
+		 * @brief: Number of MPC solves requested and how many of them missed the deadline
+		 */
+		unsigned long getSolveCount() const { return solve_count; }
+		unsigned long getDeadlineMisses() const { return deadline_misses; }
+
+		/**
+		 * @brief: Propagate the observed state by the expected solve time before solving
+		 */
+		void setPredictState(bool predict) { predict_state = predict; }
+
+		/**
+		 * @brief: Running average of the time (s) a control step spends solving
+		 */
+		double getExpectedSolveTime() const { return expected_solve_time; }
 
 		/**
 		 * @brief: The default destructor
@@ -84,14 +128,110 @@ namespace mpnet_local_planner{
 		~Controller();
 
 	private:
-		
-		MPC mpc;
+		/**
+		 * @brief: Solve the MPC for the current state and path
+		 * @return False if the solver missed the deadline, the outputs are then not set
+		 */
+		bool solveMPC(double& steer_value, double& throttle_value);
+
+		/**
+		 * @brief: Post the MPC request to the solver thread and wait for it up to the deadline
+		 */
+		bool waitMPC(double& steer_value, double& throttle_value);
+
+		/**
+		 * @brief: Move the observed state forward along the bicycle model
+		 * @param t: Time (s) to propagate by
+		 */
+		void propagateState(double t);
+
+		/**
+		 * @brief: Steering from the pure pursuit fallback
+		 * @return False if the end of the path is reached
+		 */
+		bool solveFallback(double& steer_value, double& velocity_value);
+
+		/**
+		 * @brief: Start the solver thread
+		 */
+		void startSolverThread();
+
+		/**
+		 * @brief: Body of the solver thread, solves each request posted by solveMPC
+		 */
+		void solverLoop();
+
+		/**
+		 * @brief: Pick the smallest horizon covering the remaining path
+		 */
+		void selectHorizon();
+
+		/**
+		 * @brief: Make room for n poses in plan_xy and plan_yaw
+		 */
+		void reservePlan(int n);
+
+		/**
+		 * @brief: Build the MPC reference from the first n poses of plan_xy and plan_yaw
+		 * @param frame_id: The frame of the plan
+		 * @param ds: Arc length between the poses, 0 if they are not evenly spaced
+		 */
+		void setReference(int n, const std::string& frame_id, double ds);
+
+		/**
+		 * @brief: Update the cached map to odom transform without waiting for tf
+		 * @return False if no transform has been received yet
+		 */
+		bool lookupMapToOdom();
+
+		/**
+		 * @brief: Index of the plan point closest to the robot
+		 * @param n: Number of points in plan_xy
+		 */
+		int nearestPoint(int n);
+
+		std::vector<std::unique_ptr<MPCSolver> > mpcs; /** @brief Solvers by increasing horizon, the last one is the longest allowed */
+		MPCSolver* mpc; /** @brief The solver used in this cycle */
+		bool adaptive_horizon;
+		double remaining_length; /** @brief Arc length left on the local plan */
+		double ref_spacing; /** @brief Mean distance between reference points */
+		HorizonVector ptsx, ptsy;
+		MPCSolution solution;
+		Eigen::Matrix2Xd plan_xy; /** @brief Local plan in the odom frame, only the first poses of the last plan are valid */
+		Eigen::VectorXd plan_yaw;
+		bool have_map_to_odom = false;
+		double map_to_odom_x, map_to_odom_y, map_to_odom_yaw;
+
+		// The MPC runs on its own thread so that a slow solve can not hold up
+		// the control cycle. The request and result are only touched under
+		// solver_mutex, the solvers only by the solver thread while busy.
+		boost::thread solver_thread;
+		boost::mutex solver_mutex;
+		boost::condition_variable solver_cond;
+		MPCSolver* request_solver;
+		MPCState request_state;
+		HorizonVector request_x, request_y;
+		MPCSolution result;
+		bool request_pending = false;
+		bool solver_busy = false; /** @brief A solve is running, possibly from an earlier cycle */
+		bool result_ready = false;
+		bool reset_pending = false; /** @brief Reset the solvers before the next solve */
+		bool shutdown = false;
+		double mpc_deadline;
+		unsigned long solve_count = 0;
+		unsigned long deadline_misses = 0;
+		PurePursuit fallback;
+		bool predict_state = false;
+		double expected_solve_time = 0;
+		double last_steer = 0; /** @brief Last commanded steering, used to propagate the state */
+
 		double x, y, th, vel, vth, a = 0, sta=0;
 		int curr = 0;
 		// Eigen::VectorXd coeffs;
 		bool set_goal;
-		tf2_ros::Buffer tfBuffer;
-		tf2_ros::TransformListener tf2_listener;
+		tf2_ros::Buffer* tfBuffer;
+		boost::scoped_ptr<tf2_ros::Buffer> own_tf_buffer; /** @brief Used when no buffer is shared with the controller */
+		boost::scoped_ptr<tf2_ros::TransformListener> tf2_listener;
 
 	};
 }
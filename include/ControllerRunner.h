@@ -0,0 +1,125 @@
+#ifndef CONTROLLER_RUNNER_H
+#define CONTROLLER_RUNNER_H
+
+#include <Controller.h>
+#include <LatencyStats.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <std_srvs/Trigger.h>
+#include <ros/callback_queue.h>
+#include <ros/spinner.h>
+#include <atomic>
+#include <boost/scoped_ptr.hpp>
+
+namespace mpnet_local_planner{
+
+	/**
+	 * @class ControllerRunner
+	 * @brief Runs the Controller on ROS: triggers the control steps, publishes the
+	 * commands and the latency percentiles. Used by controller_node, the
+	 * controller nodelet and, in process, by MpnetLocalPlanner.
+	 *
+	 * The timers, subscriptions and services of the runner are served by a
+	 * callback queue and spinner thread of its own, so the control steps never
+	 * wait for the callbacks of the host, nor the host for a solve. Plans and
+	 * resets from other threads are only handed over under a short lock and
+	 * applied at the start of the next control step.
+	 */
+	class ControllerRunner
+	{
+	public:
+		/**
+		 * @brief: Constructor, reads the controller parameters from private_nh
+		 * @param host_nh: Handle for the command topic and the reset service, its callback queue is not used
+		 * @param private_nh: Handle for the parameters and the latency topics, its callback queue is not used
+		 * @param odom_helper: Odometry shared with the caller, the runner subscribes itself if NULL
+		 * @param subscribe_plan: Subscribe to the local plan topic, otherwise plans come from setPlan
+		 * @param tf: A tf buffer shared with the caller, the controller listens itself if NULL
+		 */
+		ControllerRunner(ros::NodeHandle& host_nh, ros::NodeHandle& private_nh, OdometryHelperRos* odom_helper = NULL, bool subscribe_plan = true, tf2_ros::Buffer* tf = NULL);
+
+		/**
+		 * @brief: Destructor
+		 */
+		~ControllerRunner();
+
+		/**
+		 * @brief: Give a new compact local plan to the controller, for the next control step
+		 */
+		void setPlan(const mpnet_plan::LocalPlan::ConstPtr& plan);
+
+		/**
+		 * @brief: Give a new local plan to the controller, for the next control step
+		 */
+		void setPath(const nav_msgs::Path::ConstPtr& path);
+
+		/**
+		 * @brief: Reset the controller before the next control step, as the reset_controller service does
+		 */
+		void reset();
+
+	private:
+		/**
+		 * @brief: Run one control step and publish the command, only called from the spinner thread
+		 */
+		void step();
+
+		/**
+		 * @brief: Queue a control step on the runner queue, from the odometry callback
+		 */
+		void queueStep();
+
+		/**
+		 * @brief: Apply the reset and plan handed over since the last step
+		 */
+		void applyPending();
+
+		/**
+		 * @brief: Publish the latency percentiles
+		 */
+		void publishLatency(const ros::TimerEvent& event);
+
+		/**
+		 * @brief: The reset_controller service
+		 */
+		bool resetService(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response);
+
+		/**
+		 * @brief: The dump_trace service, writes the recorded spans to trace_file
+		 */
+		bool dumpTrace(std_srvs::Trigger::Request& request, std_srvs::Trigger::Response& response);
+
+		/**
+		 * @brief: Record the stamp of a new plan for the plan to command latency
+		 */
+		void planReceived(const ros::Time& stamp);
+
+		boost::scoped_ptr<OdometryHelperRos> own_odom_helper_;
+		OdometryHelperRos* odom_helper_;
+		boost::scoped_ptr<Controller> controller_;
+		boost::mutex mutex_; /** @brief Guards the pending plan and reset only, never held across a control step */
+		mpnet_plan::LocalPlan::ConstPtr pending_plan_;
+		nav_msgs::Path::ConstPtr pending_path_;
+		bool reset_pending_;
+		std::atomic<bool> step_queued_; /** @brief An odometry triggered step is waiting in the queue */
+
+		ros::CallbackQueue queue_;
+		ros::AsyncSpinner spinner_;
+
+		ros::Subscriber plan_sub_;
+		ros::Publisher cmd_pub_;
+		ros::Publisher odom_latency_pub_, plan_latency_pub_;
+		ros::ServiceServer reset_srv_, trace_srv_;
+		std::string trace_file_;
+		ros::Timer control_timer_, latency_timer_;
+
+		OdomSnapshot odom_;
+		ackermann_msgs::AckermannDriveStamped cmd_;
+		std_msgs::Float64MultiArray latency_msg_;
+		LatencyStats odom_latency_; /** @brief Odometry stamp to command */
+		LatencyStats plan_latency_; /** @brief Plan stamp to the first command using it */
+		ros::Time plan_stamp_;
+		bool new_plan_;
+	};
+}
+
+#endif /* CONTROLLER_RUNNER_H */
@@ -0,0 +1,58 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <vector>
+#include <cstddef>
+
+namespace mpnet_local_planner{
+
+	/**
+	 * @class LatencyStats
+	 * @brief Percentiles over a sliding window of the most recent samples
+	 */
+	class LatencyStats
+	{
+	public:
+		/**
+		 * @brief: Constructor
+		 * @param window: Number of most recent samples kept
+		 */
+		LatencyStats(size_t window = 200);
+
+		/**
+		 * @brief: Add a sample, dropping the oldest one once the window is full
+		 */
+		void add(double value);
+
+		/**
+		 * @brief: Percentile of the samples in the window
+		 * @param p: The percentile, in [0, 100]
+		 * @return The nearest-rank percentile, 0 if there are no samples
+		 */
+		double percentile(double p);
+
+		/**
+		 * @brief: Largest sample in the window
+		 */
+		double max() const;
+
+		/**
+		 * @brief: Number of samples in the window
+		 */
+		size_t size() const { return count_; }
+
+		/**
+		 * @brief: Number of samples added since construction
+		 */
+		unsigned long total() const { return total_; }
+
+	private:
+		std::vector<double> samples_; /** @brief Ring buffer of samples */
+		std::vector<double> sorted_;  /** @brief Scratch space for percentile */
+		size_t next_, count_;
+		unsigned long total_;
+		bool sorted_valid_;
+	};
+}
+
+#endif /* LATENCY_STATS_H */
@@ -2,26 +2,17 @@
 #define MPC_H
 
 #include <vector>
+#include <memory>
+#include <string>
+#include <Eigen/Core>
 // for file
 
 
 using namespace std;
 
-class MPC {
- public:
-  MPC();
-
-  virtual ~MPC();
-
-  // Solve the model given an initial state and polynomial coefficients.
-  // Return the first actuatotions.
-  vector<double> Solve(std::vector<double> state, std::vector<double> ptsx, std::vector<double>  ptsy);
-};
-
-
 // Set the timestep length and duration
 // const int N = 20;
-const double dt = 0.05;
+constexpr double dt = 0.05;
 
 // This value assumes the model presented in the classroom is used.
 //
@@ -33,17 +24,111 @@ const double dt = 0.05;
 // presented in the classroom matched the previous radius.
 //
 // This is the length from front to CoG that has a similar radius.
-const double Lf = 0.324;
-const int N = 40;                 
-const double ref_v = 0.2;
+constexpr double Lf = 0.324;
+// Default horizon
+const int N = 40;
+constexpr double ref_v = 0.2;
+
+// Horizons the MPC backends are compiled for.
+const int mpc_horizons[] = {10, 20, 40, 60};
+const int MPC_MAX_HORIZON = 60;
+
+// Kinematic bicycle model driven at a constant reference speed.
+struct BicycleModel {
+  static constexpr double dt = ::dt;
+  static constexpr double Lf = ::Lf;
+  static constexpr double ref_v = ::ref_v;
+  static constexpr double max_steer = 0.5;
+};
+
+// Reference and predicted trajectories, stored inline up to the largest
+// horizon so that no control cycle has to allocate.
+typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MPC_MAX_HORIZON, 1> HorizonVector;
+
+struct MPCState {
+  double x, y, psi, v;
+};
+
+struct MPCSolution {
+  double steering;
+  double throttle;
+  // Predicted positions for the steps 1 .. horizon-1
+  HorizonVector x, y;
+  bool ok;
+};
+
+// Interface shared by the MPC backends, so the controller can pick one and
+// a horizon at start up.
+class MPCSolver {
+ public:
+  virtual ~MPCSolver() {}
+
+  // Number of steps in the horizon, the reference must have this many points.
+  virtual int horizon() const = 0;
 
-const size_t x_start = 0;
-const size_t y_start = x_start + N;
-const size_t psi_start = y_start + N;
-const size_t v_start = psi_start + N;
-const size_t delta_start = v_start + N;
-const size_t a_start = delta_start + N - 1;
+  // Solve the model given an initial state and the reference path.
+  // Fills the first actuatotions and the predicted trajectory.
+  virtual bool Solve(const MPCState& state, const HorizonVector& ptsx, const HorizonVector& ptsy, MPCSolution& solution) = 0;
+
+  // Drop the solution kept for warm starting the next Solve.
+  virtual void Reset() = 0;
+
+  // Set a backend option by name, e.g. an IPOPT option or
+  // "max_qp_iterations" of the RTI backend. Returns false if the backend
+  // has no such option or the value does not parse.
+  virtual bool SetOption(const std::string& name, const std::string& value) { return false; }
+
+  // Wall time (seconds) and solver iteration count of the last Solve.
+  double lastSolveTime() const { return solve_time_; }
+  int lastIterations() const { return iterations_; }
+
+  // Whether the last Solve met the optimality conditions of the backend,
+  // false if it stopped at its iteration or time limit.
+  bool lastConverged() const { return converged_; }
+
+ protected:
+  MPCSolver(): solve_time_(0), iterations_(0), converged_(false) {}
+
+  double solve_time_;
+  int iterations_;
+  bool converged_;
+};
+
+// Full nonlinear MPC solved with IPOPT. Instantiated for mpc_horizons.
+template <int Horizon, class Model = BicycleModel>
+class MPC : public MPCSolver {
+ public:
+  MPC();
+
+  virtual ~MPC();
+
+  int horizon() const { return Horizon; }
+
+  bool Solve(const MPCState& state, const HorizonVector& ptsx, const HorizonVector& ptsy, MPCSolution& solution);
+
+  void Reset();
+
+  // Any IPOPT option. warm_start_init_point and mu_init are chosen by
+  // Solve depending on whether it warm starts. "retape" = "yes" records
+  // the tape and its sparsity patterns again on every Solve, as before they
+  // were reused, so the saving can be measured.
+  bool SetOption(const std::string& name, const std::string& value);
+
+ private:
+  // The AD tape, sparsity patterns and IPOPT application are built once in
+  // the constructor and reused by every Solve, the problem structure never
+  // changes between control cycles.
+  struct IpoptContext;
+  std::unique_ptr<IpoptContext> ipopt_;
+};
 
+/**
+ * @brief Create an MPC backend by name
+ * @param backend "ipopt" for the nonlinear MPC, "rti" for the real-time iteration MPC
+ * @param horizon One of mpc_horizons
+ * @return The solver, or NULL if the backend or horizon is unknown
+ */
+MPCSolver* createMPCSolver(const std::string& backend, int horizon = N);
 
 
 #endif /* MPC_H */
@@ -0,0 +1,52 @@
+#ifndef PURE_PURSUIT_H
+#define PURE_PURSUIT_H
+
+#include <cmath>
+#include <vector>
+
+namespace mpnet_local_planner{
+
+	/**
+	 * @class PurePursuit
+	 * @brief Geometric path tracker, the same algorithm as scripts/pure_pursuit_controller.py.
+	 * Used by the controller when the MPC misses its deadline.
+	 */
+	class PurePursuit
+	{
+	public:
+		/**
+		 * @brief: Constructor
+		 * @param speed: The commanded speed
+		 * @param wheelbase: The wheelbase of the car
+		 * @param max_steering: The steering angle limit
+		 * @param gain: The gain on the heading error
+		 * @param look_ahead: Path points closer than this are considered passed
+		 */
+		PurePursuit(double speed = 0.4, double wheelbase = 0.325, double max_steering = M_PI/2, double gain = 2.5, double look_ahead = 0.075);
+
+		/**
+		 * @brief: Set the path to track
+		 */
+		void setPath(const std::vector<double>& path_x, const std::vector<double>& path_y, const std::vector<double>& path_th);
+
+		/**
+		 * @brief: Compute the command for the current pose
+		 * @param steering: The steering angle
+		 * @param speed: The speed, 0 once the end of the path is reached
+		 * @return False if the end of the path is reached
+		 */
+		bool control(double x, double y, double th, double& steering, double& speed);
+
+	private:
+		/**
+		 * @brief: Drop the path points the robot has passed
+		 */
+		void prunePath(double x, double y);
+
+		double speed_, wheelbase_, max_steering_, gain_, look_ahead_;
+		std::vector<double> path_x_, path_y_, path_th_;
+		size_t start_; /** @brief Index of the current target point */
+	};
+}
+
+#endif /* PURE_PURSUIT_H */
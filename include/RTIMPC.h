@@ -0,0 +1,71 @@
+#ifndef RTIMPC_H
+#define RTIMPC_H
+
+#include <Eigen/Dense>
+
+#include "MPC.h"
+
+// Real-time iteration MPC for the kinematic bicycle model of FG_eval.
+//
+// Each Solve does a single Gauss-Newton SQP step: the model is linearized
+// once around the previous solution shifted by one step, the states are
+// condensed out and the resulting dense box-constrained QP over the
+// steering inputs is solved with a primal active-set method, warm started
+// from the bounds the shifted solution sits on. Each iteration factors the
+// QP on the free inputs once, and either stops at the first bound in the
+// way, or checks the multipliers of the held inputs and releases one. If
+// the iteration bound is hit first the last feasible iterate is applied and
+// lastConverged() is false. All storage is fixed size, so the solve time
+// only depends on the horizon and the iteration bound. Instantiated for
+// mpc_horizons.
+template <int Horizon, class Model = BicycleModel>
+class RTIMPC : public MPCSolver {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /**
+   * @brief Constructor
+   * @param max_qp_iterations Upper bound on active-set iterations per solve
+   */
+  RTIMPC(int max_qp_iterations = 10);
+
+  virtual ~RTIMPC();
+
+  int horizon() const { return Horizon; }
+
+  bool Solve(const MPCState& state, const HorizonVector& ptsx, const HorizonVector& ptsy, MPCSolution& solution);
+
+  void Reset();
+
+  // "max_qp_iterations"
+  bool SetOption(const std::string& name, const std::string& value);
+
+ private:
+  // Number of steering inputs
+  static const int M = Horizon - 1;
+  typedef Eigen::Matrix<double, M, 1> InputVector;
+  typedef Eigen::Matrix<double, Horizon, 1> StateVector;
+
+  // Roll the model out from the initial state with the steering inputs u.
+  void rollout(double x, double y, double psi, const InputVector& u);
+
+  // Solve min 0.5 u'Hu + f'u  s.t. |u| <= max_steer, starting from the
+  // feasible u with the working set active_. Returns false if the
+  // iterations ran out before the KKT conditions held.
+  bool solveBoxQP(InputVector& u, int& iterations);
+
+  int max_qp_iterations_;
+  bool warm_;
+
+  InputVector u_, u_bar_;
+  StateVector xs_, ys_, psis_;            // rolled out states
+  Eigen::Matrix<double, Horizon, M> Gx_;  // sensitivities of x, y w.r.t. the inputs
+  Eigen::Matrix<double, Horizon, M> Gy_;
+  Eigen::Matrix<double, M, M> H_, K_;
+  InputVector f_, rhs_, step_;
+  StateVector ex_, ey_;
+  Eigen::Matrix<bool, M, 1> active_;     // working set, the inputs held on a bound
+  Eigen::LLT<Eigen::Matrix<double, M, M> > llt_;
+};
+
+#endif /* RTIMPC_H */
@@ -0,0 +1,79 @@
+/**
+ * A small collision map around the robot, filled from the static map
+ */
+#ifndef COLLISION_GRID_H
+#define COLLISION_GRID_H
+
+#include <ros/ros.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <costmap_2d/costmap_2d.h>
+#include <tf2_ros/buffer.h>
+#include <boost/thread.hpp>
+
+namespace mpnet_local_planner{
+    /**
+     * @class CollisionGrid
+     * @brief A square window of the static map, in the frame of the planner,
+     * for collision checks outside of the local costmap. It only copies the
+     * cells of the window, and only when the window moves, instead of running
+     * a second costmap stack over the whole map.
+     */
+    class CollisionGrid{
+        public:
+        /**
+         * @brief Constructor
+         * @param tf The buffer used to place the map in the planner frame
+         * @param frame The frame of the states that are checked
+         * @param size The side length of the window (m)
+         * @param resolution The cell size of the window (m)
+         * @param map_topic The static map topic
+         */
+        CollisionGrid(tf2_ros::Buffer* tf, const std::string& frame, double size, double resolution, const std::string& map_topic = "map");
+
+        /**
+         * @brief Move the window to be centered on (x, y) if it no longer covers it well, or the map or its transform changed
+         * @param x The x co-ordinate of the robot in the planner frame
+         * @param y The y co-ordinate of the robot in the planner frame
+         * @return False if there is no map or transform yet
+         */
+        bool update(double x, double y);
+
+        /**
+         * @brief True once the window has been filled
+         */
+        bool ready() const
+        {
+            return ready_;
+        }
+
+        /**
+         * @brief The window as a costmap, with lethal, free and unknown cells
+         */
+        costmap_2d::Costmap2D& getCostmap()
+        {
+            return grid_;
+        }
+
+        private:
+        void mapCallback(const nav_msgs::OccupancyGrid::ConstPtr& map);
+
+        /**
+         * @brief Copy the map cells under the window
+         */
+        void fill(const nav_msgs::OccupancyGrid& map);
+
+        tf2_ros::Buffer* tf_;
+        std::string frame_;
+        double size_;
+        ros::Subscriber map_sub_;
+        boost::mutex map_mutex_;
+        nav_msgs::OccupancyGrid::ConstPtr map_; /** @brief The latest static map */
+        bool map_changed_;
+        costmap_2d::Costmap2D grid_;
+        bool ready_;
+        double center_x_, center_y_; /** @brief Center of the window */
+        double map_x_, map_y_, map_yaw_; /** @brief The map origin in the planner frame, for the current fill */
+    };
+}
+
+#endif /* COLLISION_GRID_H */
@@ -0,0 +1,79 @@
+/**
+ * Immutable copies of a costmap for the planner
+ */
+#ifndef COSTMAP_SNAPSHOT_H
+#define COSTMAP_SNAPSHOT_H
+
+#include <ros/ros.h>
+#include <costmap_2d/costmap_2d.h>
+#include <boost/shared_ptr.hpp>
+
+namespace mpnet_local_planner{
+    /**
+     * @class CostmapSnapshot
+     * @brief A copy of the costmap cells, origin and resolution at one
+     * instant. It is not modified while anybody holds it.
+     */
+    class CostmapSnapshot : public costmap_2d::Costmap2D{
+        public:
+        CostmapSnapshot();
+
+        /**
+         * @brief Copy the costmap into this buffer, the caller holds the costmap lock
+         * @param costmap The costmap to copy
+         * @param version The version of the snapshot
+         */
+        void copyFrom(const costmap_2d::Costmap2D& costmap, uint64_t version);
+
+        /**
+         * @brief Increases by one for every snapshot taken from the costmap
+         */
+        uint64_t getVersion() const
+        {
+            return version_;
+        }
+
+        /**
+         * @brief The time the snapshot was taken
+         */
+        const ros::Time& getStamp() const
+        {
+            return stamp_;
+        }
+
+        private:
+        uint64_t version_;
+        ros::Time stamp_;
+    };
+
+    typedef boost::shared_ptr<const CostmapSnapshot> CostmapSnapshotConstPtr;
+
+    /**
+     * @class CostmapSnapshots
+     * @brief Takes snapshots of a costmap that keeps updating. The costmap
+     * lock is only held for the copy of the cells. Two buffers are reused
+     * in turn, a new one is only allocated if both are still held.
+     */
+    class CostmapSnapshots{
+        public:
+        /**
+         * @brief Constructor
+         * @param costmap The costmap to copy, usually the local costmap
+         */
+        CostmapSnapshots(costmap_2d::Costmap2D* costmap);
+
+        /**
+         * @brief Copy the current costmap
+         * @return The new snapshot
+         */
+        CostmapSnapshotConstPtr take();
+
+        private:
+        costmap_2d::Costmap2D* costmap_;
+        boost::shared_ptr<CostmapSnapshot> buffers_[2];
+        int next_; /** @brief The buffer to fill next */
+        uint64_t version_;
+    };
+}
+
+#endif /* COSTMAP_SNAPSHOT_H */
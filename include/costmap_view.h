@@ -0,0 +1,122 @@
+/**
+ * Plain poses and costmaps for the planning core
+ */
+#ifndef COSTMAP_VIEW_H
+#define COSTMAP_VIEW_H
+
+#include <vector>
+#include <cstddef>
+
+namespace mpnet_local_planner{
+    /**
+     * @brief A pose in the plane
+     */
+    struct SE2Pose{
+        SE2Pose(double x = 0, double y = 0, double yaw = 0):
+        x(x),
+        y(y),
+        yaw(yaw)
+        {
+        }
+
+        double x, y, yaw;
+    };
+
+    /**
+     * @brief A footprint vertex in the robot frame
+     */
+    struct Point2D{
+        Point2D(double x = 0, double y = 0):
+        x(x),
+        y(y)
+        {
+        }
+
+        double x, y;
+    };
+
+    /**
+     * @brief Cost values, as in costmap_2d/cost_values.h
+     */
+    static const unsigned char NO_INFORMATION = 255;
+    static const unsigned char LETHAL_OBSTACLE = 254;
+    static const unsigned char INSCRIBED_INFLATED_OBSTACLE = 253;
+    static const unsigned char FREE_SPACE = 0;
+
+    /**
+     * @class CostmapView
+     * @brief A costmap owned by somebody else, row major from the cell at the origin
+     */
+    struct CostmapView{
+        CostmapView():
+        size_x(0),
+        size_y(0),
+        resolution(0),
+        origin_x(0),
+        origin_y(0),
+        data(NULL)
+        {
+        }
+
+        CostmapView(unsigned int size_x, unsigned int size_y, double resolution, double origin_x, double origin_y, const unsigned char* data):
+        size_x(size_x),
+        size_y(size_y),
+        resolution(resolution),
+        origin_x(origin_x),
+        origin_y(origin_y),
+        data(data)
+        {
+        }
+
+        /**
+         * @brief The cell of a world point, as Costmap2D::worldToMap
+         * @return False if the point is off the map
+         */
+        bool worldToMap(double wx, double wy, unsigned int& mx, unsigned int& my) const
+        {
+            if (wx < origin_x || wy < origin_y)
+                return false;
+            mx = (unsigned int)((wx - origin_x) / resolution);
+            my = (unsigned int)((wy - origin_y) / resolution);
+            return mx < size_x && my < size_y;
+        }
+
+        unsigned char getCost(unsigned int mx, unsigned int my) const
+        {
+            return data[my * size_x + mx];
+        }
+
+        bool empty() const
+        {
+            return data == NULL;
+        }
+
+        unsigned int size_x, size_y;
+        double resolution;
+        double origin_x, origin_y; /** @brief The corner of the cell (0, 0) */
+        const unsigned char* data;
+    };
+
+    /**
+     * @brief The cost of a footprint, as base_local_planner::CostmapModel::footprintCost:
+     * the largest cell cost under the outline of the footprint
+     * @param costmap The costmap
+     * @param pose The pose of the robot
+     * @param footprint The footprint in the robot frame, fewer than 3 points checks the center cell only
+     * @return The cost, or -1 for an obstacle, -2 for unknown cells, -3 if the footprint leaves the costmap
+     */
+    double footprintCost(const CostmapView& costmap, const SE2Pose& pose, const std::vector<Point2D>& footprint);
+
+    /**
+     * @brief The cost of a footprint from an exact rasterization: the largest
+     * cell cost over every cell that overlaps the footprint polygon, inside
+     * included. Slow, it is the reference that faster checkers are compared with.
+     * @param costmap The costmap
+     * @param pose The pose of the robot
+     * @param footprint The footprint in the robot frame, fewer than 3 points checks the center cell only
+     * @return The cost, or -1 for an obstacle, -2 for unknown cells, -3 if the footprint leaves the costmap
+     */
+    double footprintCostExact(const CostmapView& costmap, const SE2Pose& pose, const std::vector<Point2D>& footprint);
+}
+
+#endif /* COSTMAP_VIEW_H */
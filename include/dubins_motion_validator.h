@@ -0,0 +1,73 @@
+/**
+ * Motion validation along Dubins curves
+ */
+#ifndef DUBINS_MOTION_VALIDATOR_H
+#define DUBINS_MOTION_VALIDATOR_H
+
+#include <vector>
+#include <ompl/base/MotionValidator.h>
+#include <ompl/base/SpaceInformation.h>
+#include <ompl/base/spaces/DubinsStateSpace.h>
+#include <costmap_view.h>
+
+namespace mpnet_local_planner{
+    /**
+     * @class DubinsMotionValidator
+     * @brief Checks a motion of a DubinsStateSpace by solving its Dubins
+     * curve once and walking it from the start at a fixed arc length step,
+     * stopping at the first state in collision. The discrete validator of
+     * OMPL solves the curve again for every state it checks, at a step that
+     * is a fraction of the extent of the state bounds.
+     */
+    class DubinsMotionValidator : public ompl::base::MotionValidator{
+        public:
+        /**
+         * @brief Constructor
+         * @param si The space information, its state space must be a DubinsStateSpace
+         * @param turning_radius The turning radius of the space (m)
+         * @param step The arc length between the checked states (m)
+         */
+        DubinsMotionValidator(ompl::base::SpaceInformation* si, double turning_radius, double step);
+
+        /**
+         * @brief The step at which a footprint corner moves at most one cell
+         * @param resolution The resolution of the costmap checked (m)
+         * @param footprint The footprint, in the robot frame
+         * @param turning_radius The turning radius of the space (m)
+         * @return The arc length step (m)
+         */
+        static double stepFor(double resolution, const std::vector<Point2D>& footprint, double turning_radius);
+
+        void setStep(double step)
+        {
+            step_ = step;
+        }
+
+        double getStep() const
+        {
+            return step_;
+        }
+
+        bool checkMotion(const ompl::base::State* s1, const ompl::base::State* s2) const override;
+
+        bool checkMotion(const ompl::base::State* s1, const ompl::base::State* s2,
+            std::pair<ompl::base::State*, double>& last_valid) const override;
+
+        private:
+        /**
+         * @brief The Dubins curve from s1 to s2, as DubinsStateSpace::interpolate picks it
+         */
+        ompl::base::DubinsStateSpace::DubinsPath solve(const ompl::base::State* s1, const ompl::base::State* s2) const;
+
+        /**
+         * @brief The number of steps along a curve
+         */
+        int steps(const ompl::base::DubinsStateSpace::DubinsPath& path) const;
+
+        const ompl::base::DubinsStateSpace* space_;
+        double turning_radius_;
+        double step_;
+    };
+}
+
+#endif /* DUBINS_MOTION_VALIDATOR_H */
@@ -0,0 +1,78 @@
+#ifndef GLOBAL_PLAN_TRACKER_H
+#define GLOBAL_PLAN_TRACKER_H
+
+#include <vector>
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <costmap_2d/costmap_2d.h>
+#include <tf2_ros/buffer.h>
+
+namespace mpnet_local_planner{
+    /**
+     * @class GlobalPlanTracker
+     * @brief Gives the part of the global plan on the local costmap, as
+     * base_local_planner::transformGlobalPlan and prunePlan do, without
+     * transforming the whole plan every cycle. Transformed poses are cached
+     * until the transform to the planner frame changes, and the poses behind
+     * the robot are skipped by advancing an index instead of being erased.
+     */
+    class GlobalPlanTracker{
+        public:
+        GlobalPlanTracker();
+
+        /**
+         * @brief Set a new global plan and start from its first pose
+         */
+        void setPlan(const std::vector<geometry_msgs::PoseStamped>& plan);
+
+        /**
+         * @brief Clear the plan
+         */
+        void clear();
+
+        /**
+         * @brief Get the part of the plan around the robot in the planner frame
+         * @param tf The tf buffer, it is not waited on
+         * @param robot_pose The robot pose in global_frame
+         * @param costmap The local costmap, its size bounds the window
+         * @param global_frame The frame of the planner
+         * @param prune Skip the poses behind the robot for the next cycles
+         * @param transformed_plan Filled with the poses of the window
+         * @return False if there is no plan or no transform yet
+         */
+        bool update(const tf2_ros::Buffer& tf, const geometry_msgs::PoseStamped& robot_pose, const costmap_2d::Costmap2D& costmap,
+            const std::string& global_frame, bool prune, std::vector<geometry_msgs::PoseStamped>& transformed_plan);
+
+        /**
+         * @brief The plan as it was set, in its own frame
+         */
+        const std::vector<geometry_msgs::PoseStamped>& getPlan() const
+        {
+            return plan_;
+        }
+
+        /**
+         * @brief Index of the first pose that has not been pruned
+         */
+        size_t getProgress() const
+        {
+            return progress_;
+        }
+
+        private:
+        /**
+         * @brief The pose i of the plan in the planner frame, transformed on first use
+         */
+        const geometry_msgs::PoseStamped& transformed(size_t i);
+
+        std::vector<geometry_msgs::PoseStamped> plan_;
+        std::vector<geometry_msgs::PoseStamped> transformed_; /** @brief Cache of the transformed poses */
+        std::vector<unsigned int> cached_; /** @brief The transform generation of each pose in transformed_ */
+        unsigned int generation_; /** @brief Increased when the transform changes, which drops the cache */
+        size_t progress_;
+        bool have_transform_;
+        geometry_msgs::TransformStamped plan_to_global_;
+    };
+}
+
+#endif /* GLOBAL_PLAN_TRACKER_H */
@@ -0,0 +1,22 @@
+#ifndef LOCAL_PLAN_H
+#define LOCAL_PLAN_H
+
+#include <vector>
+#include <geometry_msgs/PoseStamped.h>
+#include <mpnet_plan/LocalPlan.h>
+
+namespace mpnet_local_planner{
+
+    /** @brief The smallest arc length between the samples of a compact plan (m) */
+    const double min_plan_ds = 0.005;
+
+    /**
+     * @brief Sample a plan every ds of arc length, the last sample is always the last pose
+     * @param plan The dense plan
+     * @param ds Arc length between the samples, raised to min_plan_ds
+     * @param compact Filled with the samples, the header and ds are left as they are
+     */
+    void resamplePlan(const std::vector<geometry_msgs::PoseStamped>& plan, double ds, mpnet_plan::LocalPlan& compact);
+}
+
+#endif /* LOCAL_PLAN_H */
@@ -0,0 +1,220 @@
+/**
+ * The planning core, without ROS
+ */
+#ifndef MPNET_CORE_H
+#define MPNET_CORE_H
+
+#include <torch/script.h>
+#include <torch/torch.h>
+
+#include <ompl/base/spaces/DubinsStateSpace.h>
+#include <ompl/base/ScopedState.h>
+#include <ompl/geometric/SimpleSetup.h>
+#include <ompl/geometric/PathSimplifier.h>
+#include <ompl/geometric/planners/rrt/RRTstar.h>
+
+#include <costmap_view.h>
+#include <dubins_motion_validator.h>
+#include <planner_metrics.h>
+#include <query_log.h>
+
+namespace ob = ompl::base;
+namespace og = ompl::geometric;
+
+namespace mpnet_local_planner{
+    /**
+     * @class MpnetCore
+     * @brief Plans with MPNet, or RRT*, on a costmap view. It needs no ROS
+     * master, so it can be benchmarked and tested offline and several
+     * instances can run side by side.
+     */
+    class MpnetCore{
+        public:
+        static const double turning_radius; /** @brief Of the Dubins curves of the state space (m) */
+
+        /**
+         * @brief Constructor, loads the network
+         * @param file_name The TorchScript model
+         * @param xy_tolerance The distance to the goal at which a sample is accepted as the goal (m)
+         * @param yaw_tolerance The heading error at which a sample is accepted as the goal (rad)
+         * @param num_samples The number of samples of each rollout
+         * @param num_paths The number of rollouts before giving up
+         * @param footprint The footprint checked for collisions
+         */
+        MpnetCore(
+            const std::string& file_name,
+            double xy_tolerance,
+            double yaw_tolerance,
+            int num_samples,
+            int num_paths,
+            const std::vector<Point2D>& footprint
+            );
+
+        /**
+         * @brief Set the costmaps to plan on, they must stay unchanged until the next call
+         * @param costmap The local costmap, the network sees its 120x120 cells
+         * @param fallback A costmap for the states off the local costmap, or NULL
+         */
+        void setCostmap(const CostmapView& costmap, const CostmapView* fallback = NULL);
+
+        /**
+         * @brief A function to copy the costmap and pad it with zeros such that the robot is in the center
+         * @param x The x co-ordinate of the robot
+         * @param y The y co-ordinate of the robot
+         * @return A padded egocentric costmap
+         */
+        torch::Tensor copy_costmap(double x, double y);
+
+        /**
+         * @brief A function that returns the input tensor given the current and goal position of the robot
+         * @param start The starting position of the robot
+         * @param goal The goal position the robot has to achieve
+         * @param bounds The bounds of the robot
+         * @return A normalized vector for the network input
+         */
+        torch::Tensor copy_pose(const ob::ScopedState<> &start, const ob::ScopedState<> &goal, const std::vector<double>& bounds);
+
+        /**
+         * @brief A function to return a vector given the target point predicted by the network
+         * @param target_state The target tensor returned by the network
+         * @param bounds The bound of the local costmap
+         * @return A vector with the [x,y,theta] of the target pose
+         */
+        std::vector<double> getMapPoint(torch::Tensor target_state, const std::vector<double>& bounds);
+
+        /**
+         * @brief check if a path exists for a sample
+         * @param start The current position of the robot
+         * @param goal The goal position of the robot
+         * @return A vector that returns the target pose given start and goal position
+         */
+        std::vector<double> getTargetPoint(const ob::ScopedState<> &start, const ob::ScopedState<> &goal, const std::vector<double>& bounds);
+
+        /**
+         * @brief Plan from start to goal with the network
+         * @param start The pose of the robot
+         * @param goal The goal
+         * @param bounds The size of the local costmap (m) and the yaw range
+         * @param path Filled with the interpolated path, cleared if there is none
+         * @return The length of the path, or -1 if no path was found
+         */
+        double plan(const SE2Pose& start, const SE2Pose& goal, const std::vector<double>& bounds, std::vector<SE2Pose>& path);
+
+        /**
+         * @brief Plan from start to goal with RRT*, for 0.1 s
+         * @param start The pose of the robot
+         * @param goal The goal
+         * @param path Filled with the interpolated path, cleared if there is none
+         * @param iterations If not 0, plan for this many RRT* iterations and simplify
+         * the path as much as possible instead, so the result does not depend on the
+         * speed of the machine
+         * @return True if a path was found
+         */
+        bool planRRTStar(const SE2Pose& start, const SE2Pose& goal, std::vector<SE2Pose>& path, unsigned int iterations = 0);
+
+        /**
+         * @brief Plan from start to goal by repairing a stored path: join it
+         * from the start, skip its poses that are in collision or can only be
+         * reached by a detour, join the goal from the last pose kept, then
+         * simplify and interpolate as a network plan
+         * @param start The pose of the robot
+         * @param goal The goal
+         * @param stored The stored path, from near the start to near the goal
+         * @param path Filled with the interpolated path, cleared if there is none
+         * @return The length of the path, or -1 if the stored path could not be repaired
+         */
+        double planFromPath(const SE2Pose& start, const SE2Pose& goal, const std::vector<SE2Pose>& stored, std::vector<SE2Pose>& path);
+
+        /**
+         * @brief Returns if the given state is in collision or not
+         * @param The current state to check
+         * @return True is the state is not in collision
+         */
+        bool isStateValid(const ob::State *state);
+
+        /**
+         * @brief Returns if a footprint at the pose is in collision or not
+         * @param pose The pose to check
+         * @param footprint The footprint, in the robot frame
+         * @return True is the pose is not in collision
+         */
+        bool isStateValid(const SE2Pose& pose, const std::vector<Point2D>& footprint);
+
+        /**
+         * @brief Change the rollouts from the next plan on
+         * @param num_samples The number of samples of each rollout
+         * @param num_paths The number of rollouts before giving up
+         */
+        void setRollouts(int num_samples, int num_paths)
+        {
+            this->num_samples = num_samples;
+            this->num_paths = num_paths;
+        }
+
+        /**
+         * @brief Bound the time spent simplifying a path
+         * @param seconds The time, 0 simplifies as much as possible
+         */
+        void setSimplifyTime(double seconds)
+        {
+            simplify_time = seconds;
+        }
+
+        /**
+         * @brief The wall time of the last plan, and of its simplification (s)
+         */
+        void getLastPlanTimes(double& plan_time, double& simplify_time) const
+        {
+            plan_time = last_plan_time;
+            simplify_time = last_simplify_time;
+        }
+
+        /**
+         * @brief The torch seed of the next plan, the plans after it take the following seeds
+         *
+         * The seed is process-wide in torch, so the cores of a process sample
+         * one plan at a time
+         */
+        void setSeed(uint64_t seed)
+        {
+            next_seed = seed;
+        }
+
+        /**
+         * @brief Fill the costmaps, footprint, parameters, simplification budget and seed of the last plan into a record
+         */
+        void getQuery(PlanningRecord& record) const;
+
+        /**
+         * @brief The timings of the planning stages
+         */
+        PlannerMetrics& getMetrics()
+        {
+            return metrics;
+        }
+
+        private:
+        CostmapView costmap_; /** @brief The local costmap for this planning cycle */
+        CostmapView fallback_; /** @brief Checked for states off costmap_, if set */
+        std::vector<Point2D> footprint_;
+        PlannerMetrics metrics;
+        bool use_gpu;
+
+        std::vector<torch::jit::IValue> inputs;
+        torch::jit::script::Module module;
+        torch::Device device;
+        ob::StateSpacePtr space;
+        ob::RealVectorBounds space_bounds;
+        std::shared_ptr<ob::SpaceInformation> si;
+        std::shared_ptr<DubinsMotionValidator> motion_validator; /** @brief Checks the motions of si at a step of the costmap resolution */
+        std::shared_ptr<og::PathSimplifier> psk;
+        std::shared_ptr<og::RRTstar> planAlgo;
+        double g_tolerance, yaw_tolerance; /** @brief The threshold for goal */
+        int num_samples, num_paths;
+        double simplify_time; /** @brief The simplification budget (s), 0 for simplifyMax */
+        double last_plan_time, last_simplify_time;
+        uint64_t next_seed, seed; /** @brief Torch is seeded before each plan, so a plan can be replayed */
+    };
+}
+
+#endif /* MPNET_CORE_H */
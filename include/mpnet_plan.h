@@ -1,12 +1,9 @@
 /**
- * The core of the planner
+ * The ROS side of the planner
  */
 
 #include <ros/ros.h>
 
-#include <torch/script.h>
-#include <torch/torch.h>
-
 #include <costmap_2d/costmap_2d.h>
 #include <costmap_2d/costmap_2d_ros.h>
 
@@ -14,31 +11,30 @@
 #include <tf2_ros/buffer.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 
-#include <base_local_planner/world_model.h>
 #include <base_local_planner/trajectory.h>
-
-#include <ompl/base/spaces/DubinsStateSpace.h>
-#include <ompl/base/ScopedState.h>
-
-#include <ompl/geometric/SimpleSetup.h>
-#include <ompl/geometric/SimpleSetup.h>
-#include <ompl/geometric/planners/rrt/RRTstar.h>
-
-namespace ob = ompl::base;
-namespace og = ompl::geometric;
-
+#include <collision_grid.h>
+#include <costmap_snapshot.h>
+#include <mpnet_core.h>
+#include <path_library.h>
+#include <planning_budget.h>
 
 namespace mpnet_local_planner{
+    /**
+     * @class MpnetPlanner
+     * @brief Runs MpnetCore on the local costmap of move_base: snapshots the
+     * costmap, keeps the collision grid around the robot and converts the
+     * poses and paths.
+     */
     class MpnetPlanner{
         public:
         /**
-         * @brief A default initializer
-         * @param tf
-         * @param costmap_ros
-         * @param file_name
+         * @brief Constructor
+         * @param tf The tf buffer, for the collision grid
+         * @param costmap_ros The local costmap, it is not owned
+         * @param file_name The TorchScript model
+         * @param footprint The footprint for isStateValid, planning uses the padded footprint of the costmap
+         * @param collision_grid_size Side of the static map window for states off the local costmap, 0 disables it
          */
-        // MpnetPlanner();
-
         MpnetPlanner(
             tf2_ros::Buffer *tf, 
             costmap_2d::Costmap2DROS *costmap_ros, 
@@ -47,48 +43,12 @@ namespace mpnet_local_planner{
             double yaw_tolerance,
             int numSamples,
             int numPaths,
-            std::vector<geometry_msgs::Point> footprint
+            std::vector<geometry_msgs::Point> footprint,
+            double collision_grid_size = 10.0
             );
 
         ~MpnetPlanner();
 
-        /**
-         * @brief A function to copy the costmap and pad it with zeros such that the robot is in the center
-         * @param x The x co-ordinate of the robot
-         * @param y The y co-ordinate of the robot
-         * @return A padded egocentric costmap
-         */
-        torch::Tensor copy_costmap( double x, double y);
-
-        /**
-         * @brief A function that returns the input tensor given the current and goal position of the robot
-         * @param start The starting position of the robot
-         * @param goal The goal position the robot has to achieve
-         * @param bounds The bounds of the robot
-         * @param origin_x The x co-ordinate of the local costmap origin
-         * @param origin_y The y co-ordinate of the local costmap origin
-         * @return A normalized vector for the network input
-         */
-        torch::Tensor copy_pose(const ob::ScopedState<> &start, const ob::ScopedState<> &goal, std::vector<double> bounds);
-        
-        /**
-         * @brief A function to return a vector given the target point predicted by the network
-         * @param target_state The target tensor returned by the network
-         * @param bounds The bound of the local costmap
-         * @param origin_x  The x co-ordinate of the local costmap origin
-         * @param origin_y The y co-ordinate of the local costmap origin
-         * @return A vector with the [x,y,theta] of the target pose
-         */
-        std::vector<double> getMapPoint(torch::Tensor target_state, std::vector<double> bounds);
-
-        /**
-         * @brief check if a path exists for a sample
-         * @param start The current position of the robot
-         * @param goal The goal position of the robot
-         * @return A vector that returns the target pose given start and goal position
-         */
-        std::vector<double> getTargetPoint(const ob::ScopedState<> &start, const ob::ScopedState<> &goal, std::vector<double> bounds);
-
         /**
          * @brief gets the path from start to goal using the loaded network
          * @param start
@@ -107,14 +67,77 @@ namespace mpnet_local_planner{
         void getPathRRT_star(geometry_msgs::PoseStamped start, geometry_msgs::PoseStamped goal, base_local_planner::Trajectory &traj);
 
         /**
-         * @brief Returns if the given state is in collision or not
-         * @param The current state to check
+         * @brief Returns if the robot footprint at the pose is in collision or not
+         * @param start The pose to check
          * @return True is the state is not in collision
          */
-        bool isStateValid(const ob::State *state);
-
         bool isStateValid(geometry_msgs::PoseStamped start);
 
+        /**
+         * @brief Take a snapshot of the local costmap and move the collision grid, call at the start of each planning cycle
+         * @param start The current position of the robot
+         */
+        void updateCostmap(const geometry_msgs::PoseStamped& start);
+
+        /**
+         * @brief Append every plan to a query log, for query_replay
+         * @param file_name The log
+         * @return False if the log could not be opened
+         */
+        bool recordQueries(const std::string& file_name);
+
+        /**
+         * @brief Repair paths of a library before planning, and store every path found
+         * @param file_name The library file, created if missing
+         * @param map_frame The frame the paths are stored in, so they stay valid as odometry drifts
+         * @param radius The distance from the start and goal at which a stored path is repaired (m)
+         * @param yaw_tolerance The heading error at which a stored path is repaired (rad)
+         * @param capacity The number of paths of a new library
+         * @return False if the library could not be opened
+         */
+        bool usePathLibrary(const std::string& file_name, const std::string& map_frame, double radius, double yaw_tolerance, size_t capacity);
+
+        /**
+         * @brief The path library, NULL if none
+         */
+        const PathLibrary* getPathLibrary() const
+        {
+            return library;
+        }
+
+        /**
+         * @brief True if the last path of getPath was repaired from the library rather than planned
+         */
+        bool isLastPathFromLibrary() const
+        {
+            return last_from_library;
+        }
+
+        /**
+         * @brief The timings of the planning stages
+         */
+        PlannerMetrics& getMetrics()
+        {
+            return core->getMetrics();
+        }
+
+        /**
+         * @brief Plan with the rollouts and simplification time of a budget from the next plan on
+         */
+        void setBudget(const PlanningBudget::Settings& settings)
+        {
+            core->setRollouts(settings.num_samples, settings.num_paths);
+            core->setSimplifyTime(settings.simplify_time);
+        }
+
+        /**
+         * @brief The wall time of the last MPNet plan, and of its simplification (s)
+         */
+        void getLastPlanTimes(double& plan_time, double& simplify_time) const
+        {
+            core->getLastPlanTimes(plan_time, simplify_time);
+        }
+
 
         bool isInitialized()
         {
@@ -122,27 +145,55 @@ namespace mpnet_local_planner{
         }
 
         private:
-        static char* cost_translation_table;
+        /**
+         * @brief Copy a path of the core into a trajectory
+         */
+        void toTrajectory(const std::vector<SE2Pose>& path, base_local_planner::Trajectory& traj);
+
+        /**
+         * @brief The pose of the costmap frame in the library frame
+         * @return False if the transform is not available
+         */
+        bool lookupLibraryFrame(SE2Pose& frame);
+
+        /**
+         * @brief Repair the stored paths from near the start to near the goal, the closest first, into path_buffer
+         * @param frame The pose of the costmap frame in the library frame
+         * @return The length of the first path repaired, or -1 if none, its slot is kept in library_slot
+         */
+        double planFromLibrary(const SE2Pose& start, const SE2Pose& goal, const SE2Pose& frame);
+
+        /**
+         * @brief Store path_buffer in the library
+         * @param frame The pose of the costmap frame in the library frame
+         * @param repaired Whether path_buffer was repaired from the path in library_slot, which it then replaces
+         */
+        void storePath(const SE2Pose& frame, bool repaired);
+
+        /**
+         * @brief Queue the last plan to the query log
+         */
+        void recordQuery(PlanningRecord::Planner planner, const SE2Pose& start, const SE2Pose& goal, const std::vector<double>& bounds,
+            double cost, double plan_time, unsigned long collision_checks);
 
         tf2_ros::Buffer* tf_;
         ros::Publisher target_robot_pub;
-        costmap_2d::Costmap2DROS *navigation_costmap_ros, *collision_costmap_ros;
-        costmap_2d::Costmap2D* costmap_, *costmap_collision_;
-        base_local_planner::WorldModel* world_model;
+        costmap_2d::Costmap2DROS *navigation_costmap_ros;
+        CostmapSnapshots* snapshots;
+        CostmapSnapshotConstPtr costmap_; /** @brief The local costmap for this planning cycle, the core reads it */
+        CollisionGrid* collision_grid; /** @brief The static map around the robot, for states off the local costmap */
+        MpnetCore* core;
         bool initialized_;
-        bool use_gpu;
-
-        std::vector<torch::jit::IValue> inputs;
-        torch::jit::script::Module module;
-        torch::Device device;
-        base_local_planner::Trajectory path;
-        ob::StateSpacePtr space;
-        ob::RealVectorBounds* bounds;
-        std::shared_ptr<ob::SpaceInformation> si;
-        std::shared_ptr<og::PathSimplifier> psk;
-        std::shared_ptr<og::RRTstar> planAlgo;
-        double g_tolerance, yaw_tolerance; /** @brief The threshold for goal */
-        int num_samples, num_paths;
-        std::vector<geometry_msgs::Point> robot_footprint;
+
+        std::vector<Point2D> robot_footprint;
+        std::vector<SE2Pose> path_buffer; /** @brief Paths of the core, reused between plans */
+        QueryRecorder* recorder; /** @brief The query log, if recording */
+        PlanningRecord record_; /** @brief Reused between plans */
+        PathLibrary* library; /** @brief Paths of past plans, if used */
+        std::string library_frame;
+        std::vector<PathLibrary::Match> matches; /** @brief Reused between plans */
+        std::vector<SE2Pose> library_buffer; /** @brief A path in the other frame, reused between plans */
+        uint64_t library_slot; /** @brief The slot of the last path repaired from the library */
+        bool last_from_library;
     };
 }
\ No newline at end of file
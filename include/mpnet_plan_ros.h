@@ -27,8 +27,14 @@
 
 #include <odometry_helper_ros.h>
 #include <Controller.h>
+#include <ControllerRunner.h>
+#include <local_plan.h>
+#include <global_plan_tracker.h>
 
 #include <costmap_2d/footprint.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <std_srvs/Trigger.h>
 
 namespace ob = ompl::base;
 namespace og = ompl::geometric;
@@ -101,6 +107,32 @@ namespace mpnet_local_planner{
              */
             void pruneLocalPlan(const geometry_msgs::PoseStamped& global_pose, std::vector<geometry_msgs::PoseStamped>& plan);
 
+            /**
+             * @brief Publish the plan resampled at a constant arc length as a LocalPlan message
+             * @param plan
+             */
+            void publishCompactPlan(const std::vector<geometry_msgs::PoseStamped>& plan);
+
+            /**
+             * @brief Publish the stage timings of the planner on ~planner_metrics and /diagnostics
+             */
+            void publishMetrics(const ros::TimerEvent& event);
+
+            /**
+             * @brief Hand the settings of the planning budget to the planner and publish them on ~planning_budget
+             */
+            void applyBudget();
+
+            /**
+             * @brief The dump_trace service, writes the recorded spans to trace_file as a Chrome trace
+             */
+            bool dumpTrace(std_srvs::Trigger::Request& request, std_srvs::Trigger::Response& response);
+
+            /**
+             * @brief Dump the trace on SIGUSR1
+             */
+            void pollTraceDump(const ros::TimerEvent& event);
+
             /**
              * @brief A function to reset the logging paramters used in the function
              */
@@ -123,8 +155,17 @@ namespace mpnet_local_planner{
             std::string global_frame_; /** @brief The frame in which the controller will run */
             std::string robot_base_frame_; /** @brief Used as the base frame id of the robot */
             ros::Publisher g_plan_pub_, l_plan_pub_; /** @brief A publisher to print the local plan generated by mpnet*/
+            ros::Publisher l_plan_compact_pub_; /** @brief The local plan for the controller */
+            double compact_plan_ds; /** @brief Arc length between the samples of compact_plan */
             ros::ServiceClient resetController;
             ros::Publisher goal_footprint_pub;
+            ros::Publisher metrics_pub_, diagnostics_pub_;
+            ros::Timer metrics_timer_, trace_timer_;
+            ros::ServiceServer trace_srv_;
+            std::string trace_file_;
+            std_msgs::Float64MultiArray metrics_msg_;
+            diagnostic_msgs::DiagnosticArray diagnostics_msg_;
+            double max_cycle_time_; /** @brief The p99 planning cycle (s) above which /diagnostics warns, 0 never warns */
             ros::Publisher footprintPolygon;
             double xy_goal_tolerance, yaw_goal_tolerance;
             bool reached_goal_;
@@ -132,7 +173,7 @@ namespace mpnet_local_planner{
             
             bool valid_local_path;
             base_local_planner::Trajectory path;
-            std::vector<geometry_msgs::PoseStamped> global_plan_;
+            GlobalPlanTracker global_plan_; /** @brief The global plan and how far along it the robot is */
             std::vector<geometry_msgs::PoseStamped> local_plan;
             geometry_msgs::PoseStamped prev_goal;
 
@@ -140,7 +181,11 @@ namespace mpnet_local_planner{
             std::vector<geometry_msgs::Point> goal_region_footprint;
             // Controller controller;
             OdometryHelperRos odom_helper_;
+            boost::scoped_ptr<ControllerRunner> controller_runner_; /** @brief The controller when run inside move_base, shares odom_helper_ */
             int plan_freq, plan_freq_count;
+            boost::scoped_ptr<PlanningBudget> budget_; /** @brief Adjusts the rollouts and replanning to a target plan time, if adaptive */
+            ros::Publisher budget_pub_;
+            std_msgs::Float64MultiArray budget_msg_;
 
             // Parameters for LOGGING
             int dynmpnet_num, rrtstar_num;
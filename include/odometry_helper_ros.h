@@ -41,10 +41,19 @@
 #include <nav_msgs/Odometry.h>
 #include <ros/ros.h>
 #include <boost/thread.hpp>
+#include <boost/function.hpp>
 #include <geometry_msgs/PoseStamped.h>
+#include <seqlock.h>
 
 namespace mpnet_local_planner {
 
+/** @brief The planar pose and twist of the latest odometry message. */
+struct OdomSnapshot {
+  double x, y, yaw;   ///< Pose in the odometry frame
+  double vx, vy, wz;  ///< Twist in the base frame
+  double stamp;       ///< Message stamp (s), 0 before the first message
+};
+
 class OdometryHelperRos {
 public:
 
@@ -65,6 +74,10 @@ public:
 
   void getRobotVel(geometry_msgs::PoseStamped& robot_vel);
 
+  /** @brief Copy the latest pose and twist without locking or allocating.
+   * @return The number of messages received so far */
+  unsigned getSnapshot(OdomSnapshot& snapshot) const { return snapshot_.load(snapshot); }
+
   /** @brief Set the odometry topic.  This overrides what was set in the constructor, if anything.
    *
    * This unsubscribes from the old topic (if any) and subscribes to the new one (if any).
@@ -75,6 +88,12 @@ public:
   /** @brief Return the current odometry topic. */
   std::string getOdomTopic() const { return odom_topic_; }
 
+  /** @brief Set a function called after each odometry message is stored.
+   *
+   * It runs in the subscriber's callback, so getOdom and getRobotVel
+   * already return the new message. An empty function removes it. */
+  void setOdomCallback(const boost::function<void(const nav_msgs::Odometry::ConstPtr&)>& callback) { odom_callback_ = callback; }
+
 private:
   //odom topic
   std::string odom_topic_;
@@ -83,6 +102,8 @@ private:
   ros::Subscriber odom_sub_;
   nav_msgs::Odometry base_odom_;
   boost::mutex odom_mutex_;
+  SeqLock<OdomSnapshot> snapshot_;
+  boost::function<void(const nav_msgs::Odometry::ConstPtr&)> odom_callback_;
   // global tf frame id
   std::string frame_id_; ///< The frame_id associated this data
 };
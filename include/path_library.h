@@ -0,0 +1,147 @@
+/**
+ * A library of past local paths, for planning repeated routes from experience
+ */
+#ifndef PATH_LIBRARY_H
+#define PATH_LIBRARY_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <costmap_view.h>
+
+namespace mpnet_local_planner{
+    /**
+     * @class PathLibrary
+     * @brief Successful local paths in the map frame, kept in a memory
+     * mapped file so they survive restarts, as the experience database of
+     * Lightning. The file has a fixed number of slots of a fixed number of
+     * poses. A repaired match replaces the path it came from, a new path
+     * replaces a stored one with about the same start and goal, else the
+     * slots are reused in clock order, sparing the paths that were used
+     * since the clock last passed. A grid over the poses finds the paths
+     * passing near a start.
+     *
+     * One thread uses the library, the counters may be read by others.
+     */
+    class PathLibrary{
+        public:
+        /**
+         * @brief A stored path that passes near a start and then near a goal
+         */
+        struct Match{
+            uint64_t slot;
+            double distance; /** @brief From the start to its nearest pose, plus from the goal to its nearest pose after it (m) */
+            std::vector<SE2Pose> poses; /** @brief The poses between the two, in the map frame */
+        };
+
+        /**
+         * @brief Constructor
+         * @param radius The distance of a stored pose from the start or the goal at which it matches (m)
+         * @param yaw_tolerance The heading error at which a stored pose matches (rad)
+         */
+        PathLibrary(double radius = 0.5, double yaw_tolerance = 0.5);
+
+        ~PathLibrary();
+
+        /**
+         * @brief Map a library, an existing one keeps its size
+         * @param file_name The library file, created if missing
+         * @param capacity The number of paths of a new library
+         * @param max_poses The poses kept of each path of a new library, longer paths are subsampled
+         * @return False if the file could not be created or mapped, or is not a library
+         */
+        bool open(const std::string& file_name, size_t capacity = 2048, size_t max_poses = 128);
+
+        void close();
+
+        bool isOpen() const
+        {
+            return data_ != NULL;
+        }
+
+        /**
+         * @brief Find the stored paths that lead from near the start to near the goal
+         * @param start The start, in the map frame
+         * @param goal The goal, in the map frame
+         * @param max_matches The number of matches kept
+         * @param matches Filled with the matches, the closest first
+         * @return The number of matches
+         */
+        size_t find(const SE2Pose& start, const SE2Pose& goal, size_t max_matches, std::vector<Match>& matches);
+
+        /**
+         * @brief Count a match that was repaired into a plan, its slot is spared on the next pass of the clock
+         */
+        void markUsed(uint64_t slot);
+
+        /**
+         * @brief Store a path, in place of a stored one with about the same ends if any
+         * @param path The path, in the map frame
+         * @return False if the path has fewer than two poses
+         */
+        bool add(const std::vector<SE2Pose>& path);
+
+        /**
+         * @brief Store a path in place of the one in a slot, as a match repaired into it
+         * @param slot_index The slot of the match
+         * @param path The path, in the map frame
+         * @return False if the path has fewer than two poses or the slot does not exist
+         */
+        bool replace(uint64_t slot_index, const std::vector<SE2Pose>& path);
+
+        /**
+         * @brief The number of stored paths
+         */
+        size_t size() const
+        {
+            return paths_.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief The number of find() calls since opening
+         */
+        unsigned long getLookups() const
+        {
+            return lookups_.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief The number of markUsed() calls since opening
+         */
+        unsigned long getHits() const
+        {
+            return hits_.load(std::memory_order_relaxed);
+        }
+
+        private:
+        /**
+         * @brief The grid cells of the poses of a slot, each once
+         */
+        void cellsOf(uint64_t slot, std::vector<int64_t>& cells) const;
+
+        /**
+         * @brief Write a path to a slot and index it, keeping the used flag of the slot
+         */
+        void store(uint64_t target, const std::vector<SE2Pose>& path);
+
+        void index(uint64_t slot);
+        void unindex(uint64_t slot);
+
+        int64_t cellKey(double x, double y) const;
+
+        double radius_, yaw_tolerance_;
+        double cell_size_; /** @brief Of the grid, the radius so a search covers 3x3 cells */
+        char* data_;
+        size_t length_;
+        std::unordered_map<int64_t, std::vector<uint64_t> > grid_; /** @brief The slots with a pose in each cell */
+        std::vector<uint64_t> visited_; /** @brief The lookup that last saw each slot */
+        uint64_t lookup_;
+        std::vector<int64_t> cells_; /** @brief Reused between calls */
+        std::atomic<size_t> paths_;
+        std::atomic<unsigned long> lookups_, hits_;
+    };
+}
+
+#endif /* PATH_LIBRARY_H */
@@ -0,0 +1,137 @@
+/**
+ * Timings of the planning stages
+ */
+#ifndef PLANNER_METRICS_H
+#define PLANNER_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <boost/thread/mutex.hpp>
+#include <LatencyStats.h>
+#include <trace_recorder.h>
+
+namespace mpnet_local_planner{
+    /**
+     * @class PlannerMetrics
+     * @brief Latency percentiles and call counts of each planning stage, and
+     * the number of collision checks. Stages are recorded by the planning
+     * thread and read by the thread that publishes them.
+     */
+    class PlannerMetrics{
+        public:
+        enum Stage{
+            SNAPSHOT,     /** @brief Costmap snapshot and collision grid update */
+            COSTMAP_COPY, /** @brief Egocentric costmap for the network */
+            INFERENCE,    /** @brief Forward pass of the network */
+            PATH_CHECK,   /** @brief PathGeometric::check of a sampled segment */
+            SIMPLIFY,     /** @brief PathSimplifier::simplifyMax, or simplify within a time budget */
+            INTERPOLATE,  /** @brief PathGeometric::interpolate */
+            MPNET,        /** @brief A whole MPNet plan */
+            RRT_STAR,     /** @brief A whole RRT* plan */
+            LIBRARY,      /** @brief A whole plan repaired from the path library, found or not */
+            CYCLE,        /** @brief computeVelocityCommands */
+            NUM_STAGES
+        };
+
+        /**
+         * @brief Summary of a stage, times in seconds
+         */
+        struct Summary{
+            double p50, p95, p99, max;
+            unsigned long calls;
+        };
+
+        /**
+         * @class ScopedTimer
+         * @brief Records the time from construction to destruction as a stage,
+         * and as a trace span when tracing is on
+         */
+        class ScopedTimer{
+            public:
+            ScopedTimer(PlannerMetrics& metrics, Stage stage):
+            metrics_(metrics),
+            stage_(stage),
+            start_(std::chrono::steady_clock::now()),
+            span_(stageName(stage))
+            {
+            }
+
+            ~ScopedTimer()
+            {
+                metrics_.record(stage_, std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+            }
+
+            private:
+            PlannerMetrics& metrics_;
+            Stage stage_;
+            std::chrono::steady_clock::time_point start_;
+            TraceSpan span_;
+        };
+
+        /**
+         * @brief Constructor, measures the overhead of a ScopedTimer
+         * @param window The number of most recent samples kept per stage
+         */
+        PlannerMetrics(size_t window = 200);
+
+        /**
+         * @brief The name of a stage, as published
+         */
+        static const char* stageName(Stage stage);
+
+        /**
+         * @brief Add a sample to a stage
+         */
+        void record(Stage stage, double seconds);
+
+        /**
+         * @brief Count collision checks, cheap enough for every state
+         */
+        void countCollisionCheck()
+        {
+            collision_checks_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Total number of collision checks
+         */
+        unsigned long getCollisionChecks() const
+        {
+            return collision_checks_.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Add the number of collision checks of one plan
+         */
+        void recordPlanChecks(unsigned long checks);
+
+        /**
+         * @brief Percentiles of a stage
+         */
+        void summary(Stage stage, Summary& out);
+
+        /**
+         * @brief Percentiles of the collision checks per plan
+         */
+        void planChecks(Summary& out);
+
+        /**
+         * @brief The cost of one ScopedTimer (s), measured at construction
+         */
+        double getTimerOverhead() const
+        {
+            return timer_overhead_;
+        }
+
+        private:
+        void summarize(LatencyStats& stats, Summary& out);
+
+        boost::mutex mutex_;
+        std::vector<LatencyStats> stages_;
+        LatencyStats plan_checks_;
+        std::atomic<unsigned long> collision_checks_;
+        double timer_overhead_;
+    };
+}
+
+#endif /* PLANNER_METRICS_H */
@@ -0,0 +1,108 @@
+/**
+ * Feedback on the planning budget
+ */
+#ifndef PLANNING_BUDGET_H
+#define PLANNING_BUDGET_H
+
+#include <LatencyStats.h>
+
+namespace mpnet_local_planner{
+    /**
+     * @class PlanningBudget
+     * @brief Adjusts the rollouts, the simplification time and the replan
+     * cadence so the MPNet plans take about a target time. Every window of
+     * plans, when the 95th percentile of the plan time is over the target it
+     * cuts the simplification time if simplifying takes a large share of the
+     * plans, else the rollouts in proportion to the overrun, and when the
+     * rollouts are at their lower bounds it plans less often. Below
+     * headroom times the target it spends the headroom one step at a time:
+     * planning more often first, then more paths while the success rate is
+     * under its target, then longer rollouts, more paths and more
+     * simplification time.
+     */
+    class PlanningBudget{
+        public:
+        /**
+         * @brief What a plan may spend
+         */
+        struct Settings{
+            Settings(int num_samples = 5, int num_paths = 10, double simplify_time = 0.05, int replanning_freq = 20):
+            num_samples(num_samples),
+            num_paths(num_paths),
+            simplify_time(simplify_time),
+            replanning_freq(replanning_freq)
+            {
+            }
+
+            int num_samples; /** @brief Samples of each rollout */
+            int num_paths; /** @brief Rollouts before giving up */
+            double simplify_time; /** @brief Time for simplifying a path (s) */
+            int replanning_freq; /** @brief Planning cycles between plans */
+        };
+
+        /**
+         * @brief Constructor
+         * @param initial The settings to start from, clamped to the bounds
+         * @param min The lower bounds of the settings, the simplification time above 0
+         * @param max The upper bounds of the settings
+         * @param target_plan_time The plan time to hold the 95th percentile at (s)
+         * @param window The number of plans between adjustments
+         * @param success_target The success rate under which headroom goes to more paths first
+         * @param headroom The fraction of the target under which the budget grows
+         */
+        PlanningBudget(const Settings& initial, const Settings& min, const Settings& max,
+            double target_plan_time, int window = 10, double success_target = 0.8, double headroom = 0.7);
+
+        /**
+         * @brief Add an MPNet plan made with the current settings
+         * @param plan_time The time of the whole plan (s)
+         * @param simplify_time The time spent simplifying the path (s)
+         * @param success True if the plan found a path
+         * @return True if the settings changed
+         */
+        bool addPlan(double plan_time, double simplify_time, bool success);
+
+        const Settings& getSettings() const
+        {
+            return settings_;
+        }
+
+        /**
+         * @brief The 95th percentile of the plan time over the last full window (s)
+         */
+        double getPlanTime() const
+        {
+            return plan_time_;
+        }
+
+        /**
+         * @brief The success rate over the last full window
+         */
+        double getSuccessRate() const
+        {
+            return success_rate_;
+        }
+
+        double getTargetPlanTime() const
+        {
+            return target_plan_time_;
+        }
+
+        private:
+        /**
+         * @brief Change the settings for the window that just ended
+         * @return True if they changed
+         */
+        bool adjust(double simplify_share);
+
+        Settings settings_, min_, max_;
+        double target_plan_time_, success_target_, headroom_;
+        int window_;
+        LatencyStats plan_times_;
+        int plans_, successes_;
+        double plan_time_sum_, simplify_time_sum_;
+        double plan_time_, success_rate_;
+    };
+}
+
+#endif /* PLANNING_BUDGET_H */
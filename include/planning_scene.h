@@ -0,0 +1,99 @@
+/**
+ * Costmaps with start and goal queries, for planning offline
+ */
+#ifndef PLANNING_SCENE_H
+#define PLANNING_SCENE_H
+
+#include <string>
+#include <vector>
+#include <costmap_view.h>
+
+namespace mpnet_local_planner{
+    /**
+     * @brief A start and goal on the costmap of a scene
+     */
+    struct PlanningQuery{
+        PlanningQuery()
+        {
+        }
+
+        PlanningQuery(const SE2Pose& start, const SE2Pose& goal):
+        start(start),
+        goal(goal)
+        {
+        }
+
+        SE2Pose start, goal;
+    };
+
+    /**
+     * @class PlanningScene
+     * @brief A local costmap and the queries planned on it. Scenes are kept
+     * as text, a header followed by the cells row by row:
+     *
+     *     mpnet_scene 1
+     *     name <name>
+     *     costmap <size_x> <size_y> <resolution> <origin_x> <origin_y>
+     *     query <start x> <start y> <start yaw> <goal x> <goal y> <goal yaw>
+     *     cells
+     *     <size_y rows of size_x costs, 0 to 255>
+     */
+    class PlanningScene{
+        public:
+        PlanningScene();
+
+        /**
+         * @brief A scene with all cells free
+         */
+        PlanningScene(unsigned int size_x, unsigned int size_y, double resolution, double origin_x, double origin_y);
+
+        /**
+         * @brief Read a scene file
+         * @return False, with the reason on stderr, if the file is not a scene
+         */
+        bool load(const std::string& file_name);
+
+        /**
+         * @brief Read a scene file, or the .scene files of a directory in name order
+         * @param scenes The scenes are appended to it
+         * @return False, with the reason on stderr, at the first file that is not a scene
+         */
+        static bool loadAll(const std::string& path, std::vector<PlanningScene>& scenes);
+
+        /**
+         * @brief Write the scene to a file
+         * @return False if the file could not be written
+         */
+        bool save(const std::string& file_name) const;
+
+        /**
+         * @brief The costmap of the scene, valid while the scene is
+         */
+        CostmapView view() const
+        {
+            return CostmapView(size_x, size_y, resolution, origin_x, origin_y, cells.data());
+        }
+
+        /**
+         * @brief Inflate the lethal cells as the inflation layer of costmap_2d does
+         * @param inscribed_radius Cells closer than this to an obstacle are inscribed (m)
+         * @param inflation_radius Cells further than this stay free (m)
+         * @param cost_scaling_factor The decay of the cost past the inscribed radius
+         */
+        void inflate(double inscribed_radius, double inflation_radius, double cost_scaling_factor);
+
+        /**
+         * @brief The network bounds for this costmap, as the plugin passes them
+         */
+        std::vector<double> bounds() const;
+
+        std::string name;
+        unsigned int size_x, size_y;
+        double resolution;
+        double origin_x, origin_y;
+        std::vector<unsigned char> cells; /** @brief Row major from the cell at the origin */
+        std::vector<PlanningQuery> queries;
+    };
+}
+
+#endif /* PLANNING_SCENE_H */
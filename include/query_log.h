@@ -0,0 +1,193 @@
+/**
+ * A binary log of planning queries, for replaying them offline
+ */
+#ifndef QUERY_LOG_H
+#define QUERY_LOG_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <costmap_view.h>
+#include <planning_scene.h>
+
+namespace mpnet_local_planner{
+    /**
+     * @brief A planning query, everything the core needs to plan it again,
+     * and its result. The costmaps point to data owned by somebody else.
+     */
+    struct PlanningRecord{
+        enum Planner{
+            MPNET = 0,
+            RRT_STAR = 1
+        };
+
+        PlanningRecord():
+        sequence(0),
+        stamp(0),
+        planner(MPNET),
+        xy_tolerance(0),
+        yaw_tolerance(0),
+        num_samples(0),
+        num_paths(0),
+        seed(0),
+        simplify_time(0),
+        success(false),
+        cost(-1),
+        plan_time(0),
+        collision_checks(0)
+        {
+        }
+
+        /**
+         * @brief The query as a scene for planner_bench
+         */
+        PlanningScene toScene(const std::string& name) const;
+
+        uint64_t sequence; /** @brief Number of the record since recording started */
+        double stamp; /** @brief Time of the query (s) */
+        Planner planner;
+        SE2Pose start, goal;
+        std::vector<double> bounds; /** @brief The network bounds, empty for RRT* */
+        double xy_tolerance, yaw_tolerance;
+        int num_samples, num_paths;
+        uint64_t seed; /** @brief The torch seed of the plan */
+        double simplify_time; /** @brief The simplification budget (s), 0 for simplifyMax */
+        std::vector<Point2D> footprint;
+        CostmapView costmap; /** @brief The local costmap snapshot */
+        CostmapView fallback; /** @brief The collision grid, empty if none */
+
+        bool success;
+        double cost; /** @brief Length of an MPNet path, -1 if none and for RRT* */
+        double plan_time; /** @brief (s) */
+        uint64_t collision_checks;
+        std::vector<SE2Pose> path;
+    };
+
+    /**
+     * @class QueryRecorder
+     * @brief Appends records to a log from a thread of its own. record()
+     * only copies the record into a free buffer, and drops it if all
+     * buffers are waiting to be written, so the planner never waits on the
+     * disk. Recording stops at the first record that cannot be written,
+     * since the records after one cut short could not be read back.
+     */
+    class QueryRecorder{
+        public:
+        /**
+         * @brief Open the log, records are appended to an existing one
+         * @param file_name The log
+         * @param buffers The number of records that can wait to be written
+         */
+        QueryRecorder(const std::string& file_name, size_t buffers = 8);
+
+        /**
+         * @brief Writes the records still waiting and closes the log
+         */
+        ~QueryRecorder();
+
+        /**
+         * @brief False if the log could not be opened
+         */
+        bool isOpen() const
+        {
+            return file_ != NULL;
+        }
+
+        /**
+         * @brief Queue a record, its sequence is set by the recorder
+         * @return False if it was dropped
+         */
+        bool record(const PlanningRecord& record);
+
+        /**
+         * @brief Records dropped because the writer fell behind
+         */
+        unsigned long getDropped();
+
+        /**
+         * @brief Records written
+         */
+        unsigned long getWritten();
+
+        /**
+         * @brief Records that could not be written, or were queued once writing failed
+         */
+        unsigned long getFailed();
+
+        private:
+        void writeLoop();
+
+        FILE* file_;
+        boost::mutex mutex_;
+        boost::condition_variable cond_;
+        std::vector<std::vector<char>*> free_;
+        std::deque<std::vector<char>*> pending_;
+        std::vector<std::vector<char> > buffers_;
+        uint64_t sequence_;
+        unsigned long dropped_, written_, failed_;
+        bool stop_;
+        bool error_; /** @brief A write failed, nothing more is recorded */
+        boost::thread thread_;
+    };
+
+    /**
+     * @class QueryLog
+     * @brief Reads a log through a memory mapping. The costmaps of the
+     * records point into the mapping. A record cut short by a crash at the
+     * end of the log is left out.
+     */
+    class QueryLog{
+        public:
+        QueryLog();
+        ~QueryLog();
+
+        /**
+         * @brief Map a log
+         * @return False, with the reason on stderr, if it is not a log
+         */
+        bool open(const std::string& file_name);
+
+        /**
+         * @brief The number of records
+         */
+        size_t size() const
+        {
+            return offsets_.size();
+        }
+
+        /**
+         * @brief Read a record, valid while the log is open
+         */
+        void get(size_t index, PlanningRecord& record) const;
+
+        /**
+         * @brief The size of the file (bytes)
+         */
+        size_t getLength() const
+        {
+            return length_;
+        }
+
+        /**
+         * @brief The size up to the end of the last whole record (bytes)
+         */
+        size_t getWholeLength() const
+        {
+            return whole_length_;
+        }
+
+        private:
+        void close();
+
+        const char* data_;
+        size_t length_, whole_length_;
+        std::vector<size_t> offsets_;
+    };
+}
+
+#endif /* QUERY_LOG_H */
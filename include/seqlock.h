@@ -0,0 +1,74 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mpnet_local_planner{
+
+	/**
+	 * @class SeqLock
+	 * @brief Single writer, many reader sequence lock for small trivially copyable values.
+	 * Readers never block the writer and never allocate, they retry if a write
+	 * overlapped their copy. The value is kept in atomic words so that the
+	 * overlapping copies are not data races.
+	 */
+	template <class T>
+	class SeqLock
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+
+	public:
+		SeqLock(): seq_(0)
+		{
+			for (size_t i = 0; i < Words; i++)
+				data_[i].store(0, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief: Publish a new value, only one thread may call this
+		 */
+		void store(const T& value)
+		{
+			uint64_t words[Words] = {};
+			std::memcpy(words, &value, sizeof(T));
+			unsigned seq = seq_.load(std::memory_order_relaxed);
+			// An odd sequence marks a write in progress
+			seq_.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			for (size_t i = 0; i < Words; i++)
+				data_[i].store(words[i], std::memory_order_relaxed);
+			seq_.store(seq + 2, std::memory_order_release);
+		}
+
+		/**
+		 * @brief: Read the latest value
+		 * @return The sequence number of the value, 0 if nothing was stored yet
+		 */
+		unsigned load(T& value) const
+		{
+			uint64_t words[Words];
+			unsigned before, after;
+			do
+			{
+				before = seq_.load(std::memory_order_acquire);
+				for (size_t i = 0; i < Words; i++)
+					words[i] = data_[i].load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				after = seq_.load(std::memory_order_relaxed);
+			} while ((before & 1) || before != after);
+			std::memcpy(&value, words, sizeof(T));
+			return before / 2;
+		}
+
+	private:
+		static const size_t Words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+		std::atomic<unsigned> seq_;
+		std::atomic<uint64_t> data_[Words];
+	};
+}
+
+#endif /* SEQLOCK_H */
@@ -0,0 +1,116 @@
+/**
+ * Spans of the planner and controller cycles, for chrome://tracing or Perfetto
+ */
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <string>
+
+namespace mpnet_local_planner{
+    /**
+     * @class TraceRecorder
+     * @brief Records spans into a ring buffer per thread, the last 16384
+     * spans of each thread are kept. Recording takes no lock, the buffers are
+     * only read by dump(), which checks a sequence number per span as
+     * SeqLock does and skips the spans overwritten while it copies them.
+     * Off unless setEnabled(true) is called.
+     */
+    class TraceRecorder{
+        public:
+        /**
+         * @brief A completed span
+         */
+        struct Event{
+            const char* name;
+            uint64_t begin_ns;
+            uint64_t duration_ns;
+        };
+
+        /**
+         * @brief Start or stop recording
+         */
+        static void setEnabled(bool enabled)
+        {
+            enabled_.store(enabled, std::memory_order_relaxed);
+        }
+
+        static bool isEnabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief The steady clock in ns
+         */
+        static uint64_t now();
+
+        /**
+         * @brief Record a span of the calling thread
+         * @param name A string literal, only the pointer is kept
+         */
+        static void record(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+        /**
+         * @brief Name the calling thread in the trace
+         * @param name A string literal, only the pointer is kept
+         */
+        static void setThreadName(const char* name);
+
+        /**
+         * @brief Write the recorded spans of all threads as a Chrome trace
+         * @param path The JSON file to write
+         * @return False if the file could not be written
+         */
+        static bool dump(const std::string& path);
+
+        /**
+         * @brief Request a dump when the process receives signum, see dumpRequested
+         */
+        static void dumpOnSignal(int signum);
+
+        /**
+         * @brief True once after the signal of dumpOnSignal was received,
+         * polled from a timer since files cannot be written in the handler
+         */
+        static bool dumpRequested();
+
+        private:
+        static std::atomic<bool> enabled_;
+    };
+
+    /**
+     * @class TraceSpan
+     * @brief Records the time from construction to destruction as a span, a
+     * single relaxed load when tracing is off
+     */
+    class TraceSpan{
+        public:
+        explicit TraceSpan(const char* name):
+        name_(TraceRecorder::isEnabled() ? name : NULL),
+        begin_(name_ != NULL ? TraceRecorder::now() : 0)
+        {
+        }
+
+        ~TraceSpan()
+        {
+            if (name_ != NULL)
+                TraceRecorder::record(name_, begin_, TraceRecorder::now());
+        }
+
+        private:
+        const char* name_;
+        uint64_t begin_;
+    };
+}
+
+#define MPNET_TRACE_CONCAT_(a, b) a##b
+#define MPNET_TRACE_CONCAT(a, b) MPNET_TRACE_CONCAT_(a, b)
+/**
+ * @brief Trace the rest of the enclosing scope, name must be a string literal
+ */
+#define MPNET_TRACE_SPAN(name) ::mpnet_local_planner::TraceSpan MPNET_TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#endif /* TRACE_RECORDER_H */
@@ -1,23 +1,121 @@
 #include "Controller.h"
+#include <angles/angles.h>
 namespace mpnet_local_planner{
 
 	Controller::Controller():
 	verbose(true),
-	tf2_listener(tfBuffer)
-	{}
+	adaptive_horizon(false),
+	remaining_length(0),
+	ref_spacing(0),
+	mpc_deadline(0),
+	fallback(ref_v),
+	own_tf_buffer(new tf2_ros::Buffer()),
+	tf2_listener(new tf2_ros::TransformListener(*own_tf_buffer))
+	{
+		tfBuffer = own_tf_buffer.get();
+		mpcs.emplace_back(new MPC<N>());
+		mpc = mpcs.back().get();
+		startSolverThread();
+	}
 
-	Controller::Controller(bool verbose):
+	Controller::Controller(bool verbose, const std::string& mpc_backend, int mpc_horizon, bool adaptive_horizon, double mpc_deadline, tf2_ros::Buffer* tf):
 	verbose(verbose),
-	tf2_listener(tfBuffer)
-	{}
+	adaptive_horizon(adaptive_horizon),
+	remaining_length(0),
+	ref_spacing(0),
+	mpc_deadline(mpc_deadline),
+	fallback(ref_v),
+	tfBuffer(tf)
+	{
+		if (tfBuffer == NULL)
+		{
+			own_tf_buffer.reset(new tf2_ros::Buffer());
+			tf2_listener.reset(new tf2_ros::TransformListener(*own_tf_buffer));
+			tfBuffer = own_tf_buffer.get();
+		}
+		// With an adaptive horizon every compiled horizon up to the requested
+		// one is kept ready, smallest first.
+		for (int h : mpc_horizons)
+		{
+			if (h == mpc_horizon || (adaptive_horizon && h < mpc_horizon))
+			{
+				MPCSolver* solver = createMPCSolver(mpc_backend, h);
+				if (solver)
+					mpcs.emplace_back(solver);
+			}
+		}
+		if (mpcs.empty() || mpcs.back()->horizon() != mpc_horizon)
+		{
+			ROS_WARN("No %s MPC backend with horizon %d, using ipopt with horizon %d", mpc_backend.c_str(), mpc_horizon, N);
+			mpcs.clear();
+			mpcs.emplace_back(new MPC<N>());
+			this->adaptive_horizon = false;
+		}
+		else
+			ROS_INFO("Using the %s MPC backend with horizon %d%s", mpc_backend.c_str(), mpc_horizon, adaptive_horizon ? " (adaptive)" : "");
+		mpc = mpcs.back().get();
+		if (mpc_deadline > 0)
+			ROS_INFO("MPC deadline %.3fs, pure pursuit on misses", mpc_deadline);
+		startSolverThread();
+	}
 
-	Controller::~Controller(){}
+	Controller::~Controller()
+	{
+		{
+			boost::mutex::scoped_lock lock(solver_mutex);
+			shutdown = true;
+		}
+		solver_cond.notify_all();
+		// A running solve is bounded by the solver's own time limit
+		solver_thread.join();
+	}
+
+	void Controller::startSolverThread()
+	{
+		solver_thread = boost::thread(&Controller::solverLoop, this);
+	}
+
+	void Controller::solverLoop()
+	{
+		TraceRecorder::setThreadName("mpc_solver");
+		MPCSolution thread_solution;
+		boost::mutex::scoped_lock lock(solver_mutex);
+		while (true)
+		{
+			solver_cond.wait(lock, [this]{ return request_pending || shutdown; });
+			if (shutdown)
+				return;
+			request_pending = false;
+			// The request buffers are not written while solver_busy is set
+			MPCSolver* solver = request_solver;
+			lock.unlock();
+			{
+				MPNET_TRACE_SPAN("mpc_solve");
+				solver->Solve(request_state, request_x, request_y, thread_solution);
+			}
+			lock.lock();
+			// Late results are dropped by the next request, the solver still
+			// keeps them to warm start its next solve.
+			result = thread_solution;
+			result_ready = true;
+			solver_busy = false;
+			solver_cond.notify_all();
+		}
+	}
 
 	bool Controller::resetController(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response)
 	{
 		path_x = vector<double>(N);
 		path_y = vector<double>(N);
+		path_th = vector<double>(N);
 		path_goal = vector<double>(2);
+		{
+			// The solver thread may still be using a solver, they are reset
+			// before the next request.
+			boost::mutex::scoped_lock lock(solver_mutex);
+			reset_pending = true;
+		}
+		remaining_length = 0;
 
 		reached = true;
 		// path_goal.at(0) = x;
@@ -41,70 +139,195 @@ namespace mpnet_local_planner{
 		// ROS_INFO("x: [%f], y:[%f], th:[%f]", x, y, th);
 	}
 
-	void Controller::get_path(const nav_msgs::Path::ConstPtr& msg)
+	void Controller::observe(const OdomSnapshot& odom)
+	{
+		x = odom.x;
+		y = odom.y;
+		th = odom.yaw;
+		vel = std::hypot(odom.vx, odom.vy);
+		vth = odom.wz;
+	}
+
+	bool Controller::lookupMapToOdom()
+	{
+		// The listener fills tfBuffer from its own thread, only take what is
+		// already there and keep the last transform otherwise.
+		if (tfBuffer->canTransform("odom", "map", ros::Time(0)))
+		{
+			geometry_msgs::TransformStamped map_to_odom = tfBuffer->lookupTransform("odom", "map", ros::Time(0));
+			map_to_odom_x = map_to_odom.transform.translation.x;
+			map_to_odom_y = map_to_odom.transform.translation.y;
+			map_to_odom_yaw = tf2::getYaw(map_to_odom.transform.rotation);
+			have_map_to_odom = true;
+		}
+		else if (have_map_to_odom)
+			ROS_WARN_THROTTLE(5.0, "No current map to odom transform, using the last one");
+		return have_map_to_odom;
+	}
+
+	int Controller::nearestPoint(int n)
 	{
-		std::vector<geometry_msgs::PoseStamped> poses;
-		if (msg->header.frame_id=="map")
+		// Search around the previous closest point first, the robot only moves
+		// a little between plans.
+		const int window = 20;
+		int begin = std::max(0, std::min(curr, n - 1) - window);
+		int end = std::min(n, curr + window + 1);
+		int start = begin;
+		double min = 1e10;
+		for (int i = begin; i < end; i++)
 		{
-			geometry_msgs::TransformStamped map_to_odom;
-			map_to_odom = tfBuffer.lookupTransform("odom","map", ros::Time(0), ros::Duration(2.0) );
-			for (int j=0;j<msg->poses.size();j++)
+			double d = (plan_xy.col(i) - Eigen::Vector2d(x, y)).squaredNorm();
+			if (d < min)
 			{
-				geometry_msgs::PoseStamped p;
-				tf2::doTransform(msg->poses[j], p, map_to_odom);
-				poses.push_back(p);
+				start = i;
+				min = d;
 			}
 		}
-		else
+		// A minimum on the window edge may continue outside of it, a far one
+		// means the plan changed under the robot.
+		bool on_edge = (start == begin && begin > 0) || (start == end - 1 && end < n);
+		if (on_edge || min > 0.5*0.5)
 		{
-			poses = msg->poses;
+			Eigen::Index i;
+			(plan_xy.leftCols(n).colwise() - Eigen::Vector2d(x, y)).colwise().squaredNorm().minCoeff(&i);
+			start = i;
 		}
-		
-		// std::cout<<poses.size()<<std::endl;
-		// int k = 2;
-		int k = 3;
-		int length = poses.size()>(std::size_t)(N*k) ? N: poses.size(), start = 0;
-		
-		double min = 1e10;
+		return start;
+	}
 
-		double xi = 0., yi = 0., tmp = 0.;
-		for(unsigned int i = 0; i< poses.size(); i++){
-			xi = poses.at(i).pose.position.x;
-			yi = poses.at(i).pose.position.y;
-			tmp = (x-xi)*(x-xi) + (y-yi) * (y-yi);
-			if(tmp < min){
-				start = i;
-				min = tmp;
-			}
-			if((std::size_t)(start+length*k) > poses.size()){
-					length = (poses.size() - start) / k;
+	void Controller::reservePlan(int n)
+	{
+		if (plan_xy.cols() < n)
+		{
+			// Grow only, later plans reuse the buffers
+			plan_xy.resize(2, n);
+			plan_yaw.resize(n);
+		}
+	}
+
+	void Controller::get_path(const nav_msgs::Path::ConstPtr& msg)
+	{
+		int n = msg->poses.size();
+		reservePlan(n);
+		for (int j = 0; j < n; j++)
+		{
+			plan_xy(0, j) = msg->poses[j].pose.position.x;
+			plan_xy(1, j) = msg->poses[j].pose.position.y;
+			plan_yaw[j] = tf2::getYaw(msg->poses[j].pose.orientation);
+		}
+		setReference(n, msg->header.frame_id, 0);
+	}
+
+	void Controller::get_plan(const mpnet_plan::LocalPlan::ConstPtr& msg)
+	{
+		int n = std::min(msg->x.size(), std::min(msg->y.size(), msg->yaw.size()));
+		reservePlan(n);
+		plan_xy.row(0).head(n) = Eigen::Map<const Eigen::VectorXf>(msg->x.data(), n).cast<double>();
+		plan_xy.row(1).head(n) = Eigen::Map<const Eigen::VectorXf>(msg->y.data(), n).cast<double>();
+		plan_yaw.head(n) = Eigen::Map<const Eigen::VectorXf>(msg->yaw.data(), n).cast<double>();
+		setReference(n, msg->header.frame_id, msg->ds);
+	}
+
+	void Controller::setReference(int n, const std::string& frame_id, double ds)
+	{
+		if (frame_id=="map")
+		{
+			if (!lookupMapToOdom())
+			{
+				ROS_WARN_THROTTLE(5.0, "No map to odom transform yet, ignoring the local plan");
+				return;
 			}
+			// Planar transform of the whole plan
+			Eigen::Matrix2d rotation = Eigen::Rotation2Dd(map_to_odom_yaw).toRotationMatrix();
+			plan_xy.leftCols(n) = (rotation * plan_xy.leftCols(n)).colwise() + Eigen::Vector2d(map_to_odom_x, map_to_odom_y);
+			plan_yaw.head(n).array() += map_to_odom_yaw;
+		}
 
-			// if(start > curr){
-			// 	curr = start;
-			// }
-			curr = start;
+		int horizon = mpcs.back()->horizon();
+		curr = n > 0 ? nearestPoint(n) : 0;
+		int length;
+		if (ds > 0)
+		{
+			// One reference per MPC step, the distance the model covers in dt
+			double step = ref_v * dt / ds;
+			length = n > 0 ? std::min(horizon, (int)((n - 1 - curr) / step) + 1) : 0;
+			path_x.resize(length);
+			path_y.resize(length);
+			path_th.resize(length);
+			for (int i = 0; i < length; i++)
+			{
+				double f = curr + i * step;
+				int i0 = std::min((int)f, n - 1);
+				int i1 = std::min(i0 + 1, n - 1);
+				double t = f - i0;
+				path_x[i] = (1 - t) * plan_xy(0, i0) + t * plan_xy(0, i1);
+				path_y[i] = (1 - t) * plan_xy(1, i0) + t * plan_xy(1, i1);
+				path_th[i] = plan_yaw[i0] + t * angles::shortest_angular_distance(plan_yaw[i0], plan_yaw[i1]);
+			}
+		}
+		else
+		{
+			// int k = 2;
+			int k = 3;
+			// Every k-th pose from the closest one, at most a horizon of them
+			length = std::min(horizon, (n - curr) / k);
+			path_x.resize(length);
+			path_y.resize(length);
+			path_th.resize(length);
+			for (int i = 0; i < length; i++)
+			{
+				path_x[i] = plan_xy(0, i*k+curr);
+				path_y[i] = plan_xy(1, i*k+curr);
+				path_th[i] = plan_yaw[i*k+curr];
+			}
 		}
-		if(poses.size()>=1){
+
+		if(n>=1){
 			reached = false;
-			path_goal.at(0) = poses.back().pose.position.x;
-			path_goal.at(1) = poses.back().pose.position.y;
+			path_goal.at(0) = plan_xy(0, n - 1);
+			path_goal.at(1) = plan_xy(1, n - 1);
 		}
 		else{
 			reached = true;
 			path_goal.at(0) = x;
 			path_goal.at(1) = y;
 		}
+		fallback.setPath(path_x, path_y, path_th);
 
-		
-		
-		path_x = std::vector<double>(length);
-		path_y = std::vector<double>(length); 
-		
-		for (int i = 0; i < length; i++)
+		// Arc length left on the plan and the spacing of the reference points,
+		// used to size the horizon.
+		remaining_length = 0;
+		if (n - curr > 1)
+			remaining_length = (plan_xy.block(0, curr + 1, 2, n - curr - 1) - plan_xy.block(0, curr, 2, n - curr - 1)).colwise().norm().sum();
+		double reference_length = 0;
+		for (int i = 1; i < length; i++)
+			reference_length += std::hypot(path_x[i] - path_x[i-1], path_y[i] - path_y[i-1]);
+		ref_spacing = length > 1 ? reference_length / (length - 1) : 0;
+	}
+
+	void Controller::selectHorizon()
+	{
+		MPCSolver* selected = mpcs.back().get();
+		if (adaptive_horizon && ref_spacing > 0)
 		{
-			path_x.at(i) = poses.at(i*k+curr).pose.position.x;
-			path_y.at(i) = poses.at(i*k+curr).pose.position.y;
+			// Smallest horizon that still reaches the end of the plan
+			int steps = (int)std::ceil(remaining_length / ref_spacing) + 1;
+			for (size_t i = 0; i < mpcs.size(); i++)
+			{
+				if (mpcs[i]->horizon() >= steps)
+				{
+					selected = mpcs[i].get();
+					break;
+				}
+			}
+		}
+		if (selected != mpc)
+		{
+			// The warm start of the other horizon is from an older cycle
+			selected->Reset();
+			mpc = selected;
+			if (verbose)
+				ROS_INFO("MPC horizon set to %d", mpc->horizon());
 		}
 	}
 
@@ -145,7 +368,110 @@ namespace mpnet_local_planner{
 	}
 
 
- */	void Controller::control(ackermann_msgs::AckermannDriveStamped& _ackermann_msg){
+ */	void Controller::propagateState(double t)
+	{
+		x += vel * cos(th) * t;
+		y += vel * sin(th) * t;
+		th += vel * last_steer / Lf * t;
+	}
+
+	bool Controller::solveMPC(double& steer_value, double& throttle_value)
+	{
+		MPNET_TRACE_SPAN("mpc_wait");
+		ros::WallTime start_time = ros::WallTime::now();
+		if (predict_state)
+			propagateState(expected_solve_time);
+		bool solved = waitMPC(steer_value, throttle_value);
+		// Exponential average, the fallback cycles count with the full wait
+		double solve_time = (ros::WallTime::now() - start_time).toSec();
+		expected_solve_time = expected_solve_time > 0 ? 0.8 * expected_solve_time + 0.2 * solve_time : solve_time;
+		return solved;
+	}
+
+	bool Controller::waitMPC(double& steer_value, double& throttle_value)
+	{
+		boost::mutex::scoped_lock lock(solver_mutex);
+		solve_count++;
+		if (solver_busy)
+		{
+			// Still solving an earlier cycle, do not queue behind it
+			deadline_misses++;
+			return false;
+		}
+		if (reset_pending)
+		{
+			mpc = mpcs.back().get();
+			for (size_t i = 0; i < mpcs.size(); i++)
+				mpcs[i]->Reset();
+			reset_pending = false;
+		}
+		selectHorizon();
+		// Pad the reference with its last point up to the horizon
+		int horizon = mpc->horizon();
+		ptsx.setConstant(horizon, path_x.back());
+		ptsy.setConstant(horizon, path_y.back());
+		int length = std::min((int)path_x.size()-1, horizon-1);
+		for( int i = 0; i < length ; i++){
+			ptsx[i] = path_x[i];
+			ptsy[i] = path_y[i];
+		}
+		// solve MPC
+		double px = x;
+		double py = y;
+		double psi = th;
+		double v = vel;
+
+		double str = sta;
+		double throttle = a;
+		// Reference in the robot frame
+		for(int i = 0; i < horizon; i++){
+			double diffx = ptsx[i]-px;
+			double diffy = ptsy[i]-py;
+			ptsx[i] = diffx * cos(psi) + diffy * sin(psi);
+			ptsy[i] = diffy * cos(psi) - diffx * sin(psi);
+		}
+
+		// double px_l = /*v*/ 0.3 * dt;
+		// double py_l = 0.0;
+		// double psi_l = /*v*/ 0.3 * str / Lf * dt;
+		// double v_l = 0.3;//v + throttle*dt;
+		request_state.x = v * dt;
+		request_state.y = 0.0;
+		request_state.psi = v * str / Lf * dt;
+		request_state.v = v + throttle*dt;
+		request_x = ptsx;
+		request_y = ptsy;
+		request_solver = mpc;
+		request_pending = true;
+		solver_busy = true;
+		result_ready = false;
+		solver_cond.notify_all();
+
+		if (mpc_deadline > 0)
+		{
+			boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::duration<double>(mpc_deadline);
+			if (!solver_cond.wait_until(lock, deadline, [this]{ return result_ready; }))
+			{
+				deadline_misses++;
+				return false;
+			}
+		}
+		else
+			solver_cond.wait(lock, [this]{ return result_ready; });
+		solution = result;
+
+		steer_value = solution.steering; /// (deg2rad(25)*Lf);
+		throttle_value = solution.throttle; //r[1]*(1-fabs(steer_value))+0.1;
+		return true;
+	}
+
+	bool Controller::solveFallback(double& steer_value, double& velocity_value)
+	{
+		ROS_WARN_THROTTLE(5.0, "MPC missed its %.3fs deadline, using pure pursuit (%lu of %lu solves missed)", mpc_deadline, deadline_misses, solve_count);
+		return fallback.control(x, y, th, steer_value, velocity_value);
+	}
+
+	void Controller::control(ackermann_msgs::AckermannDriveStamped& _ackermann_msg){
 		// deal with path
 		if(verbose){
 			// for (unsigned int i = 0; i < ptsx.size(); i++){
@@ -164,53 +490,12 @@ namespace mpnet_local_planner{
 			_ackermann_msg.drive.acceleration = 0;//throttle_value;
 		}
 		else{
-			std::vector<double> ptsx(N, path_x.back());
-			std::vector<double> ptsy(N, path_y.back());
-			// vector<double> ptsy = std::vector<double>(N);
-			int length = ((path_x.size()-1) < (N-1)) ? (path_x.size()-1) : (N-1);
-			for( int i = 0; i < length ; i++){
-				ptsx.at(i) = path_x.at(i);
-				ptsy.at(i) = path_y.at(i);
-			}
-			// solve MPC		
-			double px = x;
-			double py = y;
-			double psi = th;
-			double v = vel;
-
-			double str = sta;
-			double throttle = a;
-			for(unsigned int i = 0; i < ptsx.size(); i++){
-					double diffx = ptsx[i]-px;
-					double diffy = ptsy[i]-py;
-					ptsx[i] = diffx * cos(psi) + diffy * sin(psi);
-					ptsy[i] = diffy * cos(psi) - diffx * sin(psi);
-			}
-			// int horizon = ptsx.size();
-
-			std::vector<double> ptsxV = ptsx;
-			std::vector<double> ptsyV = ptsy;
-			std::vector<double> state;
-
-			// double px_l = /*v*/ 0.3 * dt;
-			// double py_l = 0.0;
-			// double psi_l = /*v*/ 0.3 * str / Lf * dt;
-			// double v_l = 0.3;//v + throttle*dt;
-			double px_l = v * dt;
-			double py_l = 0.0;
-			double psi_l = v * str / Lf * dt;
-			double v_l = v + throttle*dt;
-			state.push_back(px_l);
-			state.push_back(py_l);
-			state.push_back(psi_l);
-			state.push_back(v_l);
-			std::vector<double> r;
-			r = mpc.Solve(state, ptsxV, ptsyV);
-
-			double steer_value = r[0]; /// (deg2rad(25)*Lf);
-			double throttle_value = r[1]; //r[1]*(1-fabs(steer_value))+0.1;
+			double steer_value, throttle_value = 0;
 			// double velocity_value = vel + throttle_value * dt;  
 			double velocity_value = ref_v;
+			if (!solveMPC(steer_value, throttle_value))
+				solveFallback(steer_value, velocity_value);
+			last_steer = steer_value;
 
 			_ackermann_msg.drive.steering_angle = steer_value;
 			_ackermann_msg.drive.speed = velocity_value;
@@ -245,46 +530,13 @@ namespace mpnet_local_planner{
 			cmd_vel.angular.z = 0;
 		}
 		else{
-			std::vector<double> ptsx(N, path_x.back());
-			std::vector<double> ptsy(N, path_y.back());
-			// vector<double> ptsy = std::vector<double>(N);
-			int length = ((path_x.size()-1) < (N-1)) ? (path_x.size()-1) : (N-1);
-			for( int i = 0; i < length ; i++){
-				ptsx.at(i) = path_x.at(i);
-				ptsy.at(i) = path_y.at(i);
-			}
-			// solve MPC		
-			double px = x;
-			double py = y;
-			double psi = th;
-			double v = vel;
-
-			double str = sta;
-			double throttle = a;
-			for(unsigned int i = 0; i < ptsx.size(); i++){
-				double diffx = ptsx[i]-px;
-				double diffy = ptsy[i]-py;
-				ptsx[i] = diffx * cos(psi) + diffy * sin(psi);
-				ptsy[i] = diffy * cos(psi) - diffx * sin(psi);
-			}
-			std::vector<double> ptsxV = ptsx;
-			std::vector<double> ptsyV = ptsy;
-			std::vector<double> state;
-
-			double px_l = v * dt;
-			double py_l = 0.0;
-			double psi_l = v * str / Lf * dt;
-			double v_l = v + throttle*dt;
-			state.push_back(px_l);
-			state.push_back(py_l);
-			state.push_back(psi_l);
-			state.push_back(v_l);
-			std::vector<double> r;
-			r = mpc.Solve(state, ptsxV, ptsyV);
-
-			double steer_value = r[0]; /// (deg2rad(25)*Lf);
-			double throttle_value = r[1]; //r[1]*(1-fabs(steer_value))+0.1;
-			double velocity_value = vel + throttle_value * dt;  
+			double steer_value, throttle_value = 0;
+			double velocity_value;
+			if (solveMPC(steer_value, throttle_value))
+				velocity_value = vel + throttle_value * dt;  
+			else
+				solveFallback(steer_value, velocity_value);
+			last_steer = steer_value;
 			// double velocity_value = ref_v;
 			if(verbose){
 				ROS_INFO("sta: [%f], v:[%f], a:[%f]", steer_value, velocity_value, throttle_value);
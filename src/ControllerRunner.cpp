@@ -0,0 +1,242 @@
+#include <ControllerRunner.h>
+#include <boost/make_shared.hpp>
+
+namespace mpnet_local_planner{
+
+	namespace{
+		/**
+		 * @brief: A control step posted to the runner queue
+		 */
+		class StepCallback : public ros::CallbackInterface
+		{
+		public:
+			StepCallback(const boost::function<void()>& step): step_(step) {}
+
+			CallResult call()
+			{
+				step_();
+				return Success;
+			}
+
+		private:
+			boost::function<void()> step_;
+		};
+	}
+
+	ControllerRunner::ControllerRunner(ros::NodeHandle& host_nh, ros::NodeHandle& private_nh, OdometryHelperRos* odom_helper, bool subscribe_plan, tf2_ros::Buffer* tf):
+	odom_helper_(odom_helper),
+	reset_pending_(false),
+	step_queued_(false),
+	spinner_(1, &queue_),
+	new_plan_(false)
+	{
+		// Everything the runner serves goes to its own queue
+		ros::NodeHandle nh(host_nh);
+		nh.setCallbackQueue(&queue_);
+		ros::NodeHandle runner_private_nh(private_nh);
+		runner_private_nh.setCallbackQueue(&queue_);
+
+		std::string mpc_backend;
+		private_nh.param<std::string>("mpc_backend", mpc_backend, "ipopt");
+		int mpc_horizon;
+		private_nh.param("mpc_horizon", mpc_horizon, N);
+		bool adaptive_horizon;
+		private_nh.param("adaptive_horizon", adaptive_horizon, false);
+		double mpc_deadline;
+		private_nh.param("mpc_deadline", mpc_deadline, 0.04);
+		// What starts a control step: "odom" runs on every odometry message,
+		// "rate" and "timer" run from a ros::Timer at control_rate.
+		std::string trigger;
+		private_nh.param<std::string>("trigger", trigger, "rate");
+		double control_rate;
+		private_nh.param("control_rate", control_rate, 20.0);
+		bool predict_state;
+		private_nh.param("predict_state", predict_state, false);
+		// Follow the compact LocalPlan instead of the nav_msgs/Path local plan
+		bool compact_plan;
+		private_nh.param("compact_plan", compact_plan, false);
+		// Record spans of the control steps and MPC solves, written as a
+		// Chrome trace by ~dump_trace or SIGUSR1
+		bool trace;
+		private_nh.param("trace", trace, false);
+		private_nh.param<std::string>("trace_file", trace_file_, "/tmp/mpnet_controller_trace.json");
+
+		if (odom_helper_ == NULL)
+		{
+			// For simulation use /pf/pose/odom, for real-world use
+			// /robot_pose_ekf/odom_ekf_topic
+			std::string odom_topic;
+			private_nh.param<std::string>("odom_topic", odom_topic, "/pf/pose/odom");
+			own_odom_helper_.reset(new OdometryHelperRos(odom_topic));
+			odom_helper_ = own_odom_helper_.get();
+		}
+
+		controller_.reset(new Controller(false, mpc_backend, mpc_horizon, adaptive_horizon, mpc_deadline, tf));
+		controller_->setPredictState(predict_state);
+
+		if (subscribe_plan)
+		{
+			if (compact_plan)
+				plan_sub_ = nh.subscribe("/move_base/MpnetLocalPlanner/local_plan_compact", 2, &ControllerRunner::setPlan, this);
+			else
+				plan_sub_ = nh.subscribe("/move_base/MpnetLocalPlanner/local_plan", 2, &ControllerRunner::setPath, this);
+		}
+		// cmd_pub_ = nh.advertise<ackermann_msgs::AckermannDriveStamped>("/vesc/high_level/ackermann_cmd_mux/input/nav_0", 10);
+		cmd_pub_ = nh.advertise<ackermann_msgs::AckermannDriveStamped>("/vesc/ackermann_cmd_mux/input/navigation", 10);
+		reset_srv_ = nh.advertiseService("reset_controller", &ControllerRunner::resetService, this);
+		if (trace)
+		{
+			TraceRecorder::setEnabled(true);
+			TraceRecorder::dumpOnSignal(SIGUSR1);
+			trace_srv_ = runner_private_nh.advertiseService("dump_trace", &ControllerRunner::dumpTrace, this);
+		}
+
+		// Latencies as p50, p90, p99, max (ms) and the number of samples in
+		// the window.
+		odom_latency_pub_ = runner_private_nh.advertise<std_msgs::Float64MultiArray>("control_latency", 1);
+		plan_latency_pub_ = runner_private_nh.advertise<std_msgs::Float64MultiArray>("plan_latency", 1);
+		latency_msg_.layout.dim.resize(1);
+		latency_msg_.layout.dim[0].label = "p50,p90,p99,max,samples";
+		latency_msg_.layout.dim[0].size = 5;
+		latency_msg_.layout.dim[0].stride = 5;
+		latency_msg_.data.resize(5);
+		latency_timer_ = nh.createTimer(ros::Duration(1.0), &ControllerRunner::publishLatency, this);
+
+		ROS_INFO("Control steps triggered by %s", trigger.c_str());
+		if (trigger == "odom")
+			odom_helper_->setOdomCallback(boost::bind(&ControllerRunner::queueStep, this));
+		else
+			control_timer_ = nh.createTimer(ros::Duration(1.0 / control_rate), boost::bind(&ControllerRunner::step, this));
+		spinner_.start();
+	}
+
+	ControllerRunner::~ControllerRunner()
+	{
+		odom_helper_->setOdomCallback(boost::function<void(const nav_msgs::Odometry::ConstPtr&)>());
+		control_timer_.stop();
+		spinner_.stop();
+		ROS_INFO("MPC missed the deadline in %lu of %lu cycles", controller_->getDeadlineMisses(), controller_->getSolveCount());
+	}
+
+	void ControllerRunner::planReceived(const ros::Time& stamp)
+	{
+		plan_stamp_ = stamp;
+		new_plan_ = !stamp.isZero();
+	}
+
+	void ControllerRunner::setPlan(const mpnet_plan::LocalPlan::ConstPtr& plan)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		pending_plan_ = plan;
+		pending_path_.reset();
+	}
+
+	void ControllerRunner::setPath(const nav_msgs::Path::ConstPtr& path)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		pending_path_ = path;
+		pending_plan_.reset();
+	}
+
+	bool ControllerRunner::resetService(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response)
+	{
+		reset();
+		return true;
+	}
+
+	void ControllerRunner::reset()
+	{
+		// A plan handed over before the reset belongs to the old goal
+		boost::mutex::scoped_lock lock(mutex_);
+		reset_pending_ = true;
+		pending_plan_.reset();
+		pending_path_.reset();
+	}
+
+	void ControllerRunner::applyPending()
+	{
+		mpnet_plan::LocalPlan::ConstPtr plan;
+		nav_msgs::Path::ConstPtr path;
+		bool reset;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			plan.swap(pending_plan_);
+			path.swap(pending_path_);
+			reset = reset_pending_;
+			reset_pending_ = false;
+		}
+		if (reset)
+		{
+			std_srvs::Empty::Request request;
+			std_srvs::Empty::Response response;
+			controller_->resetController(request, response);
+		}
+		if (plan)
+		{
+			controller_->get_plan(plan);
+			planReceived(plan->header.stamp);
+		}
+		else if (path)
+		{
+			controller_->get_path(path);
+			planReceived(path->header.stamp);
+		}
+	}
+
+	bool ControllerRunner::dumpTrace(std_srvs::Trigger::Request& request, std_srvs::Trigger::Response& response)
+	{
+		response.success = TraceRecorder::dump(trace_file_);
+		response.message = trace_file_;
+		return true;
+	}
+
+	void ControllerRunner::queueStep()
+	{
+		// Odometry may come faster than the steps run, one waiting step is enough
+		if (!step_queued_.exchange(true))
+			queue_.addCallback(boost::make_shared<StepCallback>(boost::bind(&ControllerRunner::step, this)), (uint64_t)this);
+	}
+
+	void ControllerRunner::step()
+	{
+		MPNET_TRACE_SPAN("control");
+		step_queued_ = false;
+		applyPending();
+		odom_helper_->getSnapshot(odom_);
+		controller_->observe(odom_);
+		// controller_->control_cmd_vel(cmd_vel);
+		controller_->control(cmd_);
+		cmd_.header.stamp = ros::Time::now();
+		cmd_pub_.publish(cmd_);
+		if (odom_.stamp > 0)
+			odom_latency_.add(cmd_.header.stamp.toSec() - odom_.stamp);
+		if (new_plan_)
+		{
+			plan_latency_.add((cmd_.header.stamp - plan_stamp_).toSec());
+			new_plan_ = false;
+		}
+	}
+
+	void ControllerRunner::publishLatency(const ros::TimerEvent& event)
+	{
+		if (TraceRecorder::dumpRequested())
+		{
+			std_srvs::Trigger::Request request;
+			std_srvs::Trigger::Response response;
+			dumpTrace(request, response);
+			ROS_INFO("Wrote the trace to %s", trace_file_.c_str());
+		}
+		// On the spinner thread, as the steps that add the latencies
+		LatencyStats* stats[] = {&odom_latency_, &plan_latency_};
+		ros::Publisher* pubs[] = {&odom_latency_pub_, &plan_latency_pub_};
+		for (int i = 0; i < 2; i++)
+		{
+			latency_msg_.data[0] = stats[i]->percentile(50) * 1e3;
+			latency_msg_.data[1] = stats[i]->percentile(90) * 1e3;
+			latency_msg_.data[2] = stats[i]->percentile(99) * 1e3;
+			latency_msg_.data[3] = stats[i]->max() * 1e3;
+			latency_msg_.data[4] = stats[i]->size();
+			pubs[i]->publish(latency_msg_);
+		}
+	}
+}
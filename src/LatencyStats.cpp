@@ -0,0 +1,47 @@
+#include "LatencyStats.h"
+#include <algorithm>
+#include <cmath>
+
+namespace mpnet_local_planner{
+
+	LatencyStats::LatencyStats(size_t window):
+	samples_(std::max<size_t>(window, 1)),
+	next_(0),
+	count_(0),
+	total_(0),
+	sorted_valid_(false)
+	{
+		sorted_.reserve(samples_.size());
+	}
+
+	void LatencyStats::add(double value)
+	{
+		samples_[next_] = value;
+		next_ = (next_ + 1) % samples_.size();
+		count_ = std::min(count_ + 1, samples_.size());
+		total_++;
+		sorted_valid_ = false;
+	}
+
+	double LatencyStats::percentile(double p)
+	{
+		if (count_ == 0)
+			return 0;
+		if (!sorted_valid_)
+		{
+			sorted_.assign(samples_.begin(), samples_.begin() + count_);
+			std::sort(sorted_.begin(), sorted_.end());
+			sorted_valid_ = true;
+		}
+		p = std::min(100.0, std::max(0.0, p));
+		size_t rank = (size_t)std::ceil(p / 100.0 * count_);
+		return sorted_[rank > 0 ? rank - 1 : 0];
+	}
+
+	double LatencyStats::max() const
+	{
+		if (count_ == 0)
+			return 0;
+		return *std::max_element(samples_.begin(), samples_.begin() + count_);
+	}
+}
@@ -1,191 +1,562 @@
 #include "MPC.h"
+#include "RTIMPC.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <set>
 #include <cppad/cppad.hpp>
-#include <cppad/ipopt/solve.hpp>
+#include <coin/IpIpoptApplication.hpp>
+#include <coin/IpRegOptions.hpp>
+#include <coin/IpTNLP.hpp>
 
 using CppAD::AD;
 
+// Offsets of the decision variables for a given horizon.
+template <int Horizon>
+struct MPCLayout {
+  enum : size_t {
+    x_start = 0,
+    y_start = x_start + Horizon,
+    psi_start = y_start + Horizon,
+    v_start = psi_start + Horizon,
+    delta_start = v_start + Horizon,
+    a_start = delta_start + Horizon - 1,
+    // Number of model variables (includes both states and inputs).
+    n_vars = Horizon * 4 + (Horizon - 1) * 2,
+    // Number of constraints
+    n_constraints = Horizon * 4
+  };
+};
+
+template <int Horizon, class Model>
 class FG_eval {
  public:
-  // Fitted polynomial coefficients
-  std::vector<double> tgx, tgy;
-  FG_eval(std::vector<double> ptsx, std::vector<double> ptsy) { 
-    this -> tgx = ptsx;
-    this -> tgy = ptsy; 
-  }
+  typedef MPCLayout<Horizon> L;
   typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
-  void operator()(ADvector& fg, const ADvector& vars) {
+  // The reference path is a dynamic parameter of the tape: p = [tgx, tgy].
+  void operator()(ADvector& fg, const ADvector& vars, const ADvector& p) {
     fg[0] = 0;
-    for (int t = 0; t < N; t++) {
+    for (int t = 0; t < Horizon; t++) {
       // fg[0] += 100.0*CppAD::pow(vars[cte_start + t], 2);
       // fg[0] += 100.0*CppAD::pow(vars[epsi_start + t], 2);
-      fg[0] += 500 *CppAD::pow(vars[x_start + t]-tgx[t], 2);
-      fg[0] += 500 *CppAD::pow(vars[y_start + t]-tgy[t], 2);
-      // fg[0] += 50 *CppAD::pow(vars[v_start + t]- ref_v, 2);
-      // fg[0] += 10*(CppAD::pow(vars[x_start + t] - goal[0], 2)+CppAD::pow(vars[y_start + t] - goal[1], 2));
+      fg[0] += 500 *CppAD::pow(vars[L::x_start + t]-p[t], 2);
+      fg[0] += 500 *CppAD::pow(vars[L::y_start + t]-p[Horizon + t], 2);
+      // fg[0] += 50 *CppAD::pow(vars[L::v_start + t]- Model::ref_v, 2);
     }
 
-    // fg[0] += 500 * CppAD::pow(vars[x_start + N-1]-tgx[N-1], 2);
-    // fg[0] += 500 * CppAD::pow(vars[y_start + N-1]-tgy[N-1], 2);
-
-    // for (int t = 0; t < N - 1; t++) {
-    //   fg[0] += 1*CppAD::pow(vars[delta_start + t], 2);
-    //   fg[0] += 1*CppAD::pow(vars[a_start + t], 2);
+    // for (int t = 0; t < Horizon - 1; t++) {
+    //   fg[0] += 1*CppAD::pow(vars[L::delta_start + t], 2);
+    //   fg[0] += 1*CppAD::pow(vars[L::a_start + t], 2);
     // }
 
-    for (int t = 0; t < N - 2; t++) {
-      fg[0] += 50*CppAD::pow(vars[delta_start + t + 1] - vars[delta_start + t], 2);
-      // fg[0] += 0.1*CppAD::pow(vars[a_start + t + 1] - vars[a_start + t], 2);
+    for (int t = 0; t < Horizon - 2; t++) {
+      fg[0] += 50*CppAD::pow(vars[L::delta_start + t + 1] - vars[L::delta_start + t], 2);
+      // fg[0] += 0.1*CppAD::pow(vars[L::a_start + t + 1] - vars[L::a_start + t], 2);
     }
     // terminal loss
-    fg[1 + x_start] = vars[x_start];
-    fg[1 + y_start] = vars[y_start];
-    fg[1 + psi_start] = vars[psi_start];
-    fg[1 + v_start] = vars[v_start];
-    for (int t = 1; t < N; t++) {
-      if(t >= tgx.size()){
-        fg[1 + x_start + t] = 0;
-        fg[1 + y_start + t] = 0;
-        fg[1 + psi_start + t] = 0;
-        fg[1 + v_start + t] = 0;
+    fg[1 + L::x_start] = vars[L::x_start];
+    fg[1 + L::y_start] = vars[L::y_start];
+    fg[1 + L::psi_start] = vars[L::psi_start];
+    fg[1 + L::v_start] = vars[L::v_start];
+    // The caller always pads the reference to Horizon points, so the structure of
+    // the problem is the same for every solve.
+    for (int t = 1; t < Horizon; t++) {
+      AD<double> x1 = vars[L::x_start + t];
+      AD<double> y1 = vars[L::y_start + t];
+      AD<double> psi1 = vars[L::psi_start + t];
+      AD<double> x0 = vars[L::x_start + t - 1];
+      AD<double> y0 = vars[L::y_start + t - 1];
+      AD<double> psi0 = vars[L::psi_start + t - 1];
+      AD<double> delta0 = vars[L::delta_start + t - 1];
+      fg[1 + L::x_start + t] = x1 - (x0 + Model::ref_v * CppAD::cos(psi0) * Model::dt);
+      fg[1 + L::y_start + t] = y1 - (y0 + Model::ref_v * CppAD::sin(psi0) * Model::dt);
+      fg[1 + L::psi_start + t] = psi1 - (psi0 + Model::ref_v * delta0 / Model::Lf * Model::dt);
+      // fg[1 + L::v_start + t] = v1 - (v0 + a0 * Model::dt);
+      fg[1 + L::v_start + t] = 0;
+    }
+  }
+};
+
+//
+// IPOPT interface over a tape that is recorded once.
+//
+template <int Horizon, class Model>
+class MPC_NLP : public Ipopt::TNLP {
+ public:
+  typedef MPCLayout<Horizon> L;
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  typedef std::vector<std::set<size_t> > SetVector;
+
+  MPC_NLP():
+  x0_(L::n_vars),
+  ref_(2 * Horizon),
+  x_lower_(L::n_vars),
+  x_upper_(L::n_vars),
+  g_lower_(L::n_constraints),
+  g_upper_(L::n_constraints),
+  solution_(L::n_vars),
+  z_L_(L::n_vars),
+  z_U_(L::n_vars),
+  lambda_(L::n_constraints),
+  status_(Ipopt::INTERNAL_ERROR),
+  warm_(false)
+  {
+    record();
+  }
+
+  // Record the tape with the reference path as dynamic parameters and
+  // compute the sparsity patterns. Done once by the constructor, and again
+  // by every solve with the "retape" option to measure what that costs.
+  void record() {
+    typename FG_eval<Horizon, Model>::ADvector avars(L::n_vars), ap(2 * Horizon), afg(1 + L::n_constraints);
+    for (size_t i = 0; i < L::n_vars; i++) {
+      avars[i] = 0;
+    }
+    for (size_t i = 0; i < 2 * Horizon; i++) {
+      ap[i] = 0;
+    }
+    CppAD::Independent(avars, 0, false, ap);
+    FG_eval<Horizon, Model> fg_eval;
+    fg_eval(afg, avars, ap);
+    fun_.Dependent(avars, afg);
+    fun_.optimize();
+
+    // The sparsity patterns only depend on the tape.
+    SetVector r(L::n_vars);
+    for (size_t j = 0; j < L::n_vars; j++) {
+      r[j].insert(j);
+    }
+    SetVector fg_pattern = fun_.ForSparseJac(L::n_vars, r);
+    SetVector s(1);
+    for (size_t i = 0; i < 1 + L::n_constraints; i++) {
+      s[0].insert(i);
+    }
+    hes_pattern_ = fun_.RevSparseHes(L::n_vars, s);
+
+    // Only the constraint rows of the Jacobian are handed to IPOPT.
+    jac_pattern_ = fg_pattern;
+    jac_pattern_[0].clear();
+    jac_row_.clear();
+    jac_col_.clear();
+    hes_row_.clear();
+    hes_col_.clear();
+    jac_work_.clear();
+    hes_work_.clear();
+    for (size_t i = 1; i < fg_pattern.size(); i++) {
+      for (std::set<size_t>::const_iterator it = fg_pattern[i].begin(); it != fg_pattern[i].end(); ++it) {
+        jac_row_.push_back(i);
+        jac_col_.push_back(*it);
+      }
+    }
+    // IPOPT takes the lower triangle of the Hessian of the Lagrangian.
+    for (size_t i = 0; i < L::n_vars; i++) {
+      for (std::set<size_t>::const_iterator it = hes_pattern_[i].begin(); it != hes_pattern_[i].end(); ++it) {
+        if (*it <= i) {
+          hes_row_.push_back(i);
+          hes_col_.push_back(*it);
+        }
+      }
+    }
+    jac_.resize(jac_row_.size());
+    hes_.resize(hes_row_.size());
+    w_.resize(1 + L::n_constraints);
+    xv_.resize(L::n_vars);
+  }
+
+  // Set up the problem for the next solve.
+  void update(const MPCState& state, const HorizonVector& ptsx, const HorizonVector& ptsy) {
+    double x = state.x;
+    double y = state.y;
+    double psi = state.psi;
+    double v = state.v;
+    size_t i;
+
+    for (i = 0; i < (size_t)Horizon; i++) {
+      ref_[i] = ptsx[i];
+      ref_[Horizon + i] = ptsy[i];
+    }
+    fun_.new_dynamic(ref_);
+
+    if (warm_) {
+      shift(x, y, psi, v);
+    }
+    else {
+      // Initial value of the independent variables.
+      // SHOULD BE 0 besides initial state.
+      for (i = 0; i < L::n_vars; i++) {
+        x0_[i] = 0;
+      }
+      x0_[L::x_start] = x;
+      x0_[L::y_start] = y;
+      x0_[L::psi_start] = psi;
+      x0_[L::v_start] = v;
+    }
+
+    // Lower and upper limits for variables.
+    for (i = 0; i < L::delta_start; i++) {
+      x_lower_[i] = -1.0e19;
+      x_upper_[i] = 1.0e19;
+    }
+    for (i = L::v_start; i < L::delta_start; i++) {
+      x_lower_[i] =  0;
+      x_upper_[i] =  0.3;
+    }
+    for (i = L::delta_start; i < L::a_start; i++) {
+      x_lower_[i] =  -Model::max_steer;
+      x_upper_[i] =  Model::max_steer;
+    }
+    // Acceleration/decceleration upper and lower limits.
+    for (i = L::a_start; i < L::n_vars; i++) {
+      x_lower_[i] = -1;
+      x_upper_[i] = 1;
+    }
+
+    // Lower and upper limits for the constraints
+    // Should be 0 besides initial state.
+    for (i = 0; i < L::n_constraints; i++) {
+      g_lower_[i] = 0;
+      g_upper_[i] = 0;
+    }
+    g_lower_[L::x_start] = g_upper_[L::x_start] = x;
+    g_lower_[L::y_start] = g_upper_[L::y_start] = y;
+    g_lower_[L::psi_start] = g_upper_[L::psi_start] = psi;
+    g_lower_[L::v_start] = g_upper_[L::v_start] = v;
+  }
+
+  const Dvector& solution() const { return solution_; }
+  Ipopt::SolverReturn status() const { return status_; }
+
+  // True if the next solve starts from the previous primal-dual solution.
+  bool warmStart() const { return warm_; }
+
+  // Forget the previous solution, e.g. when a new plan is received.
+  void reset() { warm_ = false; }
+
+  bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m, Ipopt::Index& nnz_jac_g,
+                    Ipopt::Index& nnz_h_lag, IndexStyleEnum& index_style) {
+    n = L::n_vars;
+    m = L::n_constraints;
+    nnz_jac_g = jac_row_.size();
+    nnz_h_lag = hes_row_.size();
+    index_style = C_STYLE;
+    return true;
+  }
+
+  bool get_bounds_info(Ipopt::Index n, Ipopt::Number* x_l, Ipopt::Number* x_u,
+                       Ipopt::Index m, Ipopt::Number* g_l, Ipopt::Number* g_u) {
+    for (Ipopt::Index i = 0; i < n; i++) {
+      x_l[i] = x_lower_[i];
+      x_u[i] = x_upper_[i];
+    }
+    for (Ipopt::Index i = 0; i < m; i++) {
+      g_l[i] = g_lower_[i];
+      g_u[i] = g_upper_[i];
+    }
+    return true;
+  }
+
+  bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number* x,
+                          bool init_z, Ipopt::Number* z_L, Ipopt::Number* z_U,
+                          Ipopt::Index m, bool init_lambda, Ipopt::Number* lambda) {
+    if ((init_z || init_lambda) && !warm_) {
+      return false;
+    }
+    for (Ipopt::Index i = 0; i < n; i++) {
+      x[i] = x0_[i];
+    }
+    if (init_z) {
+      for (Ipopt::Index i = 0; i < n; i++) {
+        z_L[i] = z_L_[i];
+        z_U[i] = z_U_[i];
+      }
+    }
+    if (init_lambda) {
+      for (Ipopt::Index i = 0; i < m; i++) {
+        lambda[i] = lambda_[i];
+      }
+    }
+    return true;
+  }
+
+  bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number& obj_value) {
+    forward(x);
+    obj_value = fg_[0];
+    return true;
+  }
+
+  bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number* grad_f) {
+    forward(x);
+    for (size_t i = 0; i < w_.size(); i++) {
+      w_[i] = 0;
+    }
+    w_[0] = 1;
+    Dvector grad = fun_.Reverse(1, w_);
+    for (Ipopt::Index j = 0; j < n; j++) {
+      grad_f[j] = grad[j];
+    }
+    return true;
+  }
+
+  bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Index m, Ipopt::Number* g) {
+    forward(x);
+    for (Ipopt::Index i = 0; i < m; i++) {
+      g[i] = fg_[1 + i];
+    }
+    return true;
+  }
+
+  bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Index m,
+                  Ipopt::Index nele_jac, Ipopt::Index* iRow, Ipopt::Index* jCol, Ipopt::Number* values) {
+    if (values == NULL) {
+      for (Ipopt::Index k = 0; k < nele_jac; k++) {
+        iRow[k] = jac_row_[k] - 1;
+        jCol[k] = jac_col_[k];
       }
-      else{
-        AD<double> x1 = vars[x_start + t];
-        AD<double> y1 = vars[y_start + t];
-        AD<double> psi1 = vars[psi_start + t];
-        AD<double> v1 = vars[v_start + t];
-        // AD<double> cte1 = vars[cte_start + t];
-        // AD<double> epsi1 = vars[epsi_start + t];
-        AD<double> x0 = vars[x_start + t - 1];
-        AD<double> y0 = vars[y_start + t - 1];
-        AD<double> psi0 = vars[psi_start + t - 1];
-        AD<double> v0 = vars[v_start + t - 1];
-        // AD<double> cte0 = vars[cte_start + t - 1];
-        // AD<double> epsi0 = vars[epsi_start + t - 1];
-        AD<double> delta0 = vars[delta_start + t - 1];
-        AD<double> a0 = vars[a_start + t - 1];
-        fg[1 + x_start + t] = x1 - (x0 + ref_v * CppAD::cos(psi0) * dt);
-        fg[1 + y_start + t] = y1 - (y0 + ref_v * CppAD::sin(psi0) * dt);
-        fg[1 + psi_start + t] = psi1 - (psi0 + ref_v * delta0 / Lf * dt);
-        // fg[1 + v_start + t] = v1 - (v0 + a0 * dt);
+      return true;
+    }
+    for (Ipopt::Index j = 0; j < n; j++) {
+      xv_[j] = x[j];
+    }
+    fun_.SparseJacobianForward(xv_, jac_pattern_, jac_row_, jac_col_, jac_, jac_work_);
+    for (Ipopt::Index k = 0; k < nele_jac; k++) {
+      values[k] = jac_[k];
+    }
+    return true;
+  }
+
+  bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number obj_factor,
+              Ipopt::Index m, const Ipopt::Number* lambda, bool new_lambda,
+              Ipopt::Index nele_hess, Ipopt::Index* iRow, Ipopt::Index* jCol, Ipopt::Number* values) {
+    if (values == NULL) {
+      for (Ipopt::Index k = 0; k < nele_hess; k++) {
+        iRow[k] = hes_row_[k];
+        jCol[k] = hes_col_[k];
       }
+      return true;
+    }
+    for (Ipopt::Index j = 0; j < n; j++) {
+      xv_[j] = x[j];
+    }
+    w_[0] = obj_factor;
+    for (Ipopt::Index i = 0; i < m; i++) {
+      w_[1 + i] = lambda[i];
+    }
+    fun_.SparseHessian(xv_, w_, hes_pattern_, hes_row_, hes_col_, hes_, hes_work_);
+    for (Ipopt::Index k = 0; k < nele_hess; k++) {
+      values[k] = hes_[k];
+    }
+    return true;
+  }
+
+  void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number* x,
+                         const Ipopt::Number* z_L, const Ipopt::Number* z_U, Ipopt::Index m,
+                         const Ipopt::Number* g, const Ipopt::Number* lambda, Ipopt::Number obj_value,
+                         const Ipopt::IpoptData* ip_data, Ipopt::IpoptCalculatedQuantities* ip_cq) {
+    status_ = status;
+    for (Ipopt::Index j = 0; j < n; j++) {
+      solution_[j] = x[j];
+      z_L_[j] = z_L[j];
+      z_U_[j] = z_U[j];
+    }
+    for (Ipopt::Index i = 0; i < m; i++) {
+      lambda_[i] = lambda[i];
+    }
+    // Only a converged solution is worth starting the next cycle from.
+    warm_ = status == Ipopt::SUCCESS || status == Ipopt::STOP_AT_ACCEPTABLE_POINT;
+  }
+
+ private:
+  // Build the starting point from the previous solution shifted by one
+  // step. The previous trajectory is expressed in the previous robot frame,
+  // so the shifted inputs are rolled out again from the new initial state,
+  // which keeps the initial guess dynamically feasible. The multipliers are
+  // shifted along with their stage.
+  void shift(double x, double y, double psi, double v) {
+    size_t t;
+    for (t = 0; t < (size_t)Horizon - 2; t++) {
+      x0_[L::delta_start + t] = solution_[L::delta_start + t + 1];
+      x0_[L::a_start + t] = solution_[L::a_start + t + 1];
+    }
+    x0_[L::delta_start + Horizon - 2] = solution_[L::delta_start + Horizon - 2];
+    x0_[L::a_start + Horizon - 2] = solution_[L::a_start + Horizon - 2];
+
+    x0_[L::x_start] = x;
+    x0_[L::y_start] = y;
+    x0_[L::psi_start] = psi;
+    x0_[L::v_start] = v;
+    for (t = 1; t < (size_t)Horizon; t++) {
+      x0_[L::x_start + t] = x0_[L::x_start + t - 1] + Model::ref_v * cos(x0_[L::psi_start + t - 1]) * Model::dt;
+      x0_[L::y_start + t] = x0_[L::y_start + t - 1] + Model::ref_v * sin(x0_[L::psi_start + t - 1]) * Model::dt;
+      x0_[L::psi_start + t] = x0_[L::psi_start + t - 1] + Model::ref_v * x0_[L::delta_start + t - 1] / Model::Lf * Model::dt;
+      x0_[L::v_start + t] = solution_[L::v_start + (t + 1 < (size_t)Horizon ? t + 1 : t)];
+    }
+
+    const size_t starts[] = {L::x_start, L::y_start, L::psi_start, L::v_start};
+    for (size_t k = 0; k < 4; k++) {
+      for (t = 1; t < (size_t)Horizon - 1; t++) {
+        lambda_[starts[k] + t] = lambda_[starts[k] + t + 1];
+        z_L_[starts[k] + t] = z_L_[starts[k] + t + 1];
+        z_U_[starts[k] + t] = z_U_[starts[k] + t + 1];
+      }
+    }
+    for (t = 0; t < (size_t)Horizon - 2; t++) {
+      z_L_[L::delta_start + t] = z_L_[L::delta_start + t + 1];
+      z_U_[L::delta_start + t] = z_U_[L::delta_start + t + 1];
+      z_L_[L::a_start + t] = z_L_[L::a_start + t + 1];
+      z_U_[L::a_start + t] = z_U_[L::a_start + t + 1];
+    }
+  }
+
+  // Zero order forward sweep at x. This is always recomputed since the
+  // sparse drivers overwrite the Taylor coefficients stored in the tape.
+  void forward(const Ipopt::Number* x) {
+    for (size_t j = 0; j < L::n_vars; j++) {
+      xv_[j] = x[j];
     }
+    fg_ = fun_.Forward(0, xv_);
   }
+
+  CppAD::ADFun<double> fun_;
+  SetVector jac_pattern_, hes_pattern_;
+  std::vector<size_t> jac_row_, jac_col_, hes_row_, hes_col_;
+  CppAD::sparse_jacobian_work jac_work_;
+  CppAD::sparse_hessian_work hes_work_;
+  Dvector jac_, hes_, w_, xv_, fg_;
+
+  Dvector x0_, ref_;
+  Dvector x_lower_, x_upper_, g_lower_, g_upper_;
+  Dvector solution_, z_L_, z_U_, lambda_;
+  Ipopt::SolverReturn status_;
+  bool warm_;
+};
+
+template <int Horizon, class Model>
+struct MPC<Horizon, Model>::IpoptContext {
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app;
+  Ipopt::SmartPtr<MPC_NLP<Horizon, Model> > nlp;
+  bool retape;
 };
 
 //
 // MPC class definition implementation.
 //
-MPC::MPC() {}
-MPC::~MPC() {}
-
-vector<double> MPC::Solve(std::vector<double> state, std::vector<double> ptsx, std::vector<double> ptsy) {
-  bool ok = true;
-  
-  size_t i;
-  typedef CPPAD_TESTVECTOR(double) Dvector;
-  double x = state[0];
-  double y = state[1];
-  double psi = state[2];
-  double v = state[3];
-  // Number of model variables (includes both states and inputs).
-  size_t n_vars = N * 4 + (N - 1) * 2;
-  // Number of constraints
-  size_t n_constraints = N * 4;
-  // Initial value of the independent variables.
-  // SHOULD BE 0 besides initial state.
-  Dvector vars(n_vars);
-  for (i = 0; i < n_vars; i++) {
-    vars[i] = 0;
-  }
-  // Set the initial variable values
-  vars[x_start] = x;
-  vars[y_start] = y;
-  vars[psi_start] = psi;
-  vars[v_start] = v;
-  Dvector vars_lowerbound(n_vars);
-  Dvector vars_upperbound(n_vars);
-  // Lower and upper limits for variables.
-  for (i = 0; i < delta_start; i++) {
-    vars_lowerbound[i] = -1.0e19;
-    vars_upperbound[i] = 1.0e19;
-  }
-
-  for (i = v_start; i < delta_start; i++) {
-    vars_lowerbound[i] =  0; 
-    vars_upperbound[i] =  0.3; 
-  }
-
-  for (i = delta_start; i < a_start; i++) {
-    vars_lowerbound[i] =  -0.5; 
-    vars_upperbound[i] =  0.5; 
-  }
-
-  // Acceleration/decceleration upper and lower limits.
-  for (i = a_start; i < n_vars; i++) {
-    vars_lowerbound[i] = -1;
-    vars_upperbound[i] = 1;
-  }
-  // Lower and upper limits for the constraints
-  // Should be 0 besides initial state.
-  Dvector constraints_lowerbound(n_constraints);
-  Dvector constraints_upperbound(n_constraints);
-  for (unsigned int i = 0; i < n_constraints; i++) {
-    constraints_lowerbound[i] = 0;
-    constraints_upperbound[i] = 0;
-  }
-  
-  constraints_lowerbound[x_start] = x;
-  constraints_lowerbound[y_start] = y;
-  constraints_lowerbound[psi_start] = psi;
-  constraints_lowerbound[v_start] = v;
-
-  constraints_upperbound[x_start] = x;
-  constraints_upperbound[y_start] = y;
-  constraints_upperbound[psi_start] = psi;
-  constraints_upperbound[v_start] = v;
-
-  
-  // object that computes objective and constraints
-  FG_eval fg_eval(ptsx, ptsy);
+template <int Horizon, class Model>
+MPC<Horizon, Model>::MPC():
+ipopt_(new IpoptContext)
+{
+  ipopt_->nlp = new MPC_NLP<Horizon, Model>();
+  ipopt_->retape = false;
+  ipopt_->app = IpoptApplicationFactory();
 
   // options for IPOPT solver
-  std::string options;
-  options += "Integer print_level  0\n";
-  // NOTE: Setting sparse to true allows the solver to take advantage
-  // of sparse routines, this makes the computation MUCH FASTER. If you
-  // can uncomment 1 of these and see if it makes a difference or not but
-  // if you uncomment both the computation time should go up in orders of
-  // magnitude.
-  options += "Sparse  true        forward\n";
-  options += "Sparse  true        reverse\n";
-  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
+  ipopt_->app->Options()->SetIntegerValue("print_level", 0);
+  ipopt_->app->Options()->SetStringValue("sb", "yes");
+  // NOTE: Currently the solver has a maximum time limit of 0.2 seconds.
   // Change this as you see fit.
-  options += "Numeric max_cpu_time          0.2\n";
+  ipopt_->app->Options()->SetNumericValue("max_cpu_time", 0.2);
+  // When warm started the previous solution is already close to the
+  // optimum, so do not push it far away from the bounds.
+  ipopt_->app->Options()->SetNumericValue("warm_start_bound_push", 1e-6);
+  ipopt_->app->Options()->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+  ipopt_->app->Initialize();
+}
+
+template <int Horizon, class Model>
+MPC<Horizon, Model>::~MPC() {}
+
+template <int Horizon, class Model>
+void MPC<Horizon, Model>::Reset() {
+  ipopt_->nlp->reset();
+}
+
+template <int Horizon, class Model>
+bool MPC<Horizon, Model>::SetOption(const std::string& name, const std::string& value) {
+  if (name == "retape") {
+    if (value != "yes" && value != "no") {
+      return false;
+    }
+    ipopt_->retape = value == "yes";
+    return true;
+  }
+  Ipopt::SmartPtr<const Ipopt::RegisteredOption> option = ipopt_->app->RegOptions()->GetOption(name);
+  if (!Ipopt::IsValid(option)) {
+    return false;
+  }
+  const char* begin = value.c_str();
+  char* end = NULL;
+  switch (option->Type()) {
+    case Ipopt::OT_Number: {
+      double number = std::strtod(begin, &end);
+      return *begin != 0 && *end == 0 && ipopt_->app->Options()->SetNumericValue(name, number);
+    }
+    case Ipopt::OT_Integer: {
+      long integer = std::strtol(begin, &end, 10);
+      return *begin != 0 && *end == 0 && ipopt_->app->Options()->SetIntegerValue(name, (Ipopt::Index)integer);
+    }
+    case Ipopt::OT_String:
+      return ipopt_->app->Options()->SetStringValue(name, value);
+    default:
+      return false;
+  }
+}
+
+template <int Horizon, class Model>
+bool MPC<Horizon, Model>::Solve(const MPCState& state, const HorizonVector& ptsx, const HorizonVector& ptsy, MPCSolution& solution) {
+  typedef MPCLayout<Horizon> L;
+  typedef CPPAD_TESTVECTOR(double) Dvector;
 
-  // place to return solution
-  CppAD::ipopt::solve_result<Dvector> solution;
+  auto start_time = std::chrono::steady_clock::now();
+  MPC_NLP<Horizon, Model>& nlp = *Ipopt::GetRawPtr(ipopt_->nlp);
+  if (ipopt_->retape) {
+    nlp.record();
+  }
+  nlp.update(state, ptsx, ptsy);
+  ipopt_->app->Options()->SetStringValue("warm_start_init_point", nlp.warmStart() ? "yes" : "no");
+  ipopt_->app->Options()->SetNumericValue("mu_init", nlp.warmStart() ? 1e-4 : 0.1);
 
   // solve the problem
-  CppAD::ipopt::solve<Dvector, FG_eval>(
-      options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
-      constraints_upperbound, fg_eval, solution);
+  ipopt_->app->OptimizeTNLP(ipopt_->nlp);
+  Ipopt::SmartPtr<Ipopt::SolveStatistics> stats = ipopt_->app->Statistics();
+  iterations_ = Ipopt::IsValid(stats) ? stats->IterationCount() : 0;
 
   // Check some of the solution values
-  ok &= solution.status == CppAD::ipopt::solve_result<Dvector>::success;
-
-  // Cost
-  auto cost = solution.obj_value;
-  // std::cout << "Cost " << cost << std::endl;
- 
-  vector<double> result;
-  result.push_back(solution.x[delta_start]);
-  result.push_back(solution.x[a_start]);
-  // result.push_back(solution.x[v_start]);
-
-  for(i=0; i< N-1; i++){
-    result.push_back(solution.x[x_start + i + 1]);
-    result.push_back(solution.x[y_start + i + 1]);
-  }
-  
-  return result;
+  solution.ok = nlp.status() == Ipopt::SUCCESS;
+  converged_ = solution.ok;
+
+  const Dvector& x = nlp.solution();
+  solution.steering = x[L::delta_start];
+  solution.throttle = x[L::a_start];
+  solution.x.resize(Horizon - 1);
+  solution.y.resize(Horizon - 1);
+  for (int i = 0; i < Horizon - 1; i++) {
+    solution.x[i] = x[L::x_start + i + 1];
+    solution.y[i] = x[L::y_start + i + 1];
+  }
+  solve_time_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  return solution.ok;
+}
+
+template class MPC<10>;
+template class MPC<20>;
+template class MPC<40>;
+template class MPC<60>;
+
+MPCSolver* createMPCSolver(const std::string& backend, int horizon) {
+  if (backend == "ipopt") {
+    switch (horizon) {
+      case 10: return new MPC<10>();
+      case 20: return new MPC<20>();
+      case 40: return new MPC<40>();
+      case 60: return new MPC<60>();
+    }
+  }
+  if (backend == "rti") {
+    switch (horizon) {
+      case 10: return new RTIMPC<10>();
+      case 20: return new RTIMPC<20>();
+      case 40: return new RTIMPC<40>();
+      case 60: return new RTIMPC<60>();
+    }
+  }
+  return NULL;
 }
@@ -0,0 +1,69 @@
+#include "PurePursuit.h"
+#include <algorithm>
+
+namespace mpnet_local_planner{
+
+	static double pi_2_pi(double angle)
+	{
+		angle = std::fmod(angle + M_PI, 2 * M_PI);
+		if (angle < 0)
+			angle += 2 * M_PI;
+		return angle - M_PI;
+	}
+
+	PurePursuit::PurePursuit(double speed, double wheelbase, double max_steering, double gain, double look_ahead):
+	speed_(speed),
+	wheelbase_(wheelbase),
+	max_steering_(max_steering),
+	gain_(gain),
+	look_ahead_(look_ahead),
+	start_(0)
+	{}
+
+	void PurePursuit::setPath(const std::vector<double>& path_x, const std::vector<double>& path_y, const std::vector<double>& path_th)
+	{
+		path_x_ = path_x;
+		path_y_ = path_y;
+		path_th_ = path_th;
+		start_ = 0;
+	}
+
+	void PurePursuit::prunePath(double x, double y)
+	{
+		size_t remaining = path_x_.size() - start_;
+		if (remaining <= 1)
+			return;
+		// Jump to the last point within the look ahead distance, if there is
+		// none move on by a single point.
+		bool found = false;
+		size_t last = start_;
+		for (size_t i = start_; i < path_x_.size(); i++)
+		{
+			if (std::hypot(x - path_x_[i], y - path_y_[i]) <= look_ahead_)
+			{
+				last = i;
+				found = true;
+			}
+		}
+		start_ = found ? last : start_ + 1;
+	}
+
+	bool PurePursuit::control(double x, double y, double th, double& steering, double& speed)
+	{
+		steering = 0;
+		speed = 0;
+		if (start_ >= path_x_.size())
+			return false;
+		if (std::hypot(x - path_x_.back(), y - path_y_.back()) < 0.1)
+			return false;
+
+		prunePath(x, y);
+		double angle = pi_2_pi(path_th_[start_] - th);
+		steering = std::atan2(2 * wheelbase_ * std::sin(angle / 2), speed_) + gain_ * angle;
+		if (std::fabs(steering) < 1e-8)
+			steering = 0.0;
+		steering = std::min(max_steering_, std::max(-max_steering_, steering));
+		speed = speed_;
+		return true;
+	}
+}
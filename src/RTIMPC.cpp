@@ -0,0 +1,217 @@
+#include "RTIMPC.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+// Weights of the cost in FG_eval.
+const double w_track = 500;
+const double w_steer_rate = 50;
+
+template <int Horizon, class Model>
+RTIMPC<Horizon, Model>::RTIMPC(int max_qp_iterations):
+max_qp_iterations_(max_qp_iterations),
+warm_(false)
+{
+  u_.setZero();
+  u_bar_.setZero();
+  Gx_.setZero();
+  Gy_.setZero();
+  step_.setZero();
+  active_.setConstant(false);
+}
+
+template <int Horizon, class Model>
+RTIMPC<Horizon, Model>::~RTIMPC() {}
+
+template <int Horizon, class Model>
+void RTIMPC<Horizon, Model>::Reset() {
+  warm_ = false;
+}
+
+template <int Horizon, class Model>
+bool RTIMPC<Horizon, Model>::SetOption(const std::string& name, const std::string& value) {
+  if (name != "max_qp_iterations") {
+    return false;
+  }
+  const char* begin = value.c_str();
+  char* end = NULL;
+  long iterations = std::strtol(begin, &end, 10);
+  if (*begin == 0 || *end != 0 || iterations < 1) {
+    return false;
+  }
+  max_qp_iterations_ = (int)iterations;
+  return true;
+}
+
+template <int Horizon, class Model>
+void RTIMPC<Horizon, Model>::rollout(double x, double y, double psi, const InputVector& u) {
+  xs_[0] = x;
+  ys_[0] = y;
+  psis_[0] = psi;
+  for (int t = 1; t < Horizon; t++) {
+    xs_[t] = xs_[t - 1] + Model::ref_v * cos(psis_[t - 1]) * Model::dt;
+    ys_[t] = ys_[t - 1] + Model::ref_v * sin(psis_[t - 1]) * Model::dt;
+    psis_[t] = psis_[t - 1] + Model::ref_v * u[t - 1] / Model::Lf * Model::dt;
+  }
+}
+
+template <int Horizon, class Model>
+bool RTIMPC<Horizon, Model>::solveBoxQP(InputVector& u, int& iterations) {
+  const double max_steer = Model::max_steer;
+  // Scale of the gradient below which a multiplier counts as zero
+  const double tolerance = 1e-9 * (1 + f_.template lpNorm<Eigen::Infinity>());
+  iterations = 0;
+  while (iterations < max_qp_iterations_) {
+    iterations++;
+
+    // Minimize over the free inputs with the working set held on its
+    // bounds. The held inputs are kept in the system as identity rows so
+    // the factorization always has the same size.
+    K_ = H_;
+    for (int i = 0; i < M; i++) {
+      if (active_[i]) {
+        K_.row(i).setZero();
+        K_.col(i).setZero();
+        K_(i, i) = 1;
+      }
+    }
+    for (int i = 0; i < M; i++) {
+      if (active_[i]) {
+        rhs_[i] = u[i];
+      }
+      else {
+        double r = -f_[i];
+        for (int j = 0; j < M; j++) {
+          if (active_[j]) {
+            r -= H_(i, j) * u[j];
+          }
+        }
+        rhs_[i] = r;
+      }
+    }
+    llt_.compute(K_);
+    step_ = llt_.solve(rhs_) - u;
+
+    // Move towards it until the first free input reaches a bound, which
+    // joins the working set.
+    double alpha = 1;
+    int blocking = -1;
+    for (int i = 0; i < M; i++) {
+      if (active_[i] || step_[i] == 0) {
+        continue;
+      }
+      double bound = step_[i] > 0 ? max_steer : -max_steer;
+      double reach = (bound - u[i]) / step_[i];
+      if (reach < alpha) {
+        alpha = std::max(0.0, reach);
+        blocking = i;
+      }
+    }
+    u += alpha * step_;
+    if (blocking >= 0) {
+      u[blocking] = step_[blocking] > 0 ? max_steer : -max_steer;
+      active_[blocking] = true;
+      continue;
+    }
+
+    // At the minimizer on the working set. The multiplier of a held input
+    // is the gradient pointing out of the box, the point is optimal if none
+    // is negative, else the most negative one is released.
+    rhs_.noalias() = H_ * u + f_;
+    int release = -1;
+    double lowest = -tolerance;
+    for (int i = 0; i < M; i++) {
+      if (!active_[i]) {
+        continue;
+      }
+      double multiplier = u[i] > 0 ? -rhs_[i] : rhs_[i];
+      if (multiplier < lowest) {
+        lowest = multiplier;
+        release = i;
+      }
+    }
+    if (release < 0) {
+      return true;
+    }
+    active_[release] = false;
+  }
+  return false;
+}
+
+template <int Horizon, class Model>
+bool RTIMPC<Horizon, Model>::Solve(const MPCState& state, const HorizonVector& ptsx, const HorizonVector& ptsy, MPCSolution& solution) {
+  auto start_time = std::chrono::steady_clock::now();
+  const double max_steer = Model::max_steer;
+  const double c = Model::ref_v * Model::dt / Model::Lf;
+
+  // Linearization point, the previous inputs shifted by one step.
+  if (warm_) {
+    u_bar_.template head<M - 1>() = u_.template tail<M - 1>();
+    u_bar_[M - 1] = u_[M - 1];
+  }
+  else {
+    u_bar_.setZero();
+  }
+  rollout(state.x, state.y, state.psi, u_bar_);
+
+  // Sensitivities of the positions w.r.t. the inputs. Input j only reaches
+  // the positions through the heading from step j + 1 on.
+  Gx_.row(0).setZero();
+  Gy_.row(0).setZero();
+  for (int t = 0; t < Horizon - 1; t++) {
+    Gx_.row(t + 1) = Gx_.row(t);
+    Gy_.row(t + 1) = Gy_.row(t);
+    double sx = -Model::ref_v * Model::dt * sin(psis_[t]) * c;
+    double sy = Model::ref_v * Model::dt * cos(psis_[t]) * c;
+    for (int j = 0; j < t; j++) {
+      Gx_(t + 1, j) += sx;
+      Gy_(t + 1, j) += sy;
+    }
+  }
+  for (int t = 0; t < Horizon; t++) {
+    ex_[t] = xs_[t] - ptsx[t];
+    ey_[t] = ys_[t] - ptsy[t];
+  }
+
+  // Condensed Gauss-Newton QP over the inputs.
+  H_.noalias() = 2 * w_track * (Gx_.transpose() * Gx_);
+  H_.noalias() += 2 * w_track * (Gy_.transpose() * Gy_);
+  f_.noalias() = 2 * w_track * (Gx_.transpose() * ex_);
+  f_.noalias() += 2 * w_track * (Gy_.transpose() * ey_);
+  f_.noalias() -= H_ * u_bar_;
+  // Steering rate penalty, D'D is tridiagonal.
+  for (int t = 0; t < M - 1; t++) {
+    H_(t, t) += 2 * w_steer_rate;
+    H_(t + 1, t + 1) += 2 * w_steer_rate;
+    H_(t, t + 1) -= 2 * w_steer_rate;
+    H_(t + 1, t) -= 2 * w_steer_rate;
+  }
+  // The last input only moves the state after the horizon.
+  H_.diagonal().array() += 1e-6;
+
+  // Start from the linearization point, the inputs it has on a bound form
+  // the initial working set.
+  u_ = u_bar_;
+  for (int i = 0; i < M; i++) {
+    u_[i] = std::min(max_steer, std::max(-max_steer, u_[i]));
+    active_[i] = std::fabs(u_[i]) >= max_steer;
+  }
+  converged_ = solveBoxQP(u_, iterations_);
+  warm_ = true;
+
+  rollout(state.x, state.y, state.psi, u_);
+
+  solution.steering = u_[0];
+  // The model runs at the constant reference speed.
+  solution.throttle = 0;
+  solution.x = xs_.template tail<Horizon - 1>();
+  solution.y = ys_.template tail<Horizon - 1>();
+  solution.ok = true;
+  solve_time_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  return true;
+}
+
+template class RTIMPC<10>;
+template class RTIMPC<20>;
+template class RTIMPC<40>;
+template class RTIMPC<60>;
@@ -0,0 +1,110 @@
+#include <collision_grid.h>
+#include <costmap_2d/cost_values.h>
+#include <tf2/utils.h>
+#include <angles/angles.h>
+
+namespace mpnet_local_planner{
+
+    CollisionGrid::CollisionGrid(tf2_ros::Buffer* tf, const std::string& frame, double size, double resolution, const std::string& map_topic):
+    tf_(tf),
+    frame_(frame),
+    size_(size),
+    map_changed_(false),
+    grid_((unsigned int)std::ceil(size / resolution), (unsigned int)std::ceil(size / resolution), resolution, 0.0, 0.0, costmap_2d::NO_INFORMATION),
+    ready_(false),
+    center_x_(0),
+    center_y_(0),
+    map_x_(0),
+    map_y_(0),
+    map_yaw_(0)
+    {
+        ros::NodeHandle n;
+        map_sub_ = n.subscribe(map_topic, 1, &CollisionGrid::mapCallback, this);
+    }
+
+    void CollisionGrid::mapCallback(const nav_msgs::OccupancyGrid::ConstPtr& map)
+    {
+        boost::mutex::scoped_lock lock(map_mutex_);
+        map_ = map;
+        map_changed_ = true;
+    }
+
+    bool CollisionGrid::update(double x, double y)
+    {
+        nav_msgs::OccupancyGrid::ConstPtr map;
+        bool changed;
+        {
+            boost::mutex::scoped_lock lock(map_mutex_);
+            map = map_;
+            changed = map_changed_;
+            map_changed_ = false;
+        }
+        if (!map)
+            return ready_;
+
+        // Where the map sits in the planner frame, without waiting for tf
+        double map_x = 0, map_y = 0, map_yaw = 0;
+        if (!map->header.frame_id.empty() && map->header.frame_id != frame_)
+        {
+            if (!tf_->canTransform(frame_, map->header.frame_id, ros::Time(0)))
+                return ready_;
+            geometry_msgs::TransformStamped frame_to_map = tf_->lookupTransform(frame_, map->header.frame_id, ros::Time(0));
+            map_x = frame_to_map.transform.translation.x;
+            map_y = frame_to_map.transform.translation.y;
+            map_yaw = tf2::getYaw(frame_to_map.transform.rotation);
+        }
+
+        double resolution = grid_.getResolution();
+        bool moved = !ready_ || changed
+            || std::hypot(x - center_x_, y - center_y_) > size_ / 4
+            || std::hypot(map_x - map_x_, map_y - map_y_) > resolution
+            || std::fabs(angles::shortest_angular_distance(map_yaw, map_yaw_)) > 0.01;
+        if (moved)
+        {
+            center_x_ = x;
+            center_y_ = y;
+            map_x_ = map_x;
+            map_y_ = map_y;
+            map_yaw_ = map_yaw;
+            grid_.updateOrigin(x - grid_.getSizeInMetersX() / 2, y - grid_.getSizeInMetersY() / 2);
+            fill(*map);
+            ready_ = true;
+        }
+        return ready_;
+    }
+
+    void CollisionGrid::fill(const nav_msgs::OccupancyGrid& map)
+    {
+        // Cells above the map_server occupied threshold are obstacles
+        const int occupied = 65;
+        double c = std::cos(map_yaw_), s = std::sin(map_yaw_);
+        double map_origin_x = map.info.origin.position.x;
+        double map_origin_y = map.info.origin.position.y;
+        double map_resolution = map.info.resolution;
+        unsigned char* data = grid_.getCharMap();
+        for (unsigned int j = 0; j < grid_.getSizeInCellsY(); j++)
+        {
+            for (unsigned int i = 0; i < grid_.getSizeInCellsX(); i++)
+            {
+                double wx, wy;
+                grid_.mapToWorld(i, j, wx, wy);
+                // Cell center in the map frame
+                double dx = wx - map_x_, dy = wy - map_y_;
+                double mx = c * dx + s * dy;
+                double my = -s * dx + c * dy;
+                int ci = (int)std::floor((mx - map_origin_x) / map_resolution);
+                int cj = (int)std::floor((my - map_origin_y) / map_resolution);
+                unsigned char cost = costmap_2d::NO_INFORMATION;
+                if (ci >= 0 && cj >= 0 && ci < (int)map.info.width && cj < (int)map.info.height)
+                {
+                    int value = map.data[cj * map.info.width + ci];
+                    if (value >= occupied)
+                        cost = costmap_2d::LETHAL_OBSTACLE;
+                    else if (value >= 0)
+                        cost = costmap_2d::FREE_SPACE;
+                }
+                data[grid_.getIndex(i, j)] = cost;
+            }
+        }
+    }
+}
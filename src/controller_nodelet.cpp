@@ -0,0 +1,26 @@
+#include <ControllerRunner.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+namespace mpnet_local_planner{
+
+	/**
+	 * @class ControllerNodelet
+	 * @brief The controller as a nodelet, to share a process with other
+	 * nodelets. The local plan comes from the move_base plugin over the
+	 * network as for controller_node, run_controller of MpnetLocalPlanner
+	 * is what avoids serializing it.
+	 */
+	class ControllerNodelet : public nodelet::Nodelet
+	{
+	private:
+		virtual void onInit()
+		{
+			runner_.reset(new ControllerRunner(getNodeHandle(), getPrivateNodeHandle()));
+		}
+
+		boost::scoped_ptr<ControllerRunner> runner_;
+	};
+}
+
+PLUGINLIB_EXPORT_CLASS(mpnet_local_planner::ControllerNodelet, nodelet::Nodelet)
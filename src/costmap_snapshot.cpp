@@ -0,0 +1,50 @@
+#include <costmap_snapshot.h>
+#include <cstring>
+
+namespace mpnet_local_planner{
+
+    CostmapSnapshot::CostmapSnapshot():
+    version_(0)
+    {
+    }
+
+    void CostmapSnapshot::copyFrom(const costmap_2d::Costmap2D& costmap, uint64_t version)
+    {
+        unsigned int size_x = costmap.getSizeInCellsX();
+        unsigned int size_y = costmap.getSizeInCellsY();
+        // Only reallocate when the costmap is resized, otherwise the cells
+        // are copied over the previous snapshot
+        if (size_x != size_x_ || size_y != size_y_ || costmap_ == NULL)
+            resizeMap(size_x, size_y, costmap.getResolution(), costmap.getOriginX(), costmap.getOriginY());
+        else
+        {
+            resolution_ = costmap.getResolution();
+            origin_x_ = costmap.getOriginX();
+            origin_y_ = costmap.getOriginY();
+        }
+        std::memcpy(costmap_, costmap.getCharMap(), size_x * size_y * sizeof(unsigned char));
+        version_ = version;
+        stamp_ = ros::Time::now();
+    }
+
+    CostmapSnapshots::CostmapSnapshots(costmap_2d::Costmap2D* costmap):
+    costmap_(costmap),
+    next_(0),
+    version_(0)
+    {
+    }
+
+    CostmapSnapshotConstPtr CostmapSnapshots::take()
+    {
+        boost::shared_ptr<CostmapSnapshot>& buffer = buffers_[next_];
+        // A buffer still held by a reader is left to it
+        if (!buffer || !buffer.unique())
+            buffer.reset(new CostmapSnapshot());
+        {
+            boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*(costmap_->getMutex()));
+            buffer->copyFrom(*costmap_, ++version_);
+        }
+        next_ = 1 - next_;
+        return buffer;
+    }
+}
@@ -0,0 +1,201 @@
+#include <costmap_view.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace mpnet_local_planner{
+
+    namespace{
+        double pointCost(const CostmapView& costmap, unsigned int x, unsigned int y)
+        {
+            unsigned char cost = costmap.getCost(x, y);
+            if (cost == NO_INFORMATION)
+                return -2;
+            if (cost == LETHAL_OBSTACLE)
+                return -1;
+            return cost;
+        }
+
+        /**
+         * @brief The largest cost along a line, rasterized as base_local_planner::LineIterator
+         */
+        double lineCost(const CostmapView& costmap, int x0, int x1, int y0, int y1)
+        {
+            double line_cost = 0.0;
+            int deltax = std::abs(x1 - x0);
+            int deltay = std::abs(y1 - y0);
+            int xinc1 = x1 >= x0 ? 1 : -1, xinc2 = xinc1;
+            int yinc1 = y1 >= y0 ? 1 : -1, yinc2 = yinc1;
+            int den, num, numadd, numpixels;
+            if (deltax >= deltay)
+            {
+                // At least one x value for every y value
+                xinc1 = 0;
+                yinc2 = 0;
+                den = deltax;
+                num = deltax / 2;
+                numadd = deltay;
+                numpixels = deltax;
+            }
+            else
+            {
+                xinc2 = 0;
+                yinc1 = 0;
+                den = deltay;
+                num = deltay / 2;
+                numadd = deltax;
+                numpixels = deltay;
+            }
+            int x = x0, y = y0;
+            for (int pixel = 0; pixel <= numpixels; pixel++)
+            {
+                double point_cost = pointCost(costmap, x, y);
+                if (point_cost < 0)
+                    return point_cost;
+                line_cost = std::max(line_cost, point_cost);
+                num += numadd;
+                if (num >= den)
+                {
+                    num -= den;
+                    x += xinc1;
+                    y += yinc1;
+                }
+                x += xinc2;
+                y += yinc2;
+            }
+            return line_cost;
+        }
+
+        /**
+         * @brief The area of a polygon clipped to the unit cell at (x, y),
+         * with Sutherland-Hodgman, which takes any simple polygon as long as
+         * the clip window is convex
+         */
+        double clippedArea(const std::vector<Point2D>& polygon, int x, int y, std::vector<Point2D>& a, std::vector<Point2D>& b)
+        {
+            a = polygon;
+            // The four sides of the cell as the half planes s * p[axis] >= bound
+            const int axes[] = {0, 0, 1, 1};
+            const double sides[] = {1, -1, 1, -1};
+            const double bounds[] = {(double)x, -(double)(x + 1), (double)y, -(double)(y + 1)};
+            for (int k = 0; k < 4 && !a.empty(); k++)
+            {
+                b.clear();
+                for (size_t i = 0; i < a.size(); i++)
+                {
+                    const Point2D& p = a[i];
+                    const Point2D& q = a[(i + 1) % a.size()];
+                    double dp = sides[k] * (axes[k] == 0 ? p.x : p.y) - bounds[k];
+                    double dq = sides[k] * (axes[k] == 0 ? q.x : q.y) - bounds[k];
+                    if (dp >= 0)
+                        b.push_back(p);
+                    if ((dp >= 0) != (dq >= 0))
+                    {
+                        double t = dp / (dp - dq);
+                        b.push_back(Point2D(p.x + t * (q.x - p.x), p.y + t * (q.y - p.y)));
+                    }
+                }
+                a.swap(b);
+            }
+            double area = 0;
+            for (size_t i = 0; i < a.size(); i++)
+            {
+                const Point2D& p = a[i];
+                const Point2D& q = a[(i + 1) % a.size()];
+                area += p.x * q.y - q.x * p.y;
+            }
+            return std::fabs(area) / 2;
+        }
+    }
+
+    double footprintCost(const CostmapView& costmap, const SE2Pose& pose, const std::vector<Point2D>& footprint)
+    {
+        unsigned int cell_x, cell_y;
+        if (!costmap.worldToMap(pose.x, pose.y, cell_x, cell_y))
+            return -3.0;
+
+        // A circular robot, only the center
+        if (footprint.size() < 3)
+        {
+            unsigned char cost = costmap.getCost(cell_x, cell_y);
+            if (cost == LETHAL_OBSTACLE || cost == INSCRIBED_INFLATED_OBSTACLE || cost == NO_INFORMATION)
+                return -1.0;
+            return cost;
+        }
+
+        // Lay the outline down edge by edge, in the order of CostmapModel, so
+        // an obstacle on an earlier edge wins over a later vertex off the map
+        double c = std::cos(pose.yaw), s = std::sin(pose.yaw);
+        size_t n = footprint.size();
+        unsigned int first_x, first_y, x0, y0, x1, y1;
+        if (!costmap.worldToMap(pose.x + footprint[0].x * c - footprint[0].y * s,
+                                pose.y + footprint[0].x * s + footprint[0].y * c, first_x, first_y))
+            return -3.0;
+        x0 = first_x;
+        y0 = first_y;
+        double footprint_cost = 0.0;
+        for (size_t i = 1; i <= n; i++)
+        {
+            if (i == n)
+            {
+                x1 = first_x;
+                y1 = first_y;
+            }
+            else if (!costmap.worldToMap(pose.x + footprint[i].x * c - footprint[i].y * s,
+                                         pose.y + footprint[i].x * s + footprint[i].y * c, x1, y1))
+                return -3.0;
+            double line_cost = lineCost(costmap, x0, x1, y0, y1);
+            if (line_cost < 0)
+                return line_cost;
+            footprint_cost = std::max(line_cost, footprint_cost);
+            x0 = x1;
+            y0 = y1;
+        }
+        return footprint_cost;
+    }
+
+    double footprintCostExact(const CostmapView& costmap, const SE2Pose& pose, const std::vector<Point2D>& footprint)
+    {
+        if (footprint.size() < 3)
+            return footprintCost(costmap, pose, footprint);
+
+        // The footprint in cell units, where the cell (i, j) is [i, i + 1] x [j, j + 1]
+        double c = std::cos(pose.yaw), s = std::sin(pose.yaw);
+        std::vector<Point2D> polygon(footprint.size());
+        double min_x = costmap.size_x, min_y = costmap.size_y, max_x = 0, max_y = 0;
+        for (size_t i = 0; i < footprint.size(); i++)
+        {
+            Point2D& p = polygon[i];
+            p.x = (pose.x + footprint[i].x * c - footprint[i].y * s - costmap.origin_x) / costmap.resolution;
+            p.y = (pose.y + footprint[i].x * s + footprint[i].y * c - costmap.origin_y) / costmap.resolution;
+            // The polygon is on the map if all its vertices are
+            if (p.x < 0 || p.y < 0 || p.x >= costmap.size_x || p.y >= costmap.size_y)
+                return -3.0;
+            min_x = std::min(min_x, p.x);
+            min_y = std::min(min_y, p.y);
+            max_x = std::max(max_x, p.x);
+            max_y = std::max(max_y, p.y);
+        }
+
+        double footprint_cost = 0.0;
+        bool unknown = false;
+        std::vector<Point2D> a, b;
+        for (int y = (int)min_y; y <= (int)max_y; y++)
+        {
+            for (int x = (int)min_x; x <= (int)max_x; x++)
+            {
+                // Cells the outline only touches do not overlap it
+                if (clippedArea(polygon, x, y, a, b) <= 1e-12)
+                    continue;
+                double point_cost = pointCost(costmap, x, y);
+                if (point_cost == -1)
+                    return -1.0;
+                if (point_cost == -2)
+                    unknown = true;
+                else
+                    footprint_cost = std::max(footprint_cost, point_cost);
+            }
+        }
+        return unknown ? -2.0 : footprint_cost;
+    }
+}
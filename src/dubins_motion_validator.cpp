@@ -0,0 +1,100 @@
+#include <dubins_motion_validator.h>
+#include <algorithm>
+#include <cmath>
+
+namespace ob = ompl::base;
+
+namespace mpnet_local_planner{
+
+    DubinsMotionValidator::DubinsMotionValidator(ob::SpaceInformation* si, double turning_radius, double step):
+    ob::MotionValidator(si),
+    space_(si->getStateSpace()->as<ob::DubinsStateSpace>()),
+    turning_radius_(turning_radius),
+    step_(step)
+    {
+    }
+
+    double DubinsMotionValidator::stepFor(double resolution, const std::vector<Point2D>& footprint, double turning_radius)
+    {
+        // Along an arc a point at distance r from the center of the robot
+        // moves (1 + r/turning_radius) times the arc length
+        double radius = 0;
+        for (size_t i = 0; i < footprint.size(); i++)
+            radius = std::max(radius, std::hypot(footprint[i].x, footprint[i].y));
+        return resolution / (1 + radius / turning_radius);
+    }
+
+    ob::DubinsStateSpace::DubinsPath DubinsMotionValidator::solve(const ob::State* s1, const ob::State* s2) const
+    {
+        ob::DubinsStateSpace::DubinsPath path = space_->dubins(s1, s2);
+        if (space_->hasSymmetricInterpolate())
+        {
+            ob::DubinsStateSpace::DubinsPath reverse = space_->dubins(s2, s1);
+            if (reverse.length() < path.length())
+            {
+                reverse.reverse_ = true;
+                path = reverse;
+            }
+        }
+        return path;
+    }
+
+    int DubinsMotionValidator::steps(const ob::DubinsStateSpace::DubinsPath& path) const
+    {
+        return std::max(1, (int)std::ceil(turning_radius_ * path.length() / step_));
+    }
+
+    bool DubinsMotionValidator::checkMotion(const ob::State* s1, const ob::State* s2) const
+    {
+        // The end first, it is the state most likely in collision
+        if (!si_->isValid(s2))
+        {
+            invalid_++;
+            return false;
+        }
+
+        ob::DubinsStateSpace::DubinsPath path = solve(s1, s2);
+        int n = steps(path);
+        bool first_time = false, valid = true;
+        ob::State* state = si_->allocState();
+        for (int i = 1; i < n && valid; i++)
+        {
+            space_->interpolate(s1, s2, (double)i / n, first_time, path, state);
+            valid = si_->isValid(state);
+        }
+        si_->freeState(state);
+
+        if (valid)
+            valid_++;
+        else
+            invalid_++;
+        return valid;
+    }
+
+    bool DubinsMotionValidator::checkMotion(const ob::State* s1, const ob::State* s2, std::pair<ob::State*, double>& last_valid) const
+    {
+        ob::DubinsStateSpace::DubinsPath path = solve(s1, s2);
+        int n = steps(path);
+        bool first_time = false;
+        ob::State* state = si_->allocState();
+        for (int i = 1; i <= n; i++)
+        {
+            if (i < n)
+                space_->interpolate(s1, s2, (double)i / n, first_time, path, state);
+            else
+                si_->copyState(state, s2);
+            if (si_->isValid(state))
+                continue;
+
+            last_valid.second = (double)(i - 1) / n;
+            if (last_valid.first != NULL)
+                space_->interpolate(s1, s2, last_valid.second, first_time, path, last_valid.first);
+            si_->freeState(state);
+            invalid_++;
+            return false;
+        }
+        si_->freeState(state);
+        valid_++;
+        return true;
+    }
+}
@@ -0,0 +1,131 @@
+#include <global_plan_tracker.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+#include <ros/console.h>
+
+namespace mpnet_local_planner{
+
+    GlobalPlanTracker::GlobalPlanTracker():
+    generation_(1),
+    progress_(0),
+    have_transform_(false)
+    {
+    }
+
+    void GlobalPlanTracker::setPlan(const std::vector<geometry_msgs::PoseStamped>& plan)
+    {
+        plan_ = plan;
+        transformed_.resize(plan_.size());
+        cached_.assign(plan_.size(), 0);
+        generation_ = 1;
+        progress_ = 0;
+        have_transform_ = false;
+    }
+
+    void GlobalPlanTracker::clear()
+    {
+        setPlan(std::vector<geometry_msgs::PoseStamped>());
+    }
+
+    const geometry_msgs::PoseStamped& GlobalPlanTracker::transformed(size_t i)
+    {
+        if (cached_[i] != generation_)
+        {
+            tf2::doTransform(plan_[i], transformed_[i], plan_to_global_);
+            cached_[i] = generation_;
+        }
+        return transformed_[i];
+    }
+
+    bool GlobalPlanTracker::update(const tf2_ros::Buffer& tf, const geometry_msgs::PoseStamped& robot_pose, const costmap_2d::Costmap2D& costmap,
+        const std::string& global_frame, bool prune, std::vector<geometry_msgs::PoseStamped>& transformed_plan)
+    {
+        transformed_plan.clear();
+        if (plan_.empty())
+        {
+            ROS_ERROR("Received plan with zero length");
+            return false;
+        }
+
+        // The latest transform, the cache is kept while it stays the same
+        const std::string& plan_frame = plan_.front().header.frame_id;
+        geometry_msgs::TransformStamped plan_to_global;
+        if (plan_frame == global_frame)
+        {
+            plan_to_global.header.frame_id = global_frame;
+            plan_to_global.child_frame_id = plan_frame;
+            plan_to_global.transform.rotation.w = 1.0;
+        }
+        else
+        {
+            if (!tf.canTransform(global_frame, plan_frame, ros::Time(0)))
+                return false;
+            plan_to_global = tf.lookupTransform(global_frame, plan_frame, ros::Time(0));
+        }
+        const geometry_msgs::Vector3& t = plan_to_global.transform.translation;
+        const geometry_msgs::Quaternion& q = plan_to_global.transform.rotation;
+        const geometry_msgs::Vector3& t_prev = plan_to_global_.transform.translation;
+        const geometry_msgs::Quaternion& q_prev = plan_to_global_.transform.rotation;
+        if (!have_transform_ || t.x != t_prev.x || t.y != t_prev.y || t.z != t_prev.z
+            || q.x != q_prev.x || q.y != q_prev.y || q.z != q_prev.z || q.w != q_prev.w)
+        {
+            generation_++;
+            have_transform_ = true;
+        }
+        plan_to_global_ = plan_to_global;
+
+        // Poses further than half the local costmap are left out, as in
+        // base_local_planner::transformGlobalPlan
+        double dist_threshold = std::max(costmap.getSizeInCellsX() * costmap.getResolution() / 2.0,
+                                         costmap.getSizeInCellsY() * costmap.getResolution() / 2.0);
+        double sq_dist_threshold = dist_threshold * dist_threshold;
+        double robot_x = robot_pose.pose.position.x;
+        double robot_y = robot_pose.pose.position.y;
+
+        size_t begin = progress_;
+        double sq_dist = sq_dist_threshold + 1;
+        // Skip to the first pose on the local costmap
+        while (begin < plan_.size())
+        {
+            const geometry_msgs::PoseStamped& pose = transformed(begin);
+            double x_diff = robot_x - pose.pose.position.x;
+            double y_diff = robot_y - pose.pose.position.y;
+            sq_dist = x_diff * x_diff + y_diff * y_diff;
+            if (sq_dist <= sq_dist_threshold)
+                break;
+            begin++;
+        }
+        // Then take the poses while they stay on it
+        size_t end = begin;
+        while (end < plan_.size() && sq_dist <= sq_dist_threshold)
+        {
+            end++;
+            if (end < plan_.size())
+            {
+                const geometry_msgs::PoseStamped& pose = transformed(end);
+                double x_diff = robot_x - pose.pose.position.x;
+                double y_diff = robot_y - pose.pose.position.y;
+                sq_dist = x_diff * x_diff + y_diff * y_diff;
+            }
+        }
+
+        // Skip the poses before the first one within 1 m of the robot, as
+        // base_local_planner::prunePlan does
+        if (prune)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                double x_diff = robot_x - transformed_[i].pose.position.x;
+                double y_diff = robot_y - transformed_[i].pose.position.y;
+                if (x_diff * x_diff + y_diff * y_diff < 1)
+                {
+                    begin = i;
+                    progress_ = i;
+                    break;
+                }
+            }
+        }
+
+        transformed_plan.assign(transformed_.begin() + begin, transformed_.begin() + end);
+        return true;
+    }
+}
@@ -0,0 +1,45 @@
+#include <local_plan.h>
+#include <cmath>
+#include <angles/angles.h>
+#include <tf2/utils.h>
+
+namespace mpnet_local_planner{
+
+    void resamplePlan(const std::vector<geometry_msgs::PoseStamped>& plan, double ds, mpnet_plan::LocalPlan& compact)
+    {
+        compact.x.clear();
+        compact.y.clear();
+        compact.yaw.clear();
+        if (plan.empty())
+            return;
+        // Also catches NaN, the loop below would never end
+        if (!(ds >= min_plan_ds))
+            ds = min_plan_ds;
+        // Walk the segments and emit a sample every ds of arc length
+        double next_s = 0, s = 0;
+        for (unsigned int i = 1; i < plan.size(); i++)
+        {
+            const geometry_msgs::Point& p0 = plan[i-1].pose.position;
+            const geometry_msgs::Point& p1 = plan[i].pose.position;
+            double segment = std::hypot(p1.x - p0.x, p1.y - p0.y);
+            double yaw0 = tf2::getYaw(plan[i-1].pose.orientation);
+            double dyaw = angles::shortest_angular_distance(yaw0, tf2::getYaw(plan[i].pose.orientation));
+            while (segment > 0 && next_s <= s + segment)
+            {
+                double t = (next_s - s) / segment;
+                compact.x.push_back(p0.x + t * (p1.x - p0.x));
+                compact.y.push_back(p0.y + t * (p1.y - p0.y));
+                compact.yaw.push_back(angles::normalize_angle(yaw0 + t * dyaw));
+                next_s += ds;
+            }
+            s += segment;
+        }
+        // Always end on the last pose
+        if (compact.x.empty() || next_s - ds < s - 1e-9)
+        {
+            compact.x.push_back(plan.back().pose.position.x);
+            compact.y.push_back(plan.back().pose.position.y);
+            compact.yaw.push_back(tf2::getYaw(plan.back().pose.orientation));
+        }
+    }
+}
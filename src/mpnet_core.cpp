@@ -0,0 +1,444 @@
+#include <mpnet_core.h>
+#include <chrono>
+#include <iostream>
+#include <cmath>
+#include <mutex>
+
+namespace mpnet_local_planner{
+
+    namespace{
+        // A stored pose is joined when the Dubins path to it is at most this
+        // much longer than the straight line, so a lateral offset from the
+        // stored path is made up further along it rather than by a loop
+        const double max_detour = 1.5;
+        const double detour_slack = 0.1;
+
+        // The generator of torch is process-wide, so the sampling of the cores
+        // runs one plan at a time for each plan to draw only from its own seed
+        std::mutex torch_seed_mutex;
+
+        // Maps the costs of costmap_2d to the occupancy in the network input
+        const char* costTranslationTable()
+        {
+            static const std::vector<char> table = []()
+            {
+                std::vector<char> t(256);
+                // special values:
+                t[0] = 0;  // NO obstacle
+                t[253] = 99;  // INSCRIBED obstacle
+                t[254] = 100;  // LETHAL obstacle
+                t[255] = -1;  // UNKNOWN
+
+                // regular cost values scale the range 1 to 252 (inclusive) to fit
+                // into 1 to 98 (inclusive).
+                for (int i = 1; i < 253; i++)
+                {
+                    t[ i ] = char(1 + (97 * (i - 1)) / 251);
+                }
+                return t;
+            }();
+            return table.data();
+        }
+    }
+
+    const double MpnetCore::turning_radius = 0.58;
+
+    MpnetCore::MpnetCore(
+        const std::string& file_name,
+        double xy_tolerance,
+        double yaw_tolerance,
+        int num_samples,
+        int num_paths,
+        const std::vector<Point2D>& footprint):
+    footprint_(footprint),
+    use_gpu(true),
+    device(torch::kCPU),
+    space(std::make_shared<ob::DubinsStateSpace>(turning_radius)),
+    space_bounds(2),
+    g_tolerance(xy_tolerance),
+    yaw_tolerance(yaw_tolerance),
+    num_samples(num_samples),
+    num_paths(num_paths),
+    simplify_time(0),
+    last_plan_time(0),
+    last_simplify_time(0),
+    next_seed(1),
+    seed(0)
+    {
+        // TODO: Set map bounds dynamically
+        space_bounds.setLow(0,-100);
+        space_bounds.setLow(1,-100);
+        space_bounds.setHigh(0,100);
+        space_bounds.setHigh(1,100);
+        space->as<ob::SE2StateSpace>()->setBounds(space_bounds);
+        space->setLongestValidSegmentFraction(0.0005);
+        si = std::make_shared<ob::SpaceInformation>(space);
+        si->setStateValidityChecker([this](const ob::State *state) -> bool
+        {
+            return this->isStateValid(state);
+        }
+        );
+        // The step follows the resolution of each costmap in setCostmap
+        motion_validator = std::make_shared<DubinsMotionValidator>(si.get(), turning_radius,
+            DubinsMotionValidator::stepFor(0.05, footprint_, turning_radius));
+        si->setMotionValidator(motion_validator);
+        psk = std::make_shared<og::PathSimplifier>(si);
+
+        planAlgo = std::make_shared<og::RRTstar>(si);
+        planAlgo->setRange(0.2);
+        planAlgo->setTreePruning(true);
+
+        module = torch::jit::load(file_name);
+        if (!torch::cuda::is_available())
+        {
+            use_gpu = false;
+            std::cout << "Did not find CUDA, setting device to CPU" << std::endl;
+        }
+
+        if (!use_gpu)
+        {
+            module.to(torch::kCPU);
+        }
+        else
+        {
+            device = torch::Device(torch::kCUDA);
+            std::cout << "Using GPU" << std::endl;
+        }
+    }
+
+    void MpnetCore::setCostmap(const CostmapView& costmap, const CostmapView* fallback)
+    {
+        costmap_ = costmap;
+        fallback_ = fallback != NULL ? *fallback : CostmapView();
+        if (costmap_.resolution > 0)
+            motion_validator->setStep(DubinsMotionValidator::stepFor(costmap_.resolution, footprint_, turning_radius));
+    }
+
+    torch::Tensor MpnetCore::copy_costmap(double x, double y)
+    {
+        torch::Tensor costmap_egocentric = torch::full({1,1,80,80}, 1);
+
+        double resolution = costmap_.resolution;
+        double origin_x = costmap_.origin_x;
+        double origin_y = costmap_.origin_y;
+
+        // FOR COSTMAP GENERATION
+        int64_t mx = (int64_t)((x-origin_x)/resolution);
+        int64_t my = (int64_t)((y-origin_y)/resolution);
+        int64_t start_x = 120-mx;
+        int64_t start_y = 120-my;
+
+        int64_t skip_x = 0 ? start_x%3==0 : 3-start_x%3;
+        int64_t skip_y = 0 ? start_y%3==0 : 3-start_y%3;
+
+        int64_t start_shrunk_x = (start_x + skip_x)/3;
+        int64_t start_shrunk_y = (start_y + skip_y)/3;
+        auto cm_a = costmap_egocentric.accessor<float,4>();
+        const unsigned char* data = costmap_.data;
+        const char* cost_translation_table = costTranslationTable();
+        if (data != NULL)
+        {
+            // Copy costmap data into egocentric costmap
+            for (int64_t i=0, r=skip_y; r < 120; i++, r+=3)
+            {
+                for (int64_t j=0, c=skip_x; c<120; j++, c+=3)
+                {
+                    cm_a[0][0][start_shrunk_y+i][start_shrunk_x +j] = ((float)cost_translation_table[data[c+r*costmap_.size_x]])/100;
+                }
+            }
+        }
+        return costmap_egocentric;
+    }
+
+    torch::Tensor MpnetCore::copy_pose(const ob::ScopedState<> &start, const ob::ScopedState<> &goal, const std::vector<double>& bounds)
+    {
+        torch::Tensor input_vector = torch::empty({1,6});
+
+        double origin_x = costmap_.origin_x;
+        double origin_y = costmap_.origin_y;
+
+        input_vector[0][0] = ((start[0]-origin_x)/bounds[0])*2 - 1;
+        input_vector[0][1] = ((start[1]-origin_y)/bounds[1])*2 - 1;
+        input_vector[0][2] = start[2]/bounds[2];
+        input_vector[0][3] = ((goal[0]-origin_x)/bounds[0])*2 - 1 ;
+        input_vector[0][4] = ((goal[1]-origin_y)/bounds[1])*2 - 1 ;
+        input_vector[0][5] = goal[2]/bounds[2];
+
+        return input_vector;
+    }
+
+    std::vector<double> MpnetCore::getMapPoint(torch::Tensor target_state, const std::vector<double>& bounds)
+    {
+        auto tensor_a = target_state.accessor<float,2>();
+
+        double origin_x = costmap_.origin_x;
+        double origin_y = costmap_.origin_y;
+
+        std::vector<double> pose{(tensor_a[0][0]+1)*bounds[0]/2 + origin_x, (tensor_a[0][1]+1)*bounds[1]/2 + origin_y,tensor_a[0][2]*bounds[2]};
+        return pose;
+    }
+
+    std::vector<double> MpnetCore::getTargetPoint(const ob::ScopedState<>&start, const ob::ScopedState<> &goal, const std::vector<double>& bounds)
+    {
+        torch::NoGradGuard no_grad;
+        torch::Tensor input_vector = copy_pose(start, goal, bounds);
+        inputs.push_back(input_vector.to(device));
+        {
+            PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::COSTMAP_COPY);
+            torch::Tensor costmap = copy_costmap(start[0], start[1]);
+            inputs.push_back(costmap.to(device));
+        }
+
+        at::Tensor output;
+        {
+            PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::INFERENCE);
+            output = module.forward(inputs).toTensor();
+            if (use_gpu)
+                output = output.to(torch::kCPU);
+        }
+
+        std::vector<double> targetPoint = getMapPoint(output, bounds);
+        inputs.clear();
+        return targetPoint;
+    }
+
+    bool MpnetCore::isStateValid(const ob::State *state)
+    {
+        const auto *s = state->as<ob::SE2StateSpace::StateType>();
+        metrics.countCollisionCheck();
+        return isStateValid(SE2Pose(s->getX(), s->getY(), s->getYaw()), footprint_);
+    }
+
+    bool MpnetCore::isStateValid(const SE2Pose& pose, const std::vector<Point2D>& footprint)
+    {
+        double footprint_cost = footprintCost(costmap_, pose, footprint);
+        // -3 is a footprint that leaves the local costmap
+        if (footprint_cost==-3.0 && !fallback_.empty())
+            footprint_cost = footprintCost(fallback_, pose, footprint);
+        return (footprint_cost>=0);
+    }
+
+    double MpnetCore::plan(const SE2Pose& start, const SE2Pose& goal, const std::vector<double>& bounds, std::vector<SE2Pose>& path)
+    {
+        PlannerMetrics::ScopedTimer plan_timer(metrics, PlannerMetrics::MPNET);
+        std::chrono::steady_clock::time_point plan_start = std::chrono::steady_clock::now();
+        unsigned long checks = metrics.getCollisionChecks();
+        last_simplify_time = 0;
+        std::unique_lock<std::mutex> seed_lock(torch_seed_mutex);
+        seed = next_seed++;
+        torch::manual_seed(seed);
+
+        ob::ScopedState<> start_ompl(space), goal_ompl(space);
+        start_ompl[0] = start.x;
+        start_ompl[1] = start.y;
+        start_ompl[2] = start.yaw;
+        goal_ompl[0] = goal.x;
+        goal_ompl[1] = goal.y;
+        goal_ompl[2] = goal.yaw;
+
+        og::PathGeometric FinalPathFromStart(si, start_ompl());
+        ob::ScopedState<> target_pose(space), s(space);
+        bool isStartValid, isGoalValid = false;
+        std::vector<double> targetPose;
+        path.clear();
+        ob::ScopedState<> reset_ompl(space, start_ompl());
+        double xy_distance_from_goal, yaw_from_goal;
+        for(int numPlan=0; numPlan<num_paths; numPlan++)
+        {
+            MPNET_TRACE_SPAN("rollout");
+            start_ompl=reset_ompl;
+            FinalPathFromStart.clear();
+            FinalPathFromStart.append(start_ompl());
+            for(int sample=0;sample<num_samples;sample++)
+            {
+                MPNET_TRACE_SPAN("sample");
+                og::PathGeometric pathToGoal = og::PathGeometric(si, start_ompl(), goal_ompl());
+                {
+                    PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::PATH_CHECK);
+                    isGoalValid = pathToGoal.check();
+                }
+                if (isGoalValid)
+                {
+                    FinalPathFromStart.append(goal_ompl());
+                    break;
+                }
+                targetPose = getTargetPoint(start_ompl, goal_ompl, bounds);
+                target_pose[0] = targetPose[0];
+                target_pose[1] = targetPose[1];
+                target_pose[2] = targetPose[2];
+
+                og::PathGeometric pathFromStart=og::PathGeometric(si, start_ompl(), target_pose());
+                {
+                    PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::PATH_CHECK);
+                    isStartValid = pathFromStart.check();
+                }
+
+                if (isStartValid)
+                {
+                    FinalPathFromStart.append(target_pose());
+                    start_ompl = target_pose;
+                }
+
+                xy_distance_from_goal = std::hypot(targetPose[0]-goal_ompl[0], targetPose[1]-goal_ompl[1]);
+                yaw_from_goal = std::fabs(std::remainder(goal_ompl[2]-targetPose[2], 2*M_PI));
+                if (xy_distance_from_goal <=g_tolerance && yaw_from_goal<=yaw_tolerance && isStartValid)
+                {
+                    isGoalValid=true;
+                    break;
+                }
+            }
+            if (isGoalValid)
+                break;
+        }
+        seed_lock.unlock();
+
+        double cost = -1;
+        if (isGoalValid)
+        {
+            // Simplify solution
+            {
+                PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::SIMPLIFY);
+                std::chrono::steady_clock::time_point simplify_start = std::chrono::steady_clock::now();
+                if (simplify_time > 0)
+                    psk->simplify(FinalPathFromStart, simplify_time);
+                else
+                    psk->simplifyMax(FinalPathFromStart);
+                last_simplify_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - simplify_start).count();
+            }
+            // TODO : Check this interpolate function on the number of points it takes to generate a
+            // feasilble path.
+            {
+                PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::INTERPOLATE);
+                FinalPathFromStart.interpolate();
+            }
+            cost = FinalPathFromStart.length();
+            path.reserve(FinalPathFromStart.getStateCount());
+            for(unsigned int i=0; i<FinalPathFromStart.getStateCount(); i++)
+            {
+                s = FinalPathFromStart.getState(i);
+                path.push_back(SE2Pose(s[0], s[1], s[2]));
+            }
+        }
+        metrics.recordPlanChecks(metrics.getCollisionChecks() - checks);
+        last_plan_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - plan_start).count();
+        return cost;
+    }
+
+    double MpnetCore::planFromPath(const SE2Pose& start, const SE2Pose& goal, const std::vector<SE2Pose>& stored, std::vector<SE2Pose>& path)
+    {
+        PlannerMetrics::ScopedTimer plan_timer(metrics, PlannerMetrics::LIBRARY);
+        unsigned long checks = metrics.getCollisionChecks();
+        path.clear();
+
+        ob::ScopedState<> from(space), to(space), s(space);
+        from[0] = start.x;
+        from[1] = start.y;
+        from[2] = start.yaw;
+        og::PathGeometric repaired(si, from());
+        // More than half the stored poses skipped is a different path
+        size_t skipped = 0, max_skipped = stored.size() / 2;
+        bool reached = false;
+        for (size_t i = 0; i <= stored.size() && skipped <= max_skipped; i++)
+        {
+            bool is_goal = i == stored.size();
+            const SE2Pose& pose = is_goal ? goal : stored[i];
+            to[0] = pose.x;
+            to[1] = pose.y;
+            to[2] = pose.yaw;
+            double line = std::hypot(pose.x - from[0], pose.y - from[1]);
+            bool joined = is_goal || si->distance(from(), to()) <= max_detour * line + detour_slack;
+            if (joined)
+            {
+                PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::PATH_CHECK);
+                joined = si->checkMotion(from(), to());
+            }
+            if (joined)
+            {
+                repaired.append(to());
+                from = to;
+                reached = is_goal;
+            }
+            else
+                skipped++;
+        }
+
+        double cost = -1;
+        if (reached)
+        {
+            {
+                PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::SIMPLIFY);
+                if (simplify_time > 0)
+                    psk->simplify(repaired, simplify_time);
+                else
+                    psk->simplifyMax(repaired);
+            }
+            {
+                PlannerMetrics::ScopedTimer timer(metrics, PlannerMetrics::INTERPOLATE);
+                repaired.interpolate();
+            }
+            cost = repaired.length();
+            path.reserve(repaired.getStateCount());
+            for(unsigned int i=0; i<repaired.getStateCount(); i++)
+            {
+                s = repaired.getState(i);
+                path.push_back(SE2Pose(s[0], s[1], s[2]));
+            }
+        }
+        metrics.recordPlanChecks(metrics.getCollisionChecks() - checks);
+        return cost;
+    }
+
+    void MpnetCore::getQuery(PlanningRecord& record) const
+    {
+        record.xy_tolerance = g_tolerance;
+        record.yaw_tolerance = yaw_tolerance;
+        record.num_samples = num_samples;
+        record.num_paths = num_paths;
+        record.seed = seed;
+        record.simplify_time = simplify_time;
+        record.footprint = footprint_;
+        record.costmap = costmap_;
+        record.fallback = fallback_;
+    }
+
+    bool MpnetCore::planRRTStar(const SE2Pose& start, const SE2Pose& goal, std::vector<SE2Pose>& path, unsigned int iterations)
+    {
+        PlannerMetrics::ScopedTimer plan_timer(metrics, PlannerMetrics::RRT_STAR);
+        unsigned long checks = metrics.getCollisionChecks();
+        og::SimpleSetup ss(si);
+        ob::ScopedState<> start_ompl(space), goal_ompl(space), s(space);
+        start_ompl[0] = start.x;
+        start_ompl[1] = start.y;
+        start_ompl[2] = start.yaw;
+        goal_ompl[0] = goal.x;
+        goal_ompl[1] = goal.y;
+        goal_ompl[2] = goal.yaw;
+
+        planAlgo->clear();
+        ss.setStartAndGoalStates(start_ompl, goal_ompl);
+        ss.setPlanner(planAlgo);
+
+        // A budget of iterations does the same work on every run, the
+        // default wall clock budget depends on the load of the machine
+        if (iterations > 0)
+            ss.solve(ob::IterationTerminationCondition(iterations));
+        else
+            ss.solve(0.1);
+        path.clear();
+
+        if (ss.haveSolutionPath())
+        {
+            ss.simplifySolution(iterations > 0 ? 0.0 : 0.05);
+            og::PathGeometric FinalPathFromStart = ss.getSolutionPath();
+            FinalPathFromStart.interpolate();
+            path.reserve(FinalPathFromStart.getStateCount());
+            for(unsigned int i=0; i<FinalPathFromStart.getStateCount(); i++)
+            {
+                s = FinalPathFromStart.getState(i);
+                path.push_back(SE2Pose(s[0], s[1], s[2]));
+            }
+        }
+        metrics.recordPlanChecks(metrics.getCollisionChecks() - checks);
+        return !path.empty();
+    }
+}
@@ -23,11 +23,55 @@
 namespace og = ompl::geometric;
 
 namespace mpnet_local_planner{
-    
-    char* MpnetPlanner::cost_translation_table=NULL;
-    
-    // MpnetPlanner::MpnetPlanner(){}
-    
+
+    namespace{
+        CostmapView viewOf(const costmap_2d::Costmap2D& costmap)
+        {
+            return CostmapView(costmap.getSizeInCellsX(), costmap.getSizeInCellsY(), costmap.getResolution(),
+                costmap.getOriginX(), costmap.getOriginY(), costmap.getCharMap());
+        }
+
+        std::vector<Point2D> toPoints(const std::vector<geometry_msgs::Point>& footprint)
+        {
+            std::vector<Point2D> points;
+            for (size_t i = 0; i < footprint.size(); i++)
+                points.push_back(Point2D(footprint[i].x, footprint[i].y));
+            return points;
+        }
+
+        SE2Pose toPose(const geometry_msgs::PoseStamped& pose)
+        {
+            return SE2Pose(pose.pose.position.x, pose.pose.position.y, tf2::getYaw(pose.pose.orientation));
+        }
+
+        /**
+         * @brief A pose given in a child frame, in the parent frame
+         * @param frame The pose of the child frame in the parent frame
+         */
+        SE2Pose compose(const SE2Pose& frame, const SE2Pose& pose)
+        {
+            double c = cos(frame.yaw), s = sin(frame.yaw);
+            return SE2Pose(frame.x + c*pose.x - s*pose.y, frame.y + s*pose.x + c*pose.y,
+                angles::normalize_angle(frame.yaw + pose.yaw));
+        }
+
+        SE2Pose inverse(const SE2Pose& frame)
+        {
+            double c = cos(frame.yaw), s = sin(frame.yaw);
+            return SE2Pose(-c*frame.x - s*frame.y, s*frame.x - c*frame.y, -frame.yaw);
+        }
+
+        void transformPath(const SE2Pose& frame, const std::vector<SE2Pose>& path, std::vector<SE2Pose>& out)
+        {
+            out.resize(path.size());
+            for (size_t i = 0; i < path.size(); i++)
+                out[i] = compose(frame, path[i]);
+        }
+
+        // The stored paths repaired before planning, the closest first
+        const size_t library_matches = 3;
+    }
+
     MpnetPlanner::MpnetPlanner(
         tf2_ros::Buffer* tf, 
         costmap_2d::Costmap2DROS *costmap_ros, 
@@ -36,393 +80,244 @@ namespace mpnet_local_planner{
         double yaw_tolerance,
         int numSamples,
         int numPaths,
-        std::vector<geometry_msgs::Point> footprint):
-    tf_(NULL),
-    navigation_costmap_ros(NULL),
-    collision_costmap_ros(NULL),
-    costmap_collision_(NULL),
-    costmap_(NULL),
-    world_model(NULL),
-    space(std::make_shared<ob::DubinsStateSpace>(0.58)),
-    bounds(NULL),
-    si(NULL),
+        std::vector<geometry_msgs::Point> footprint,
+        double collision_grid_size):
+    tf_(tf),
+    navigation_costmap_ros(costmap_ros),
+    snapshots(NULL),
+    collision_grid(NULL),
+    core(NULL),
     initialized_(false),
-    g_tolerance(xy_tolerance),
-    yaw_tolerance(yaw_tolerance),
-    planAlgo(NULL),
-    device(torch::kCPU),
-    use_gpu(true),
-    num_samples(numSamples),
-    num_paths(numPaths),
-    robot_footprint(footprint)
+    robot_footprint(toPoints(footprint)),
+    recorder(NULL),
+    library(NULL),
+    library_slot(0),
+    last_from_library(false)
     {
-        if (~isInitialized())
-        {
-            if (cost_translation_table==NULL)
-            {
-                cost_translation_table = new char[256];
-                // special values:
-                cost_translation_table[0] = 0;  // NO obstacle
-                cost_translation_table[253] = 99;  // INSCRIBED obstacle
-                cost_translation_table[254] = 100;  // LETHAL obstacle
-                cost_translation_table[255] = -1;  // UNKNOWN
-
-                // regular cost values scale the range 1 to 252 (inclusive) to fit
-                // into 1 to 98 (inclusive).
-                for (int i = 1; i < 253; i++)
-                {
-                    cost_translation_table[ i ] = char(1 + (97 * (i - 1)) / 251);
-                }
-            }
+        // Planning and collision checks use a snapshot of the local
+        // costmap, taken at the start of each cycle, so the costmap keeps
+        // updating while planning. States that fall off the local window
+        // are checked against a window of the static map around the robot.
+        snapshots = new CostmapSnapshots(navigation_costmap_ros->getCostmap());
+        costmap_ = snapshots->take();
+        if (collision_grid_size>0)
+            collision_grid = new CollisionGrid(tf_, navigation_costmap_ros->getGlobalFrameID(), collision_grid_size, costmap_->getResolution());
+
+        core = new MpnetCore(file_name, xy_tolerance, yaw_tolerance, numSamples, numPaths, toPoints(navigation_costmap_ros->getRobotFootprint()));
+        core->setCostmap(viewOf(*costmap_));
+
+        // For debugging reasons
+        ros::NodeHandle n;
+        target_robot_pub = n.advertise<geometry_msgs::PoseWithCovarianceStamped>("/targetpose", 1);
+        initialized_ = true;
+    }
 
-            // Create a connection to the global costmap
-            // THIS IS A HACK FOR COLLISION CHECKING FOR TIME BEING
-            // THE CORRECT SOLUTION WOULD BE TO USE THE LOCAL COSTMAP 
-            // AND CHECK IF THE PATH GOES OUTSIDE THE BOUNDS OF THE LOCAL COSTMAP
-            tf_ = tf;
-            collision_costmap_ros = new costmap_2d::Costmap2DROS("collision_costmap", *tf_);
-            collision_costmap_ros->pause();
-            costmap_collision_ = collision_costmap_ros->getCostmap();
-            world_model = new base_local_planner::CostmapModel(*costmap_collision_);
-            collision_costmap_ros->start();
-
-            // Create a connection to the local costmap
-            navigation_costmap_ros = costmap_ros;
-            costmap_ = navigation_costmap_ros->getCostmap();
-
-            // TODO: Set map bounds dynamically 
-            bounds = new ob::RealVectorBounds(2);
-            // bounds->setLow(0,0.0);
-            // bounds->setLow(1,0.0);
-            // bounds->setHigh(0,27.0);
-            // bounds->setHigh(1,27.0);
-            
-            // bounds->setLow(0,0.0);
-            // bounds->setLow(1,0.0);
-            // bounds->setHigh(0,13.5);
-            // bounds->setHigh(1,14.0);
-
-            bounds->setLow(0,-100);
-            bounds->setLow(1,-100);
-            bounds->setHigh(0,100);
-            bounds->setHigh(1,100);
-            
-            bounds->setLow(2,-M_PI);
-            bounds->setHigh(2,M_PI);
-            space->as<ob::SE2StateSpace>()->setBounds(*bounds);
-            space->setLongestValidSegmentFraction(0.0005);
-            si = std::make_shared<ob::SpaceInformation>(space);
-            si->setStateValidityChecker([this](const ob::State *state) -> bool
-            {
-                return this->isStateValid(state);
-            }
-            );
-            psk = std::make_shared<og::PathSimplifier>(si);
+    MpnetPlanner::~MpnetPlanner()
+    {
+        if (recorder!=NULL)
+            delete recorder;
 
-            planAlgo = std::make_shared<og::RRTstar>(si);
-            planAlgo->setRange(0.2);
-            planAlgo->setTreePruning(true);
+        if (library!=NULL)
+            delete library;
 
-            module = torch::jit::load(file_name);
-            if (!torch::cuda::is_available())
-            {
-                use_gpu = false;
-                ROS_INFO("Did not find CUDA, setting device to CPU");
-            }
+        if (core!=NULL)
+            delete core;
 
-            if (!use_gpu)
-            {
-                module.to(torch::kCPU);
-            }
-            else
-            {
-                device = torch::Device(torch::kCUDA);
-                ROS_INFO("Using GPU");
-            }
-            
-            // For debugging reasons
-            ros::NodeHandle n;
-            target_robot_pub = n.advertise<geometry_msgs::PoseWithCovarianceStamped>("/targetpose", 1);
-            initialized_ = true;
+        if (collision_grid!=NULL)
+            delete collision_grid;
 
+        costmap_.reset();
+        if (snapshots!=NULL)
+            delete snapshots;
+    }
+
+    void MpnetPlanner::updateCostmap(const geometry_msgs::PoseStamped& start)
+    {
+        PlannerMetrics::ScopedTimer timer(core->getMetrics(), PlannerMetrics::SNAPSHOT);
+        costmap_ = snapshots->take();
+        CostmapView local = viewOf(*costmap_);
+        if (collision_grid!=NULL && collision_grid->update(start.pose.position.x, start.pose.position.y))
+        {
+            CostmapView grid = viewOf(collision_grid->getCostmap());
+            core->setCostmap(local, &grid);
         }
         else
+            core->setCostmap(local);
+    }
+
+    bool MpnetPlanner::recordQueries(const std::string& file_name)
+    {
+        if (recorder!=NULL)
+            delete recorder;
+        recorder = new QueryRecorder(file_name);
+        if (!recorder->isOpen())
         {
-            ROS_WARN("The core planner has already been initialized, doing nothing");
+            delete recorder;
+            recorder = NULL;
+            return false;
         }
+        return true;
     }
 
-    MpnetPlanner::~MpnetPlanner()
+    bool MpnetPlanner::usePathLibrary(const std::string& file_name, const std::string& map_frame, double radius, double yaw_tolerance, size_t capacity)
     {
-        if (navigation_costmap_ros!=NULL)
-            delete navigation_costmap_ros;
-
-        if (bounds!=NULL)
-            delete bounds;
-
-        if (collision_costmap_ros!=NULL)
-            delete collision_costmap_ros;
-
-        if (world_model!=NULL)
-            delete world_model;
+        if (library!=NULL)
+            delete library;
+        library = new PathLibrary(radius, yaw_tolerance);
+        if (!library->open(file_name, capacity))
+        {
+            delete library;
+            library = NULL;
+            return false;
+        }
+        library_frame = map_frame;
+        return true;
     }
 
-
-    torch::Tensor MpnetPlanner::copy_costmap(double x, double y)
+    bool MpnetPlanner::lookupLibraryFrame(SE2Pose& frame)
     {
-        torch::Tensor costmap_egocentric = torch::full({1,1,80,80}, 1);
-
-        double resolution = costmap_->getResolution();
-        double origin_x, origin_y;
-        costmap_->mapToWorld(0,0,origin_x,origin_y);
-        origin_x = origin_x - resolution/2;
-        origin_y = origin_y - resolution/2;
-
-        // FOR COSTMAP GENERATION
-        int64_t mx = (int64_t)((x-origin_x)/resolution);
-        int64_t my = (int64_t)((y-origin_y)/resolution);
-        int64_t start_x = 120-mx;
-        int64_t start_y = 120-my;
-
-        int64_t skip_x = 0 ? start_x%3==0 : 3-start_x%3;
-        int64_t skip_y = 0 ? start_y%3==0 : 3-start_y%3;
-        
-        int64_t start_shrunk_x = (start_x + skip_x)/3;
-        int64_t start_shrunk_y = (start_y + skip_y)/3;
-        auto cm_a = costmap_egocentric.accessor<float,4>();
-        unsigned char* data = costmap_->getCharMap();
-        if (data != NULL)
-        {    
-            // Copy costmap data into egocentric costmap
-            for (int64_t i=0, r=skip_y; r < 120; i++, r+=3)
-            {
-                for (int64_t j=0, c=skip_x; c<120; j++, c+=3)
-                {
-                    // std::cout<< start_shrunk_y+i << " "<< start_shrunk_x + j << std::endl;
-                    cm_a[0][0][start_shrunk_y+i][start_shrunk_x +j] = ((float)cost_translation_table[data[c+r*120]])/100;
-                }
-            }
+        std::string costmap_frame = navigation_costmap_ros->getGlobalFrameID();
+        if (library_frame.empty() || library_frame==costmap_frame)
+        {
+            frame = SE2Pose();
+            return true;
+        }
+        try
+        {
+            geometry_msgs::TransformStamped transform = tf_->lookupTransform(library_frame, costmap_frame, ros::Time(0));
+            frame = SE2Pose(transform.transform.translation.x, transform.transform.translation.y, tf2::getYaw(transform.transform.rotation));
+        }
+        catch (tf2::TransformException& ex)
+        {
+            ROS_WARN_THROTTLE(5.0, "Not using the path library, no transform from %s to %s: %s",
+                costmap_frame.c_str(), library_frame.c_str(), ex.what());
+            return false;
         }
-        return costmap_egocentric;
+        return true;
     }
 
-    torch::Tensor MpnetPlanner::copy_pose(const ob::ScopedState<> &start, const ob::ScopedState<> &goal, std::vector<double> bounds)
+    double MpnetPlanner::planFromLibrary(const SE2Pose& start, const SE2Pose& goal, const SE2Pose& frame)
     {
-        torch::Tensor input_vector = torch::empty({1,6});
-        
-        auto iv_a = input_vector.accessor<float,2>();
-        double resolution = costmap_->getResolution();
-        double origin_x, origin_y;
-        costmap_->mapToWorld(0,0,origin_x,origin_y);
-        origin_x = origin_x - resolution/2;
-        origin_y = origin_y - resolution/2;
-        
-        input_vector[0][0] = ((start[0]-origin_x)/bounds[0])*2 - 1;
-        input_vector[0][1] = ((start[1]-origin_y)/bounds[1])*2 - 1;
-        input_vector[0][2] = start[2]/bounds[2];
-        input_vector[0][3] = ((goal[0]-origin_x)/bounds[0])*2 - 1 ;
-        input_vector[0][4] = ((goal[1]-origin_y)/bounds[1])*2 - 1 ;
-        input_vector[0][5] = goal[2]/bounds[2];
-
-        return input_vector;
+        if (library->find(compose(frame, start), compose(frame, goal), library_matches, matches)==0)
+            return -1;
+        SE2Pose to_costmap = inverse(frame);
+        for (size_t i = 0; i < matches.size(); i++)
+        {
+            transformPath(to_costmap, matches[i].poses, library_buffer);
+            double cost = core->planFromPath(start, goal, library_buffer, path_buffer);
+            if (cost>=0)
+            {
+                library->markUsed(matches[i].slot);
+                library_slot = matches[i].slot;
+                return cost;
+            }
+        }
+        return -1;
     }
 
-    std::vector<double> MpnetPlanner::getMapPoint(torch::Tensor target_state, std::vector<double> bounds)
+    void MpnetPlanner::storePath(const SE2Pose& frame, bool repaired)
     {
-        auto tensor_a = target_state.accessor<float,2>();
-        
-        double resolution = costmap_->getResolution();
-        double origin_x, origin_y;
-        costmap_->mapToWorld(0,0,origin_x,origin_y);
-        origin_x = origin_x - resolution/2;
-        origin_y = origin_y - resolution/2;
-
-        std::vector<double> pose{(tensor_a[0][0]+1)*bounds[0]/2 + origin_x, (tensor_a[0][1]+1)*bounds[1]/2 + origin_y,tensor_a[0][2]*bounds[2]};
-        return pose;
+        transformPath(frame, path_buffer, library_buffer);
+        if (repaired)
+            library->replace(library_slot, library_buffer);
+        else
+            library->add(library_buffer);
     }
 
-    std::vector<double> MpnetPlanner::getTargetPoint(const ob::ScopedState<>&start, const ob::ScopedState<> &goal, std::vector<double> bounds)
+    void MpnetPlanner::recordQuery(PlanningRecord::Planner planner, const SE2Pose& start, const SE2Pose& goal, const std::vector<double>& bounds,
+        double cost, double plan_time, unsigned long collision_checks)
     {
-        torch::NoGradGuard no_grad;
-        torch::Tensor input_vector = copy_pose(start, goal, bounds);
-        inputs.push_back(input_vector.to(device));
-        // torch::Tensor costmap = torch::full({1,1,80,80}, 1);
-        // auto start_time = std::chrono::high_resolution_clock::now();
-        torch::Tensor costmap = copy_costmap(start[0], start[1]);
-        // copy_costmap(start[0], start[1], costmap);
-        // auto stop_time = std::chrono::high_resolution_clock::now();
-        // auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop_time - start_time);
-        // ROS_INFO("Time taken to copy : %ld microseconds", duration.count());
-        inputs.push_back(costmap.to(device));
-
-        at::Tensor output = module.forward(inputs).toTensor();
-        if (use_gpu)
-            output = output.to(torch::kCPU);
-
-        std::vector<double> targetPoint = getMapPoint(output, bounds);
-        inputs.clear();
-        return targetPoint;
+        // Only copies into a buffer of the recorder, the disk is written by its thread
+        core->getQuery(record_);
+        record_.stamp = ros::Time::now().toSec();
+        record_.planner = planner;
+        record_.start = start;
+        record_.goal = goal;
+        record_.bounds = bounds;
+        record_.success = !path_buffer.empty();
+        record_.cost = cost;
+        record_.plan_time = plan_time;
+        record_.collision_checks = collision_checks;
+        record_.path = path_buffer;
+        if (!recorder->record(record_))
+        {
+            if (recorder->getFailed()>0)
+                ROS_ERROR_ONCE("Could not write the query log, recording stopped");
+            else if (recorder->getDropped()==1)
+                ROS_WARN("The query log is falling behind, queries are dropped");
+        }
     }
 
-
-    bool MpnetPlanner::isStateValid(const ob::State *state)
+    bool MpnetPlanner::isStateValid(geometry_msgs::PoseStamped start)
     {
-        const auto *s = state->as<ob::SE2StateSpace::StateType>();
-        std::vector<geometry_msgs::Point> footprint = collision_costmap_ros->getRobotFootprint();
-        // Pass the orientation of the robot
-        double footprint_cost  = world_model->footprintCost(s->getX(), s->getY(),s->getYaw(), footprint);
-        return (footprint_cost>=0);
+        return core->isStateValid(toPose(start), robot_footprint);
     }
 
-    bool MpnetPlanner::isStateValid(geometry_msgs::PoseStamped start)
+    void MpnetPlanner::toTrajectory(const std::vector<SE2Pose>& path, base_local_planner::Trajectory& traj)
     {
-        double yaw = tf2::getYaw(start.pose.orientation);
-        double footprint_cost = world_model->footprintCost(start.pose.position.x, start.pose.position.y, yaw, robot_footprint);
-        return (footprint_cost>=0);
+        for (size_t i = 0; i < path.size(); i++)
+            traj.addPoint(path[i].x, path[i].y, path[i].yaw);
     }
 
-    // base_local_planner::Trajectory MpnetPlanner::getPath(ob::ScopedState<> start,ob::ScopedState<> goal, std::vector<double> bounds)
-    // void MpnetPlanner::getPath(ob::ScopedState<> start,ob::ScopedState<> goal, std::vector<double> bounds, base_local_planner::Trajectory &traj)
     void MpnetPlanner::getPath(geometry_msgs::PoseStamped start, geometry_msgs::PoseStamped goal, std::vector<double> bounds, base_local_planner::Trajectory &traj)
     {
-
-        // Convert poseStamped to Scoped state
-        ob::ScopedState<> start_ompl(space), goal_ompl(space);
-        start_ompl[0] = start.pose.position.x; 
-        start_ompl[1] = start.pose.position.y;
-        start_ompl[2] = tf2::getYaw(start.pose.orientation);
-        /*     
-        if (isStateValid(start_ompl()))
-        {
-            std::cout << "Valid start state \n";
-        } */
-        goal_ompl[0] = goal.pose.position.x ;
-        goal_ompl[1] = goal.pose.position.y ;
-        goal_ompl[2] = tf2::getYaw(goal.pose.orientation);
-
-        og::PathGeometric FinalPathFromStart(si, start_ompl());
-        ob::ScopedState<> target_pose(space), s(space);
-        bool isStartValid, isGoalValid;
-        std::vector<double> targetPose;
-        // base_local_planner::Trajectory traj(0.0,0.0,0.0,0.0, (unsigned int)10000); 
-        geometry_msgs::PoseWithCovarianceStamped nextPose;
-        nextPose.header.frame_id = "/map";
-        ros::Rate rate(10.0);
         traj.resetPoints();
-        ob::ScopedState<> reset_ompl(space, start_ompl());
-        double xy_distance_from_goal, yaw_from_goal;
-        for(int numPlan=0; numPlan<num_paths; numPlan++)
+        SE2Pose start_pose = toPose(start), goal_pose = toPose(goal);
+        // A stored path that repairs is used without running the network.
+        // Those plans are not recorded, they cannot be replayed without the
+        // library.
+        SE2Pose frame;
+        bool use_library = library!=NULL && lookupLibraryFrame(frame);
+        double cost = use_library ? planFromLibrary(start_pose, goal_pose, frame) : -1;
+        last_from_library = cost>=0;
+        if (!last_from_library)
         {
-            start_ompl=reset_ompl;
-            FinalPathFromStart.clear();
-            FinalPathFromStart.append(start_ompl());
-            for(int sample=0;sample<num_samples;sample++)
-            {
-                og::PathGeometric pathToGoal = og::PathGeometric(si, start_ompl(), goal_ompl());
-                isGoalValid = pathToGoal.check();
-                if (isGoalValid)
-                {
-                    FinalPathFromStart.append(goal_ompl());
-                    break;
-                }
-                targetPose = getTargetPoint(start_ompl, goal_ompl, bounds);
-                target_pose[0] = targetPose[0];
-                target_pose[1] = targetPose[1];
-                target_pose[2] = targetPose[2];
-
-                og::PathGeometric pathFromStart=og::PathGeometric(si, start_ompl(), target_pose());
-                isStartValid = pathFromStart.check();
-                
-                if (isStartValid)
-                {
-                    // std::cout<< "Valid sample point to start" << std::endl;
-                    FinalPathFromStart.append(target_pose());
-                    start_ompl = target_pose;
-                }
-
-                xy_distance_from_goal = std::hypot(targetPose[0]-goal_ompl[0], targetPose[1]-goal_ompl[1]);
-                yaw_from_goal = fabs(angles::shortest_angular_distance(targetPose[2], goal_ompl[2]));
-                if (xy_distance_from_goal <=g_tolerance && yaw_from_goal<=yaw_tolerance && isStartValid)
-                // if (xy_distance_from_goal <=g_tolerance)
-                {
-                    ROS_INFO("Valid path close to goal found");
-                    ROS_INFO("The goal tolerance is set at : %f", g_tolerance);
-                    isGoalValid=true;
-                    break;
-                }
-            }
-            if (isGoalValid)
-                break;
+            unsigned long checks = core->getMetrics().getCollisionChecks();
+            ros::WallTime plan_start = ros::WallTime::now();
+            cost = core->plan(start_pose, goal_pose, bounds, path_buffer);
+            if (recorder!=NULL)
+                recordQuery(PlanningRecord::MPNET, start_pose, goal_pose, bounds, cost, (ros::WallTime::now() - plan_start).toSec(),
+                    core->getMetrics().getCollisionChecks() - checks);
         }
-        if (isGoalValid)
+        // A repaired path replaces the one it came from
+        if (cost>=0 && use_library)
+            storePath(frame, last_from_library);
+        if (cost>=0)
         {
             // // Only for debugging purposes
-            nextPose.pose.pose.position.x =  goal_ompl[0];
-            nextPose.pose.pose.position.y = goal_ompl[1];
+            geometry_msgs::PoseWithCovarianceStamped nextPose;
+            nextPose.header.frame_id = "/map";
+            nextPose.pose.pose.position.x = goal_pose.x;
+            nextPose.pose.pose.position.y = goal_pose.y;
             nextPose.pose.pose.position.z = 0;
-
-            nextPose.pose.pose.orientation.z = sin(goal_ompl[2]/2);
-            nextPose.pose.pose.orientation.w = cos(goal_ompl[2]/2);
+            nextPose.pose.pose.orientation.z = sin(goal_pose.yaw/2);
+            nextPose.pose.pose.orientation.w = cos(goal_pose.yaw/2);
             target_robot_pub.publish(nextPose);
 
-            // Simplify solution
-            std::size_t numStates = FinalPathFromStart.getStateCount();
-            psk->simplifyMax(FinalPathFromStart);
-            // TODO : Check this interpolate function on the number of points it takes to generate a 
-            // feasilble path.
-            FinalPathFromStart.interpolate();
-            traj.cost_ = FinalPathFromStart.length();
-            // std::cout << FinalPathFromStart.getStateCount() << std::endl;
-            // TODO: Maybe this can be made faster?
-            for(unsigned int i=0; i<FinalPathFromStart.getStateCount(); i++)
-            {
-                s = FinalPathFromStart.getState(i);
-                traj.addPoint(s[0], s[1], s[2]);
-            }
+            traj.cost_ = cost;
+            toTrajectory(path_buffer, traj);
         }
     }
 
     void MpnetPlanner::getPathRRT_star(geometry_msgs::PoseStamped start, geometry_msgs::PoseStamped goal, base_local_planner::Trajectory &traj)
     {
-        og::SimpleSetup ss(si);
-        /* 
-        ss.setStateValidityChecker([this](const ob::State *state) -> bool
-        {
-            return this->isStateValid(state);
-        });
- */
-        ob::ScopedState<> start_ompl(space), goal_ompl(space), s(space);
-        start_ompl[0] = start.pose.position.x; 
-        start_ompl[1] = start.pose.position.y;
-        start_ompl[2] = tf2::getYaw(start.pose.orientation);
-
-        goal_ompl[0] = goal.pose.position.x ;
-        goal_ompl[1] = goal.pose.position.y ;
-        goal_ompl[2] = tf2::getYaw(goal.pose.orientation);
-
-        planAlgo->clear();
-        ss.setStartAndGoalStates(start_ompl, goal_ompl);
-        ss.setPlanner(planAlgo);
-        // std::cout << "The range of the planner : " << planAlgo->getRange();
-
-        ob::PlannerStatus solved = ss.solve(0.1);
         traj.resetPoints();
-
-        if (ss.haveSolutionPath())
+        // The path cost is left at defualt which is -1, this is because
+        // irrespective of the cost, this is the last resort for a path.
+        SE2Pose start_pose = toPose(start), goal_pose = toPose(goal);
+        unsigned long checks = core->getMetrics().getCollisionChecks();
+        ros::WallTime plan_start = ros::WallTime::now();
+        bool found = core->planRRTStar(start_pose, goal_pose, path_buffer);
+        if (recorder!=NULL)
+            recordQuery(PlanningRecord::RRT_STAR, start_pose, goal_pose, std::vector<double>(), -1,
+                (ros::WallTime::now() - plan_start).toSec(), core->getMetrics().getCollisionChecks() - checks);
+        if (found)
         {
-            ss.simplifySolution(0.05);
-            og::PathGeometric FinalPathFromStart = ss.getSolutionPath();
-            FinalPathFromStart.interpolate();
-            // The path cost is left at defualt which is -1, this is because
-            // irrespective of the cost, this is the last resort for a path.
-            std::cout << FinalPathFromStart.getStateCount() << std::endl;
-            for(unsigned int i=0; i<FinalPathFromStart.getStateCount(); i++)
-            {
-                s = FinalPathFromStart.getState(i);
-                traj.addPoint(s[0], s[1], s[2]);
-            }
+            SE2Pose frame;
+            if (library!=NULL && lookupLibraryFrame(frame))
+                storePath(frame, false);
+            toTrajectory(path_buffer, traj);
         }
-
     }
 }
 
@@ -573,6 +468,7 @@ int main(int argc,char* argv[]) {
         geometry_msgs::PoseWithCovarianceStamped targetPoint;
         base_local_planner::Trajectory path;
         // auto start_time = std::chrono::high_resolution_clock::now();
+        plan.updateCostmap(global_pose);
         plan.getPath(global_pose, goal_point, spaceBound, path);
         // auto stop_time = std::chrono::high_resolution_clock::now();
         // auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop_time - start_time);
@@ -60,6 +60,13 @@ namespace mpnet_local_planner{
         {
             ros::NodeHandle private_nh("~/"+name);  
             l_plan_pub_ = private_nh.advertise<nav_msgs::Path>("local_plan", 1);
+            l_plan_compact_pub_ = private_nh.advertise<mpnet_plan::LocalPlan>("local_plan_compact", 1);
+            private_nh.param("compact_plan_ds", compact_plan_ds, 0.05);
+            if (!(compact_plan_ds >= min_plan_ds))
+            {
+                ROS_WARN("compact_plan_ds of %g m is below the minimum, using %g m", compact_plan_ds, min_plan_ds);
+                compact_plan_ds = min_plan_ds;
+            }
             g_plan_pub_ = private_nh.advertise<nav_msgs::Path>("global_plan", 1);
             footprintPolygon = private_nh.advertise<geometry_msgs::PolygonStamped>("robot_footprint",1);
             resetController = private_nh.serviceClient<std_srvs::Empty>("/reset_controller");
@@ -96,10 +103,29 @@ namespace mpnet_local_planner{
                 private_nh.param("num_paths", numPaths, 2);
                 plan_freq = replanning_freq;
                 plan_freq_count= 0;
+                // Side of the static map window used for collision checks
+                // outside the local costmap, 0 keeps checks on the local costmap
+                double collision_grid_size;
+                private_nh.param("collision_grid_size", collision_grid_size, 10.0);
 
                 // LoadRobotActualFootprints
                 robot_footprint = costmap_2d::makeFootprintFromParams(private_nh);
 
+                // Run the controller in this process, with the parameters of
+                // controller_node under ~/controller. It shares the odometry,
+                // the tf buffer and the plan messages with the planner.
+                std::string odom_topic;
+                private_nh.param<std::string>("odom_topic", odom_topic, "odom");
+                odom_helper_.setOdomTopic(odom_topic);
+                bool run_controller;
+                private_nh.param("run_controller", run_controller, false);
+                if (run_controller)
+                {
+                    ros::NodeHandle gn;
+                    ros::NodeHandle controller_nh(private_nh, "controller");
+                    controller_runner_.reset(new ControllerRunner(gn, controller_nh, &odom_helper_, false, tf));
+                }
+
                 initialized_ = true;
                 ROS_INFO("Initialized xy tolerance: %f ", xy_goal_tolerance);
                 tc_ = new MpnetPlanner(
@@ -110,8 +136,114 @@ namespace mpnet_local_planner{
                     yaw_goal_tolerance,
                     numSamples,
                     numPaths,
-                    robot_footprint
+                    robot_footprint,
+                    collision_grid_size
                     );
+
+                // Stage timings, one row per stage with p50, p95, p99, max
+                // (ms) and the number of calls, the last row is the number
+                // of collision checks per plan
+                double metrics_period;
+                private_nh.param("metrics_period", metrics_period, 1.0);
+                // A cycle longer than the period of move_base delays the
+                // next one, /diagnostics warns when the slowest ones are
+                double controller_frequency;
+                ros::NodeHandle("~").param("controller_frequency", controller_frequency, 20.0);
+                private_nh.param("max_cycle_time", max_cycle_time_, controller_frequency > 0 ? 1.0 / controller_frequency : 0.0);
+                metrics_pub_ = private_nh.advertise<std_msgs::Float64MultiArray>("planner_metrics", 1);
+                diagnostics_pub_ = private_nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+                std::string stages;
+                for (int i = 0; i < PlannerMetrics::NUM_STAGES; i++)
+                    stages += std::string(PlannerMetrics::stageName((PlannerMetrics::Stage)i)) + ",";
+                stages += "collision_checks";
+                metrics_msg_.layout.dim.resize(2);
+                metrics_msg_.layout.dim[0].label = stages;
+                metrics_msg_.layout.dim[0].size = PlannerMetrics::NUM_STAGES + 1;
+                metrics_msg_.layout.dim[0].stride = (PlannerMetrics::NUM_STAGES + 1) * 5;
+                metrics_msg_.layout.dim[1].label = "p50,p95,p99,max,calls";
+                metrics_msg_.layout.dim[1].size = 5;
+                metrics_msg_.layout.dim[1].stride = 5;
+                metrics_msg_.data.resize((PlannerMetrics::NUM_STAGES + 1) * 5);
+                diagnostics_msg_.status.resize(1);
+                diagnostics_msg_.status[0].name = "mpnet_local_planner: planning";
+                diagnostics_msg_.status[0].hardware_id = "none";
+                if (metrics_period>0)
+                    metrics_timer_ = private_nh.createTimer(ros::Duration(metrics_period), &MpnetLocalPlanner::publishMetrics, this);
+
+                // Record spans of the planning cycles, written as a Chrome
+                // trace by ~dump_trace or SIGUSR1
+                bool trace;
+                private_nh.param("trace", trace, false);
+                private_nh.param<std::string>("trace_file", trace_file_, "/tmp/mpnet_planner_trace.json");
+                if (trace)
+                {
+                    TraceRecorder::setEnabled(true);
+                    TraceRecorder::dumpOnSignal(SIGUSR1);
+                    trace_srv_ = private_nh.advertiseService("dump_trace", &MpnetLocalPlanner::dumpTrace, this);
+                    trace_timer_ = private_nh.createTimer(ros::Duration(0.5), &MpnetLocalPlanner::pollTraceDump, this);
+                }
+
+                // Append every planning query to a log, query_replay plans
+                // them again offline
+                bool record_queries;
+                std::string query_log;
+                private_nh.param("record_queries", record_queries, false);
+                private_nh.param<std::string>("query_log", query_log, "/tmp/mpnet_queries.log");
+                if (record_queries && !tc_->recordQueries(query_log))
+                    ROS_ERROR("Could not open the query log %s", query_log.c_str());
+
+                // Keep the paths found in path_library_file, in the
+                // path_library_frame, and repair the stored paths near the
+                // start and goal before running the network
+                bool path_library;
+                std::string path_library_file, path_library_frame;
+                double path_library_radius, path_library_yaw_tolerance;
+                int path_library_capacity;
+                private_nh.param("path_library", path_library, false);
+                private_nh.param<std::string>("path_library_file", path_library_file, "/tmp/mpnet_path_library.bin");
+                private_nh.param<std::string>("path_library_frame", path_library_frame, "map");
+                private_nh.param("path_library_radius", path_library_radius, 0.5);
+                private_nh.param("path_library_yaw_tolerance", path_library_yaw_tolerance, 0.5);
+                private_nh.param("path_library_capacity", path_library_capacity, 2048);
+                if (path_library && !tc_->usePathLibrary(path_library_file, path_library_frame,
+                    path_library_radius, path_library_yaw_tolerance, std::max(path_library_capacity, 1)))
+                    ROS_ERROR("Could not open the path library %s", path_library_file.c_str());
+
+                // Adjust num_samples, num_paths, the simplification time and
+                // replanning_freq within their bounds so the plans take about
+                // target_plan_time, the settings are latched on ~planning_budget
+                bool adaptive_budget;
+                private_nh.param("adaptive_budget", adaptive_budget, false);
+                if (adaptive_budget)
+                {
+                    PlanningBudget::Settings min_settings, max_settings;
+                    double target_plan_time, success_target;
+                    int budget_window;
+                    private_nh.param("target_plan_time", target_plan_time, 0.1);
+                    private_nh.param("budget_window", budget_window, 10);
+                    private_nh.param("budget_success_target", success_target, 0.8);
+                    private_nh.param("min_num_samples", min_settings.num_samples, 2);
+                    private_nh.param("max_num_samples", max_settings.num_samples, 10);
+                    private_nh.param("min_num_paths", min_settings.num_paths, 1);
+                    private_nh.param("max_num_paths", max_settings.num_paths, 20);
+                    private_nh.param("min_simplify_time", min_settings.simplify_time, 0.005);
+                    private_nh.param("max_simplify_time", max_settings.simplify_time, 0.05);
+                    private_nh.param("min_replanning_freq", min_settings.replanning_freq, 5);
+                    private_nh.param("max_replanning_freq", max_settings.replanning_freq, 40);
+                    min_settings.simplify_time = std::max(min_settings.simplify_time, 1e-3);
+                    min_settings.replanning_freq = std::max(min_settings.replanning_freq, 1);
+
+                    budget_.reset(new PlanningBudget(
+                        PlanningBudget::Settings(numSamples, numPaths, max_settings.simplify_time, replanning_freq),
+                        min_settings, max_settings, target_plan_time, budget_window, success_target));
+                    budget_pub_ = private_nh.advertise<std_msgs::Float64MultiArray>("planning_budget", 1, true);
+                    budget_msg_.layout.dim.resize(1);
+                    budget_msg_.layout.dim[0].label = "num_samples,num_paths,simplify_time,replanning_freq,plan_time_p95,success_rate,target_plan_time";
+                    budget_msg_.layout.dim[0].size = 7;
+                    budget_msg_.layout.dim[0].stride = 7;
+                    budget_msg_.data.resize(7);
+                    applyBudget();
+                }
             }
             else
                 ROS_ERROR("No model file specified, Did not initialize planner");            
@@ -130,15 +262,19 @@ namespace mpnet_local_planner{
             return false;
         }
 
-        global_plan_.clear();
         local_plan.clear();
         path.resetPoints();
         std_srvs::Empty callController;
-        if (resetController.call(callController))
+        if (controller_runner_)
+        {
+            controller_runner_->reset();
+            ROS_INFO("Reset the controller");
+        }
+        else if (resetController.call(callController))
             ROS_INFO("Reset the controller");
         else
             ROS_INFO("Was not able to reset the controller");
-        global_plan_ = orig_global_plan;
+        global_plan_.setPlan(orig_global_plan);
         plan_freq_count = 0;
         reached_goal_ = false;
         valid_local_path = false;
@@ -153,6 +289,7 @@ namespace mpnet_local_planner{
             ROS_ERROR("This planner has not been initialized, please call initialize() before using this planner");
             return false;
         }
+        PlannerMetrics::ScopedTimer cycle_timer(tc_->getMetrics(), PlannerMetrics::CYCLE);
         geometry_msgs::PoseStamped global_pose;
         if (!navigation_costmap_ros_->getRobotPose(global_pose)){
             return false;
@@ -166,15 +303,12 @@ namespace mpnet_local_planner{
         footprintPolygon.publish(oriented_footprint);
 
         std::vector<geometry_msgs::PoseStamped> transformed_plan;
-        if (!base_local_planner::transformGlobalPlan(*tf_, global_plan_, global_pose, *costmap_, global_frame_, transformed_plan))
+        if (!global_plan_.update(*tf_, global_pose, *costmap_, global_frame_, prune_plan_, transformed_plan))
         {
             ROS_WARN("Could not transform the global plan to the frame of the controller");
             return false;
         }
 
-        if(prune_plan_)
-            base_local_planner::prunePlan(global_pose, transformed_plan, global_plan_);
-
         geometry_msgs::PoseStamped drive_cmds;
         drive_cmds.header.frame_id = robot_base_frame_;
 
@@ -185,7 +319,7 @@ namespace mpnet_local_planner{
         geometry_msgs::PoseStamped goal_point = transformed_plan.back();
 
         // Check if the global plan is near the terminating point
-        geometry_msgs::PoseStamped global_goal_point = global_plan_.back();
+        geometry_msgs::PoseStamped global_goal_point = global_plan_.getPlan().back();
         double thresh = std::hypot(
             goal_point.pose.position.x-global_goal_point.pose.position.x,
             goal_point.pose.position.y-global_goal_point.pose.position.y
@@ -242,10 +376,12 @@ namespace mpnet_local_planner{
         {
             plan_freq_count = 0;
             {
+                MPNET_TRACE_SPAN("replan");
                 valid_local_path = false;
                 // TODO: Define the bound for space - THIS IS A HACK, need to add this as a class variable
                 std::vector<double> spaceBound{6.0, 6.0, M_PI};
                 
+                tc_->updateCostmap(global_pose);
                 if (!tc_->isStateValid(global_pose))
                 {
                     ROS_INFO("Robot is in collision");
@@ -254,13 +390,17 @@ namespace mpnet_local_planner{
                     return false;
                 }
                 base_local_planner::Trajectory new_path;
-                auto start_time = std::chrono::high_resolution_clock::now();
                 tc_->getPath(global_pose, goal_point, spaceBound, new_path);
+                // Paths from the library do not run the network, they say
+                // nothing of the budget
+                if (budget_ && !tc_->isLastPathFromLibrary())
+                {
+                    double plan_time, simplify_time;
+                    tc_->getLastPlanTimes(plan_time, simplify_time);
+                    if (budget_->addPlan(plan_time, simplify_time, new_path.getPointsSize()>1))
+                        applyBudget();
+                }
                 // tc_->getPathRRT_star(global_pose, goal_point, new_path);
-
-                auto stop_time = std::chrono::high_resolution_clock::now();
-                auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop_time - start_time);
-                // ROS_INFO("Time taken to Plan : %ld microseconds", duration.count());
                 // ROS_INFO("Number of points in new path : %ud", new_path.getPointsSize());
 
                 if (new_path.getPointsSize()>1) 
@@ -336,8 +476,10 @@ namespace mpnet_local_planner{
         if (!local_plan.empty())
             pruneLocalPlan(global_pose, local_plan);
         // Publish information to the visualizer
+        MPNET_TRACE_SPAN("publish");
         base_local_planner::publishPlan(transformed_plan, g_plan_pub_);
         base_local_planner::publishPlan(local_plan, l_plan_pub_);
+        publishCompactPlan(local_plan);
         // Publish Polygon
         geometry_msgs::Polygon fp_poly;
         for(unsigned int i=0; i<goal_region_footprint.size(); i++)
@@ -387,6 +529,133 @@ namespace mpnet_local_planner{
         }
     }
 
+    void MpnetLocalPlanner::publishCompactPlan(const std::vector<geometry_msgs::PoseStamped>& plan)
+    {
+        // A new message each time, the publisher and the in process controller
+        // share it without copying.
+        mpnet_plan::LocalPlanPtr compact_plan(new mpnet_plan::LocalPlan);
+        compact_plan->header.frame_id = global_frame_;
+        compact_plan->header.stamp = ros::Time::now();
+        compact_plan->ds = compact_plan_ds;
+        resamplePlan(plan, compact_plan_ds, *compact_plan);
+        l_plan_compact_pub_.publish(compact_plan);
+        if (controller_runner_)
+            controller_runner_->setPlan(compact_plan);
+    }
+
+    void MpnetLocalPlanner::publishMetrics(const ros::TimerEvent& event)
+    {
+        PlannerMetrics& metrics = tc_->getMetrics();
+        diagnostic_msgs::DiagnosticStatus& status = diagnostics_msg_.status[0];
+        status.values.clear();
+        PlannerMetrics::Summary summary;
+        for (int i = 0; i <= PlannerMetrics::NUM_STAGES; i++)
+        {
+            // Times in ms, the collision checks are counts
+            double scale = 1e3;
+            std::string name;
+            if (i < PlannerMetrics::NUM_STAGES)
+            {
+                metrics.summary((PlannerMetrics::Stage)i, summary);
+                name = PlannerMetrics::stageName((PlannerMetrics::Stage)i);
+            }
+            else
+            {
+                metrics.planChecks(summary);
+                summary.calls = metrics.getCollisionChecks();
+                name = "collision_checks";
+                scale = 1;
+            }
+            double* row = &metrics_msg_.data[i * 5];
+            row[0] = summary.p50 * scale;
+            row[1] = summary.p95 * scale;
+            row[2] = summary.p99 * scale;
+            row[3] = summary.max * scale;
+            row[4] = summary.calls;
+
+            diagnostic_msgs::KeyValue value;
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer), "p50 %.3g p95 %.3g p99 %.3g max %.3g calls %lu", row[0], row[1], row[2], row[3], summary.calls);
+            value.key = name;
+            value.value = buffer;
+            status.values.push_back(value);
+        }
+        diagnostic_msgs::KeyValue overhead;
+        overhead.key = "timer_overhead_ns";
+        overhead.value = std::to_string(metrics.getTimerOverhead() * 1e9);
+        status.values.push_back(overhead);
+
+        // Each hit saves the median network plan less the median library
+        // attempt, the attempts that missed count in that median too
+        const PathLibrary* library = tc_->getPathLibrary();
+        if (library!=NULL)
+        {
+            PlannerMetrics::Summary mpnet, from_library;
+            metrics.summary(PlannerMetrics::MPNET, mpnet);
+            metrics.summary(PlannerMetrics::LIBRARY, from_library);
+            unsigned long lookups = library->getLookups(), hits = library->getHits();
+            diagnostic_msgs::KeyValue value;
+            char buffer[160];
+            snprintf(buffer, sizeof(buffer), "paths %zu lookups %lu hits %lu hit_rate %.3f saved_ms %.1f",
+                library->size(), lookups, hits, lookups>0 ? (double)hits/lookups : 0.0,
+                std::max(0.0, hits * (mpnet.p50 - from_library.p50) * 1e3));
+            value.key = "path_library";
+            value.value = buffer;
+            status.values.push_back(value);
+        }
+
+        // Warn when the slowest cycles overrun max_cycle_time
+        PlannerMetrics::Summary cycle;
+        metrics.summary(PlannerMetrics::CYCLE, cycle);
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "OK";
+        if (max_cycle_time_ > 0 && cycle.p99 > max_cycle_time_)
+        {
+            status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            status.message = "Slow planning cycles";
+        }
+        diagnostics_msg_.header.stamp = ros::Time::now();
+        metrics_pub_.publish(metrics_msg_);
+        diagnostics_pub_.publish(diagnostics_msg_);
+    }
+
+    void MpnetLocalPlanner::applyBudget()
+    {
+        const PlanningBudget::Settings& settings = budget_->getSettings();
+        tc_->setBudget(settings);
+        plan_freq = settings.replanning_freq;
+
+        budget_msg_.data[0] = settings.num_samples;
+        budget_msg_.data[1] = settings.num_paths;
+        budget_msg_.data[2] = settings.simplify_time;
+        budget_msg_.data[3] = settings.replanning_freq;
+        budget_msg_.data[4] = budget_->getPlanTime();
+        budget_msg_.data[5] = budget_->getSuccessRate();
+        budget_msg_.data[6] = budget_->getTargetPlanTime();
+        budget_pub_.publish(budget_msg_);
+        ROS_INFO("Planning budget: %d samples, %d paths, %.3f s simplification, replanning every %d cycles (p95 plan time %.3f s, success %.2f)",
+            settings.num_samples, settings.num_paths, settings.simplify_time, settings.replanning_freq,
+            budget_->getPlanTime(), budget_->getSuccessRate());
+    }
+
+    bool MpnetLocalPlanner::dumpTrace(std_srvs::Trigger::Request& request, std_srvs::Trigger::Response& response)
+    {
+        response.success = TraceRecorder::dump(trace_file_);
+        response.message = trace_file_;
+        return true;
+    }
+
+    void MpnetLocalPlanner::pollTraceDump(const ros::TimerEvent& event)
+    {
+        if (TraceRecorder::dumpRequested())
+        {
+            std_srvs::Trigger::Request request;
+            std_srvs::Trigger::Response response;
+            dumpTrace(request, response);
+            ROS_INFO("Wrote the trace to %s", trace_file_.c_str());
+        }
+    }
+
     void MpnetLocalPlanner::resetLog(){
         dynmpnet_num = 0;
         rrtstar_num = 0;
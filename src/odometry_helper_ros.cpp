@@ -38,6 +38,7 @@
 #include <tf2/LinearMath/Quaternion.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 #include <tf2/convert.h>
+#include <tf2/utils.h>
 
 namespace mpnet_local_planner {
 
@@ -48,20 +49,34 @@ OdometryHelperRos::OdometryHelperRos(std::string odom_topic) {
 void OdometryHelperRos::odomCallback(const nav_msgs::Odometry::ConstPtr& msg) {
     ROS_INFO_ONCE("odom received!");
 
-  //we assume that the odometry is published in the frame of the base
-  boost::mutex::scoped_lock lock(odom_mutex_);
-  base_odom_.pose.pose.position.x = msg->pose.pose.position.x;
-  base_odom_.pose.pose.position.y = msg->pose.pose.position.y;
-  base_odom_.pose.pose.position.z = msg->pose.pose.position.z;
+  {
+    //we assume that the odometry is published in the frame of the base
+    boost::mutex::scoped_lock lock(odom_mutex_);
+    base_odom_.header = msg->header;
+    base_odom_.pose.pose.position.x = msg->pose.pose.position.x;
+    base_odom_.pose.pose.position.y = msg->pose.pose.position.y;
+    base_odom_.pose.pose.position.z = msg->pose.pose.position.z;
 
-  base_odom_.pose.pose.orientation = msg->pose.pose.orientation;
+    base_odom_.pose.pose.orientation = msg->pose.pose.orientation;
 
-  base_odom_.twist.twist.linear.x = msg->twist.twist.linear.x;
-  base_odom_.twist.twist.linear.y = msg->twist.twist.linear.y;
-  base_odom_.twist.twist.angular.z = msg->twist.twist.angular.z;
-  base_odom_.child_frame_id = msg->child_frame_id;
+    base_odom_.twist.twist.linear.x = msg->twist.twist.linear.x;
+    base_odom_.twist.twist.linear.y = msg->twist.twist.linear.y;
+    base_odom_.twist.twist.angular.z = msg->twist.twist.angular.z;
+    base_odom_.child_frame_id = msg->child_frame_id;
 //  ROS_DEBUG_NAMED("dwa_local_planner", "In the odometry callback with velocity values: (%.2f, %.2f, %.2f)",
 //      base_odom_.twist.twist.linear.x, base_odom_.twist.twist.linear.y, base_odom_.twist.twist.angular.z);
+  }
+  OdomSnapshot snapshot;
+  snapshot.x = msg->pose.pose.position.x;
+  snapshot.y = msg->pose.pose.position.y;
+  snapshot.yaw = tf2::getYaw(msg->pose.pose.orientation);
+  snapshot.vx = msg->twist.twist.linear.x;
+  snapshot.vy = msg->twist.twist.linear.y;
+  snapshot.wz = msg->twist.twist.angular.z;
+  snapshot.stamp = msg->header.stamp.toSec();
+  snapshot_.store(snapshot);
+  if (odom_callback_)
+    odom_callback_(msg);
 }
 
 //copy over the odometry information
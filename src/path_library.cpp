@@ -0,0 +1,417 @@
+#include <path_library.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mpnet_local_planner{
+
+    namespace{
+        // A library is a file header followed by capacity slots. Each slot
+        // is a Slot followed by max_poses poses as x, y, yaw doubles. A slot
+        // is written with its size at 0 and the size is set last, so a crash
+        // while writing leaves an empty slot. Numbers are in the byte order
+        // of the machine that wrote them.
+        const char file_magic[8] = {'M', 'P', 'N', 'E', 'T', 'P', 'L', 'B'};
+        const uint32_t file_version = 1;
+
+        struct FileHeader{
+            char magic[8];
+            uint32_t version;
+            uint32_t max_poses;
+            uint64_t capacity;
+            uint64_t hand; /** @brief The next slot the clock looks at */
+        };
+
+        struct Slot{
+            uint32_t size; /** @brief The number of poses, 0 for an empty slot */
+            uint32_t used; /** @brief Set when a match of the slot is used, cleared by the clock */
+            double length; /** @brief Of the path (m) */
+
+            double* poses()
+            {
+                return reinterpret_cast<double*>(this + 1);
+            }
+        };
+
+        size_t slotBytes(uint32_t max_poses)
+        {
+            return sizeof(Slot) + (size_t)max_poses * 3 * sizeof(double);
+        }
+
+        FileHeader* header(char* data)
+        {
+            return reinterpret_cast<FileHeader*>(data);
+        }
+
+        Slot* slot(char* data, uint64_t index)
+        {
+            return reinterpret_cast<Slot*>(data + sizeof(FileHeader) + index * slotBytes(header(data)->max_poses));
+        }
+
+        double yawError(double a, double b)
+        {
+            return std::fabs(std::remainder(a - b, 2 * M_PI));
+        }
+
+        /**
+         * @brief A candidate of find(), before its poses are copied
+         */
+        struct Candidate{
+            bool operator<(const Candidate& other) const
+            {
+                return distance < other.distance;
+            }
+
+            double distance;
+            uint64_t slot;
+            uint32_t first, last;
+        };
+    }
+
+    PathLibrary::PathLibrary(double radius, double yaw_tolerance):
+    radius_(radius),
+    yaw_tolerance_(yaw_tolerance),
+    cell_size_(std::max(radius, 0.01)),
+    data_(NULL),
+    length_(0),
+    lookup_(0),
+    paths_(0),
+    lookups_(0),
+    hits_(0)
+    {
+    }
+
+    PathLibrary::~PathLibrary()
+    {
+        close();
+    }
+
+    void PathLibrary::close()
+    {
+        if (data_ != NULL)
+        {
+            msync(data_, length_, MS_SYNC);
+            munmap(data_, length_);
+        }
+        data_ = NULL;
+        length_ = 0;
+        grid_.clear();
+        visited_.clear();
+        paths_ = 0;
+    }
+
+    bool PathLibrary::open(const std::string& file_name, size_t capacity, size_t max_poses)
+    {
+        close();
+        int fd = ::open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            std::cerr << file_name << ": could not open" << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            std::cerr << file_name << ": could not stat" << std::endl;
+            ::close(fd);
+            return false;
+        }
+        bool created = st.st_size == 0;
+        if (created)
+        {
+            // The slots of a new file read as zeros, so empty
+            capacity = std::max<size_t>(capacity, 1);
+            max_poses = std::max<size_t>(max_poses, 2);
+            st.st_size = sizeof(FileHeader) + capacity * slotBytes(max_poses);
+            if (ftruncate(fd, st.st_size) != 0)
+            {
+                std::cerr << file_name << ": could not grow to " << st.st_size << " bytes" << std::endl;
+                ::close(fd);
+                return false;
+            }
+        }
+        else if ((size_t)st.st_size < sizeof(FileHeader))
+        {
+            std::cerr << file_name << ": not a path library" << std::endl;
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            std::cerr << file_name << ": could not map" << std::endl;
+            return false;
+        }
+        data_ = static_cast<char*>(data);
+        length_ = st.st_size;
+
+        FileHeader* head = header(data_);
+        if (created)
+        {
+            std::memcpy(head->magic, file_magic, sizeof(file_magic));
+            head->version = file_version;
+            head->max_poses = max_poses;
+            head->capacity = capacity;
+            head->hand = 0;
+        }
+        else if (std::memcmp(head->magic, file_magic, sizeof(file_magic)) != 0 || head->version != file_version
+            || head->max_poses < 2 || head->capacity == 0
+            || length_ != sizeof(FileHeader) + head->capacity * slotBytes(head->max_poses))
+        {
+            std::cerr << file_name << ": not a version " << file_version << " path library" << std::endl;
+            close();
+            return false;
+        }
+
+        visited_.assign(head->capacity, 0);
+        size_t paths = 0;
+        for (uint64_t s = 0; s < head->capacity; s++)
+        {
+            Slot* stored = slot(data_, s);
+            if (stored->size > head->max_poses)
+                stored->size = 0;
+            if (stored->size < 2)
+                continue;
+            index(s);
+            paths++;
+        }
+        paths_ = paths;
+        return true;
+    }
+
+    int64_t PathLibrary::cellKey(double x, double y) const
+    {
+        int64_t cx = (int64_t)std::floor(x / cell_size_);
+        int64_t cy = (int64_t)std::floor(y / cell_size_);
+        return (cx << 32) ^ (cy & 0xffffffff);
+    }
+
+    void PathLibrary::cellsOf(uint64_t s, std::vector<int64_t>& cells) const
+    {
+        cells.clear();
+        Slot* stored = slot(data_, s);
+        const double* poses = stored->poses();
+        for (uint32_t i = 0; i < stored->size; i++)
+            cells.push_back(cellKey(poses[3 * i], poses[3 * i + 1]));
+        std::sort(cells.begin(), cells.end());
+        cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    }
+
+    void PathLibrary::index(uint64_t s)
+    {
+        cellsOf(s, cells_);
+        for (size_t i = 0; i < cells_.size(); i++)
+            grid_[cells_[i]].push_back(s);
+    }
+
+    void PathLibrary::unindex(uint64_t s)
+    {
+        cellsOf(s, cells_);
+        for (size_t i = 0; i < cells_.size(); i++)
+        {
+            std::unordered_map<int64_t, std::vector<uint64_t> >::iterator cell = grid_.find(cells_[i]);
+            if (cell == grid_.end())
+                continue;
+            std::vector<uint64_t>& slots = cell->second;
+            std::vector<uint64_t>::iterator it = std::find(slots.begin(), slots.end(), s);
+            if (it != slots.end())
+            {
+                *it = slots.back();
+                slots.pop_back();
+            }
+            if (slots.empty())
+                grid_.erase(cell);
+        }
+    }
+
+    size_t PathLibrary::find(const SE2Pose& start, const SE2Pose& goal, size_t max_matches, std::vector<Match>& matches)
+    {
+        matches.clear();
+        if (data_ == NULL)
+            return 0;
+        lookups_.fetch_add(1, std::memory_order_relaxed);
+        lookup_++;
+
+        // A pose within the radius of the start is in the 3x3 cells around it
+        std::vector<Candidate> candidates;
+        int64_t cx = (int64_t)std::floor(start.x / cell_size_);
+        int64_t cy = (int64_t)std::floor(start.y / cell_size_);
+        for (int64_t dx = -1; dx <= 1; dx++)
+        {
+            for (int64_t dy = -1; dy <= 1; dy++)
+            {
+                std::unordered_map<int64_t, std::vector<uint64_t> >::const_iterator cell =
+                    grid_.find(((cx + dx) << 32) ^ ((cy + dy) & 0xffffffff));
+                if (cell == grid_.end())
+                    continue;
+                for (size_t k = 0; k < cell->second.size(); k++)
+                {
+                    uint64_t s = cell->second[k];
+                    if (visited_[s] == lookup_)
+                        continue;
+                    visited_[s] = lookup_;
+
+                    Slot& stored = *slot(data_, s);
+                    const double* poses = stored.poses();
+                    Candidate candidate;
+                    candidate.slot = s;
+                    double start_distance = radius_, goal_distance = radius_;
+                    bool near_start = false, near_goal = false;
+                    for (uint32_t i = 0; i < stored.size; i++)
+                    {
+                        const double* pose = poses + 3 * i;
+                        double d = std::hypot(pose[0] - start.x, pose[1] - start.y);
+                        if (d <= start_distance && yawError(pose[2], start.yaw) <= yaw_tolerance_)
+                        {
+                            start_distance = d;
+                            candidate.first = i;
+                            near_start = true;
+                        }
+                    }
+                    if (!near_start)
+                        continue;
+                    for (uint32_t i = candidate.first + 1; i < stored.size; i++)
+                    {
+                        const double* pose = poses + 3 * i;
+                        double d = std::hypot(pose[0] - goal.x, pose[1] - goal.y);
+                        if (d <= goal_distance && yawError(pose[2], goal.yaw) <= yaw_tolerance_)
+                        {
+                            goal_distance = d;
+                            candidate.last = i;
+                            near_goal = true;
+                        }
+                    }
+                    if (!near_goal)
+                        continue;
+                    candidate.distance = start_distance + goal_distance;
+                    candidates.push_back(candidate);
+                }
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+        candidates.resize(std::min(candidates.size(), max_matches));
+        matches.resize(candidates.size());
+        for (size_t m = 0; m < candidates.size(); m++)
+        {
+            const Candidate& candidate = candidates[m];
+            const double* poses = slot(data_, candidate.slot)->poses();
+            Match& match = matches[m];
+            match.slot = candidate.slot;
+            match.distance = candidate.distance;
+            match.poses.clear();
+            for (uint32_t i = candidate.first; i <= candidate.last; i++)
+                match.poses.push_back(SE2Pose(poses[3 * i], poses[3 * i + 1], poses[3 * i + 2]));
+        }
+        return matches.size();
+    }
+
+    void PathLibrary::markUsed(uint64_t s)
+    {
+        if (data_ == NULL || s >= header(data_)->capacity)
+            return;
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        slot(data_, s)->used = 1;
+    }
+
+    bool PathLibrary::add(const std::vector<SE2Pose>& path)
+    {
+        if (data_ == NULL || path.size() < 2)
+            return false;
+        FileHeader* head = header(data_);
+        const SE2Pose& first = path.front();
+        const SE2Pose& last = path.back();
+
+        // A path with about the same ends replaces the stored one, so a
+        // route driven again stays one path that follows the latest map. A
+        // stored first pose within the radius is in the 3x3 cells around it.
+        bool found = false;
+        uint64_t target = 0;
+        double best = 2 * radius_;
+        int64_t cx = (int64_t)std::floor(first.x / cell_size_);
+        int64_t cy = (int64_t)std::floor(first.y / cell_size_);
+        for (int64_t dx = -1; dx <= 1; dx++)
+        {
+            for (int64_t dy = -1; dy <= 1; dy++)
+            {
+                std::unordered_map<int64_t, std::vector<uint64_t> >::const_iterator cell =
+                    grid_.find(((cx + dx) << 32) ^ ((cy + dy) & 0xffffffff));
+                if (cell == grid_.end())
+                    continue;
+                for (size_t k = 0; k < cell->second.size(); k++)
+                {
+                    Slot& stored = *slot(data_, cell->second[k]);
+                    const double* front = stored.poses();
+                    const double* back = front + 3 * (stored.size - 1);
+                    double d = std::hypot(front[0] - first.x, front[1] - first.y) + std::hypot(back[0] - last.x, back[1] - last.y);
+                    if (d <= best && yawError(front[2], first.yaw) <= yaw_tolerance_ && yawError(back[2], last.yaw) <= yaw_tolerance_)
+                    {
+                        best = d;
+                        target = cell->second[k];
+                        found = true;
+                    }
+                }
+            }
+        }
+
+        // Else the clock takes the first empty or unused slot, clearing the
+        // used flags it passes
+        if (!found)
+        {
+            for (uint64_t step = 0; step <= head->capacity; step++)
+            {
+                target = head->hand;
+                head->hand = (head->hand + 1) % head->capacity;
+                Slot* candidate = slot(data_, target);
+                if (candidate->size == 0 || candidate->used == 0)
+                    break;
+                candidate->used = 0;
+            }
+            slot(data_, target)->used = 0;
+        }
+        store(target, path);
+        return true;
+    }
+
+    bool PathLibrary::replace(uint64_t slot_index, const std::vector<SE2Pose>& path)
+    {
+        if (data_ == NULL || path.size() < 2 || slot_index >= header(data_)->capacity)
+            return false;
+        store(slot_index, path);
+        return true;
+    }
+
+    void PathLibrary::store(uint64_t target, const std::vector<SE2Pose>& path)
+    {
+        FileHeader* head = header(data_);
+        Slot* stored = slot(data_, target);
+        if (stored->size != 0)
+            unindex(target);
+        else
+            paths_.fetch_add(1, std::memory_order_relaxed);
+        stored->size = 0;
+
+        // Subsample a long path evenly, keeping both ends
+        uint32_t size = std::min<size_t>(path.size(), head->max_poses);
+        double* poses = stored->poses();
+        double length = 0;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            const SE2Pose& pose = path[size == path.size() ? i : (size_t)std::round((double)i * (path.size() - 1) / (size - 1))];
+            poses[3 * i] = pose.x;
+            poses[3 * i + 1] = pose.y;
+            poses[3 * i + 2] = pose.yaw;
+            if (i > 0)
+                length += std::hypot(pose.x - poses[3 * i - 3], pose.y - poses[3 * i - 2]);
+        }
+        stored->length = length;
+        stored->size = size;
+        index(target);
+    }
+}
@@ -0,0 +1,61 @@
+#include <planner_metrics.h>
+
+namespace mpnet_local_planner{
+
+    PlannerMetrics::PlannerMetrics(size_t window):
+    stages_(NUM_STAGES, LatencyStats(window)),
+    plan_checks_(window),
+    collision_checks_(0),
+    timer_overhead_(0)
+    {
+        // Time a batch of timers on a stage that is reset after, so the
+        // published overhead is what this machine pays per timed scope
+        const int n = 1000;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; i++)
+            ScopedTimer timer(*this, CYCLE);
+        timer_overhead_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / n;
+        stages_[CYCLE] = LatencyStats(window);
+    }
+
+    const char* PlannerMetrics::stageName(Stage stage)
+    {
+        static const char* names[NUM_STAGES] = {
+            "snapshot", "costmap_copy", "inference", "path_check", "simplify",
+            "interpolate", "mpnet", "rrt_star", "library", "cycle"};
+        return names[stage];
+    }
+
+    void PlannerMetrics::record(Stage stage, double seconds)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stages_[stage].add(seconds);
+    }
+
+    void PlannerMetrics::recordPlanChecks(unsigned long checks)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        plan_checks_.add(checks);
+    }
+
+    void PlannerMetrics::summarize(LatencyStats& stats, Summary& out)
+    {
+        out.p50 = stats.percentile(50);
+        out.p95 = stats.percentile(95);
+        out.p99 = stats.percentile(99);
+        out.max = stats.max();
+        out.calls = stats.total();
+    }
+
+    void PlannerMetrics::summary(Stage stage, Summary& out)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        summarize(stages_[stage], out);
+    }
+
+    void PlannerMetrics::planChecks(Summary& out)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        summarize(plan_checks_, out);
+    }
+}
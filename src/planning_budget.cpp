@@ -0,0 +1,117 @@
+#include <planning_budget.h>
+#include <algorithm>
+#include <cmath>
+
+namespace mpnet_local_planner{
+
+    namespace{
+        // Simplifying takes a large share of the plans above this
+        const double large_simplify_share = 0.3;
+
+        template <typename T>
+        T clamp(T value, T low, T high)
+        {
+            return std::max(low, std::min(high, value));
+        }
+    }
+
+    PlanningBudget::PlanningBudget(const Settings& initial, const Settings& min, const Settings& max,
+        double target_plan_time, int window, double success_target, double headroom):
+    min_(min),
+    max_(max),
+    target_plan_time_(target_plan_time),
+    success_target_(success_target),
+    headroom_(headroom),
+    window_(std::max(1, window)),
+    plan_times_(std::max(1, window)),
+    plans_(0),
+    successes_(0),
+    plan_time_sum_(0),
+    simplify_time_sum_(0),
+    plan_time_(0),
+    success_rate_(0)
+    {
+        settings_.num_samples = clamp(initial.num_samples, min.num_samples, max.num_samples);
+        settings_.num_paths = clamp(initial.num_paths, min.num_paths, max.num_paths);
+        settings_.simplify_time = clamp(initial.simplify_time, min.simplify_time, max.simplify_time);
+        settings_.replanning_freq = clamp(initial.replanning_freq, min.replanning_freq, max.replanning_freq);
+    }
+
+    bool PlanningBudget::addPlan(double plan_time, double simplify_time, bool success)
+    {
+        plan_times_.add(plan_time);
+        plan_time_sum_ += plan_time;
+        simplify_time_sum_ += simplify_time;
+        successes_ += success;
+        if (++plans_ < window_)
+            return false;
+
+        plan_time_ = plan_times_.percentile(95);
+        success_rate_ = (double)successes_ / plans_;
+        double simplify_share = plan_time_sum_ > 0 ? simplify_time_sum_ / plan_time_sum_ : 0;
+        plans_ = successes_ = 0;
+        plan_time_sum_ = simplify_time_sum_ = 0;
+        return adjust(simplify_share);
+    }
+
+    bool PlanningBudget::adjust(double simplify_share)
+    {
+        Settings& s = settings_;
+        if (plan_time_ > target_plan_time_)
+        {
+            if (simplify_share > large_simplify_share && s.simplify_time > min_.simplify_time)
+            {
+                s.simplify_time = std::max(min_.simplify_time, s.simplify_time / 2);
+                return true;
+            }
+            // The rollouts take most of a failing plan, scale them down with the overrun
+            if (s.num_paths > min_.num_paths)
+            {
+                int num_paths = (int)(s.num_paths * target_plan_time_ / plan_time_);
+                s.num_paths = clamp(num_paths, min_.num_paths, s.num_paths - 1);
+                return true;
+            }
+            if (s.num_samples > min_.num_samples)
+            {
+                s.num_samples--;
+                return true;
+            }
+            if (s.replanning_freq < max_.replanning_freq)
+            {
+                s.replanning_freq++;
+                return true;
+            }
+            return false;
+        }
+
+        if (plan_time_ < headroom_ * target_plan_time_)
+        {
+            if (s.replanning_freq > min_.replanning_freq)
+            {
+                s.replanning_freq--;
+                return true;
+            }
+            if (success_rate_ < success_target_ && s.num_paths < max_.num_paths)
+            {
+                s.num_paths++;
+                return true;
+            }
+            if (s.num_samples < max_.num_samples)
+            {
+                s.num_samples++;
+                return true;
+            }
+            if (s.num_paths < max_.num_paths)
+            {
+                s.num_paths++;
+                return true;
+            }
+            if (s.simplify_time < max_.simplify_time)
+            {
+                s.simplify_time = std::min(max_.simplify_time, s.simplify_time * 2);
+                return true;
+            }
+        }
+        return false;
+    }
+}
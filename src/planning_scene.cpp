@@ -0,0 +1,185 @@
+#include <planning_scene.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <boost/filesystem.hpp>
+
+namespace mpnet_local_planner{
+
+    PlanningScene::PlanningScene():
+    size_x(0),
+    size_y(0),
+    resolution(0),
+    origin_x(0),
+    origin_y(0)
+    {
+    }
+
+    PlanningScene::PlanningScene(unsigned int size_x, unsigned int size_y, double resolution, double origin_x, double origin_y):
+    size_x(size_x),
+    size_y(size_y),
+    resolution(resolution),
+    origin_x(origin_x),
+    origin_y(origin_y),
+    cells(size_x * size_y, FREE_SPACE)
+    {
+    }
+
+    std::vector<double> PlanningScene::bounds() const
+    {
+        return std::vector<double>{size_x * resolution, size_y * resolution, M_PI};
+    }
+
+    void PlanningScene::inflate(double inscribed_radius, double inflation_radius, double cost_scaling_factor)
+    {
+        std::vector<unsigned char> lethal(cells.size());
+        for (size_t i = 0; i < cells.size(); i++)
+            lethal[i] = cells[i] == LETHAL_OBSTACLE;
+
+        // The distance to the nearest obstacle within the inflation radius
+        int reach = (int)std::ceil(inflation_radius / resolution);
+        for (int y = 0; y < (int)size_y; y++)
+        {
+            for (int x = 0; x < (int)size_x; x++)
+            {
+                unsigned char& cost = cells[y * size_x + x];
+                if (lethal[y * size_x + x] || cost == NO_INFORMATION)
+                    continue;
+                double distance = inflation_radius + 1;
+                for (int j = std::max(0, y - reach); j <= std::min((int)size_y - 1, y + reach); j++)
+                    for (int i = std::max(0, x - reach); i <= std::min((int)size_x - 1, x + reach); i++)
+                        if (lethal[j * size_x + i])
+                            distance = std::min(distance, std::hypot(i - x, j - y) * resolution);
+                unsigned char inflated = FREE_SPACE;
+                if (distance <= inscribed_radius)
+                    inflated = INSCRIBED_INFLATED_OBSTACLE;
+                else if (distance <= inflation_radius)
+                    inflated = (unsigned char)((INSCRIBED_INFLATED_OBSTACLE - 1) * std::exp(-cost_scaling_factor * (distance - inscribed_radius)));
+                cost = std::max(cost, inflated);
+            }
+        }
+    }
+
+    bool PlanningScene::load(const std::string& file_name)
+    {
+        std::ifstream file(file_name.c_str());
+        if (!file)
+        {
+            std::cerr << file_name << ": could not open" << std::endl;
+            return false;
+        }
+        std::string key;
+        int format = 0;
+        if (!(file >> key >> format) || key != "mpnet_scene" || format != 1)
+        {
+            std::cerr << file_name << ": not a version 1 scene" << std::endl;
+            return false;
+        }
+
+        name.clear();
+        queries.clear();
+        cells.clear();
+        size_x = size_y = 0;
+        while (file >> key)
+        {
+            if (key == "name")
+            {
+                file >> name;
+            }
+            else if (key == "costmap")
+            {
+                file >> size_x >> size_y >> resolution >> origin_x >> origin_y;
+            }
+            else if (key == "query")
+            {
+                PlanningQuery query;
+                file >> query.start.x >> query.start.y >> query.start.yaw >> query.goal.x >> query.goal.y >> query.goal.yaw;
+                queries.push_back(query);
+            }
+            else if (key == "cells")
+            {
+                if (size_x == 0 || size_y == 0)
+                    break;
+                cells.resize(size_x * size_y);
+                for (size_t i = 0; i < cells.size(); i++)
+                {
+                    unsigned int cost;
+                    if (!(file >> cost) || cost > 255)
+                    {
+                        std::cerr << file_name << ": bad cell " << i << std::endl;
+                        return false;
+                    }
+                    cells[i] = (unsigned char)cost;
+                }
+                break;
+            }
+            else
+            {
+                std::cerr << file_name << ": unknown key " << key << std::endl;
+                return false;
+            }
+            if (!file)
+            {
+                std::cerr << file_name << ": bad " << key << " line" << std::endl;
+                return false;
+            }
+        }
+        if (cells.empty())
+        {
+            std::cerr << file_name << ": no costmap cells" << std::endl;
+            return false;
+        }
+        if (name.empty())
+            name = file_name;
+        return true;
+    }
+
+    bool PlanningScene::loadAll(const std::string& path, std::vector<PlanningScene>& scenes)
+    {
+        std::vector<std::string> files;
+        if (boost::filesystem::is_directory(path))
+        {
+            for (boost::filesystem::directory_iterator it(path), end; it != end; ++it)
+                if (it->path().extension() == ".scene")
+                    files.push_back(it->path().string());
+            std::sort(files.begin(), files.end());
+        }
+        else
+            files.push_back(path);
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            scenes.push_back(PlanningScene());
+            if (!scenes.back().load(files[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool PlanningScene::save(const std::string& file_name) const
+    {
+        std::ofstream file(file_name.c_str());
+        if (!file)
+            return false;
+        file << std::setprecision(9);
+        file << "mpnet_scene 1\n";
+        if (!name.empty())
+            file << "name " << name << "\n";
+        file << "costmap " << size_x << " " << size_y << " " << resolution << " " << origin_x << " " << origin_y << "\n";
+        for (size_t i = 0; i < queries.size(); i++)
+        {
+            const PlanningQuery& q = queries[i];
+            file << "query " << q.start.x << " " << q.start.y << " " << q.start.yaw << " "
+                 << q.goal.x << " " << q.goal.y << " " << q.goal.yaw << "\n";
+        }
+        file << "cells\n";
+        for (unsigned int y = 0; y < size_y; y++)
+        {
+            for (unsigned int x = 0; x < size_x; x++)
+                file << (x == 0 ? "" : " ") << (unsigned int)cells[y * size_x + x];
+            file << "\n";
+        }
+        return (bool)file;
+    }
+}
@@ -0,0 +1,396 @@
+#include <query_log.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mpnet_local_planner{
+
+    namespace{
+        // A log is a file header followed by records. Each record is a
+        // RecordHeader, the footprint and path as doubles, then the cells of
+        // the costmap and of the fallback, padded to 8 bytes so every header
+        // of a mapped log is aligned. Numbers are in the byte order of the
+        // machine that wrote them.
+        const char file_magic[8] = {'M', 'P', 'N', 'E', 'T', 'Q', 'L', 'G'};
+        const uint32_t file_version = 2;
+        const uint32_t record_magic = 0x5251504d; // "MPQR"
+
+        struct FileHeader{
+            char magic[8];
+            uint32_t version;
+            uint32_t reserved;
+        };
+
+        struct CostmapHeader{
+            uint32_t size_x, size_y;
+            double resolution, origin_x, origin_y;
+        };
+
+        struct RecordHeader{
+            uint32_t magic;
+            uint32_t size; /** @brief Of the whole record */
+            uint64_t sequence;
+            double stamp;
+            int32_t planner;
+            int32_t success;
+            double start[3], goal[3], bounds[3];
+            double xy_tolerance, yaw_tolerance;
+            int32_t num_samples, num_paths;
+            uint64_t seed;
+            double simplify_time;
+            double cost, plan_time;
+            uint64_t collision_checks;
+            uint32_t num_bounds, footprint_size;
+            uint32_t path_size, reserved;
+            CostmapHeader costmap, fallback;
+        };
+
+        size_t cellCount(const CostmapView& costmap)
+        {
+            return costmap.empty() ? 0 : (size_t)costmap.size_x * costmap.size_y;
+        }
+
+        size_t payloadSize(const RecordHeader& header)
+        {
+            return header.footprint_size * 2 * sizeof(double) + header.path_size * 3 * sizeof(double)
+                + (size_t)header.costmap.size_x * header.costmap.size_y + (size_t)header.fallback.size_x * header.fallback.size_y;
+        }
+
+        void writeCostmap(const CostmapView& costmap, CostmapHeader& header)
+        {
+            header.size_x = costmap.empty() ? 0 : costmap.size_x;
+            header.size_y = costmap.empty() ? 0 : costmap.size_y;
+            header.resolution = costmap.resolution;
+            header.origin_x = costmap.origin_x;
+            header.origin_y = costmap.origin_y;
+        }
+
+        CostmapView readCostmap(const CostmapHeader& header, const char* cells)
+        {
+            if (header.size_x == 0 || header.size_y == 0)
+                return CostmapView();
+            return CostmapView(header.size_x, header.size_y, header.resolution, header.origin_x, header.origin_y,
+                reinterpret_cast<const unsigned char*>(cells));
+        }
+    }
+
+    PlanningScene PlanningRecord::toScene(const std::string& name) const
+    {
+        PlanningScene scene(costmap.size_x, costmap.size_y, costmap.resolution, costmap.origin_x, costmap.origin_y);
+        scene.name = name;
+        if (!costmap.empty())
+            scene.cells.assign(costmap.data, costmap.data + cellCount(costmap));
+        scene.queries.push_back(PlanningQuery(start, goal));
+        return scene;
+    }
+
+    QueryRecorder::QueryRecorder(const std::string& file_name, size_t buffers):
+    file_(NULL),
+    buffers_(buffers),
+    sequence_(0),
+    dropped_(0),
+    written_(0),
+    failed_(0),
+    stop_(false),
+    error_(false)
+    {
+        // Cut a record left short by a crash, or the records appended now
+        // would be lost behind it
+        struct stat st;
+        if (stat(file_name.c_str(), &st) == 0 && st.st_size > 0)
+        {
+            QueryLog log;
+            if (!log.open(file_name))
+                return;
+            if (log.getWholeLength() < log.getLength() && truncate(file_name.c_str(), log.getWholeLength()) != 0)
+                return;
+        }
+        file_ = std::fopen(file_name.c_str(), "ab");
+        if (file_ == NULL)
+            return;
+        if (std::ftell(file_) == 0)
+        {
+            FileHeader header;
+            std::memcpy(header.magic, file_magic, sizeof(file_magic));
+            header.version = file_version;
+            header.reserved = 0;
+            if (std::fwrite(&header, sizeof(header), 1, file_) != 1 || std::fflush(file_) != 0)
+            {
+                std::fclose(file_);
+                file_ = NULL;
+                return;
+            }
+        }
+        for (size_t i = 0; i < buffers_.size(); i++)
+            free_.push_back(&buffers_[i]);
+        thread_ = boost::thread(&QueryRecorder::writeLoop, this);
+    }
+
+    QueryRecorder::~QueryRecorder()
+    {
+        if (file_ == NULL)
+            return;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_one();
+        thread_.join();
+        std::fclose(file_);
+    }
+
+    bool QueryRecorder::record(const PlanningRecord& record)
+    {
+        if (file_ == NULL)
+            return false;
+        std::vector<char>* buffer;
+        uint64_t sequence;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            sequence = sequence_++;
+            if (error_)
+            {
+                failed_++;
+                return false;
+            }
+            if (free_.empty())
+            {
+                dropped_++;
+                return false;
+            }
+            buffer = free_.back();
+            free_.pop_back();
+        }
+
+        size_t footprint_bytes = record.footprint.size() * 2 * sizeof(double);
+        size_t path_bytes = record.path.size() * 3 * sizeof(double);
+        size_t costmap_bytes = cellCount(record.costmap);
+        size_t fallback_bytes = cellCount(record.fallback);
+        size_t size = sizeof(RecordHeader) + footprint_bytes + path_bytes + costmap_bytes + fallback_bytes;
+        size = (size + 7) & ~(size_t)7;
+        // Keeps its capacity between records, so this only allocates for the first ones
+        buffer->resize(size);
+
+        RecordHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = record_magic;
+        header.size = size;
+        header.sequence = sequence;
+        header.stamp = record.stamp;
+        header.planner = record.planner;
+        header.success = record.success;
+        header.start[0] = record.start.x;
+        header.start[1] = record.start.y;
+        header.start[2] = record.start.yaw;
+        header.goal[0] = record.goal.x;
+        header.goal[1] = record.goal.y;
+        header.goal[2] = record.goal.yaw;
+        header.num_bounds = std::min<size_t>(record.bounds.size(), 3);
+        for (uint32_t i = 0; i < header.num_bounds; i++)
+            header.bounds[i] = record.bounds[i];
+        header.xy_tolerance = record.xy_tolerance;
+        header.yaw_tolerance = record.yaw_tolerance;
+        header.num_samples = record.num_samples;
+        header.num_paths = record.num_paths;
+        header.seed = record.seed;
+        header.simplify_time = record.simplify_time;
+        header.cost = record.cost;
+        header.plan_time = record.plan_time;
+        header.collision_checks = record.collision_checks;
+        header.footprint_size = record.footprint.size();
+        header.path_size = record.path.size();
+        writeCostmap(record.costmap, header.costmap);
+        writeCostmap(record.fallback, header.fallback);
+
+        char* out = buffer->data();
+        std::memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        double* values = reinterpret_cast<double*>(out);
+        for (size_t i = 0; i < record.footprint.size(); i++)
+        {
+            *values++ = record.footprint[i].x;
+            *values++ = record.footprint[i].y;
+        }
+        for (size_t i = 0; i < record.path.size(); i++)
+        {
+            *values++ = record.path[i].x;
+            *values++ = record.path[i].y;
+            *values++ = record.path[i].yaw;
+        }
+        out = reinterpret_cast<char*>(values);
+        if (costmap_bytes > 0)
+            std::memcpy(out, record.costmap.data, costmap_bytes);
+        out += costmap_bytes;
+        if (fallback_bytes > 0)
+            std::memcpy(out, record.fallback.data, fallback_bytes);
+        out += fallback_bytes;
+        std::memset(out, 0, buffer->data() + size - out);
+
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            pending_.push_back(buffer);
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    unsigned long QueryRecorder::getDropped()
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        return dropped_;
+    }
+
+    unsigned long QueryRecorder::getWritten()
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        return written_;
+    }
+
+    unsigned long QueryRecorder::getFailed()
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        return failed_;
+    }
+
+    void QueryRecorder::writeLoop()
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (true)
+        {
+            while (pending_.empty() && !stop_)
+                cond_.wait(lock);
+            if (pending_.empty())
+                break;
+            std::vector<char>* buffer = pending_.front();
+            pending_.pop_front();
+            lock.unlock();
+            // Whole records only, so a crash leaves at most the last one cut short
+            bool ok = std::fwrite(buffer->data(), 1, buffer->size(), file_) == buffer->size() && std::fflush(file_) == 0;
+            lock.lock();
+            free_.push_back(buffer);
+            if (ok)
+            {
+                written_++;
+                continue;
+            }
+            // A record cut short hides every record after it from QueryLog,
+            // so stop, the waiting records fail too
+            error_ = true;
+            failed_ += 1 + pending_.size();
+            while (!pending_.empty())
+            {
+                free_.push_back(pending_.front());
+                pending_.pop_front();
+            }
+            break;
+        }
+    }
+
+    QueryLog::QueryLog():
+    data_(NULL),
+    length_(0),
+    whole_length_(0)
+    {
+    }
+
+    QueryLog::~QueryLog()
+    {
+        close();
+    }
+
+    void QueryLog::close()
+    {
+        if (data_ != NULL)
+            munmap(const_cast<char*>(data_), length_);
+        data_ = NULL;
+        length_ = 0;
+        whole_length_ = 0;
+        offsets_.clear();
+    }
+
+    bool QueryLog::open(const std::string& file_name)
+    {
+        close();
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << file_name << ": could not open" << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FileHeader))
+        {
+            std::cerr << file_name << ": not a query log" << std::endl;
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            std::cerr << file_name << ": could not map" << std::endl;
+            return false;
+        }
+        data_ = static_cast<const char*>(data);
+        length_ = st.st_size;
+
+        const FileHeader* header = reinterpret_cast<const FileHeader*>(data_);
+        if (std::memcmp(header->magic, file_magic, sizeof(file_magic)) != 0 || header->version != file_version)
+        {
+            std::cerr << file_name << ": not a version " << file_version << " query log" << std::endl;
+            close();
+            return false;
+        }
+        size_t offset = sizeof(FileHeader);
+        while (offset + sizeof(RecordHeader) <= length_)
+        {
+            const RecordHeader* record = reinterpret_cast<const RecordHeader*>(data_ + offset);
+            if (record->magic != record_magic || record->size < sizeof(RecordHeader) + payloadSize(*record) || offset + record->size > length_)
+                break;
+            offsets_.push_back(offset);
+            offset += record->size;
+        }
+        whole_length_ = offset;
+        if (offset != length_)
+            std::cerr << file_name << ": ignoring " << length_ - offset << " bytes after the last whole record" << std::endl;
+        return true;
+    }
+
+    void QueryLog::get(size_t index, PlanningRecord& record) const
+    {
+        const char* in = data_ + offsets_[index];
+        const RecordHeader& header = *reinterpret_cast<const RecordHeader*>(in);
+        record.sequence = header.sequence;
+        record.stamp = header.stamp;
+        record.planner = (PlanningRecord::Planner)header.planner;
+        record.success = header.success != 0;
+        record.start = SE2Pose(header.start[0], header.start[1], header.start[2]);
+        record.goal = SE2Pose(header.goal[0], header.goal[1], header.goal[2]);
+        record.bounds.assign(header.bounds, header.bounds + header.num_bounds);
+        record.xy_tolerance = header.xy_tolerance;
+        record.yaw_tolerance = header.yaw_tolerance;
+        record.num_samples = header.num_samples;
+        record.num_paths = header.num_paths;
+        record.seed = header.seed;
+        record.simplify_time = header.simplify_time;
+        record.cost = header.cost;
+        record.plan_time = header.plan_time;
+        record.collision_checks = header.collision_checks;
+
+        const double* values = reinterpret_cast<const double*>(in + sizeof(RecordHeader));
+        record.footprint.resize(header.footprint_size);
+        for (size_t i = 0; i < record.footprint.size(); i++, values += 2)
+            record.footprint[i] = Point2D(values[0], values[1]);
+        record.path.resize(header.path_size);
+        for (size_t i = 0; i < record.path.size(); i++, values += 3)
+            record.path[i] = SE2Pose(values[0], values[1], values[2]);
+
+        const char* cells = reinterpret_cast<const char*>(values);
+        record.costmap = readCostmap(header.costmap, cells);
+        record.fallback = readCostmap(header.fallback, cells + cellCount(record.costmap));
+    }
+}
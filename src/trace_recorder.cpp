@@ -0,0 +1,181 @@
+#include <trace_recorder.h>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
+#include <boost/thread/mutex.hpp>
+
+namespace mpnet_local_planner{
+
+    namespace{
+        const uint64_t capacity = 1 << 14;
+
+        /**
+         * @brief A span in the ring, as in SeqLock the fields are atomic
+         * words so that dump() copying a slot that is being overwritten is
+         * not a data race
+         */
+        struct Slot{
+            Slot():
+            seq(0),
+            name(NULL),
+            begin_ns(0),
+            duration_ns(0)
+            {
+            }
+
+            std::atomic<uint64_t> seq; /** @brief 2 i + 1 while span i is written, 2 i + 2 once it is complete */
+            std::atomic<const char*> name;
+            std::atomic<uint64_t> begin_ns, duration_ns;
+        };
+
+        /**
+         * @brief The spans of one thread, written only by that thread
+         */
+        struct ThreadBuffer{
+            ThreadBuffer(unsigned int id):
+            id(id),
+            name(NULL),
+            head(0),
+            slots(capacity)
+            {
+            }
+
+            unsigned int id;
+            const char* name;
+            std::atomic<uint64_t> head; /** @brief Number of spans written */
+            std::vector<Slot> slots;
+        };
+
+        // Buffers are kept after their thread exits so that its spans can
+        // still be dumped, there is one per thread that ever traced.
+        boost::mutex registry_mutex;
+        std::vector<ThreadBuffer*> registry;
+        thread_local ThreadBuffer* local_buffer = NULL;
+
+        volatile std::sig_atomic_t dump_requested = 0;
+
+        void requestDump(int /*signum*/)
+        {
+            dump_requested = 1;
+        }
+
+        ThreadBuffer* threadBuffer()
+        {
+            if (local_buffer == NULL)
+            {
+                boost::mutex::scoped_lock lock(registry_mutex);
+                local_buffer = new ThreadBuffer(registry.size() + 1);
+                registry.push_back(local_buffer);
+            }
+            return local_buffer;
+        }
+
+        void writeString(FILE* file, const char* s)
+        {
+            fputc('"', file);
+            for (; *s; s++)
+            {
+                if (*s == '"' || *s == '\\')
+                    fputc('\\', file);
+                fputc(*s, file);
+            }
+            fputc('"', file);
+        }
+    }
+
+    std::atomic<bool> TraceRecorder::enabled_(false);
+
+    uint64_t TraceRecorder::now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void TraceRecorder::record(const char* name, uint64_t begin_ns, uint64_t end_ns)
+    {
+        ThreadBuffer* buffer = threadBuffer();
+        uint64_t head = buffer->head.load(std::memory_order_relaxed);
+        Slot& slot = buffer->slots[head % capacity];
+        slot.seq.store(2 * head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+        slot.duration_ns.store(end_ns - begin_ns, std::memory_order_relaxed);
+        slot.seq.store(2 * head + 2, std::memory_order_release);
+        buffer->head.store(head + 1, std::memory_order_release);
+    }
+
+    void TraceRecorder::setThreadName(const char* name)
+    {
+        ThreadBuffer* buffer = threadBuffer();
+        boost::mutex::scoped_lock lock(registry_mutex);
+        buffer->name = name;
+    }
+
+    bool TraceRecorder::dump(const std::string& path)
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        if (file == NULL)
+            return false;
+        int pid = getpid();
+        std::vector<Event> events;
+        events.reserve(capacity);
+        bool first = true;
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        boost::mutex::scoped_lock lock(registry_mutex);
+        for (size_t b = 0; b < registry.size(); b++)
+        {
+            ThreadBuffer* buffer = registry[b];
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t begin = head > capacity ? head - capacity : 0;
+            events.clear();
+            // The thread keeps recording while it is copied, a span is kept
+            // only if its slot held it, complete, before and after the copy
+            for (uint64_t i = begin; i < head; i++)
+            {
+                const Slot& slot = buffer->slots[i % capacity];
+                Event event;
+                uint64_t before = slot.seq.load(std::memory_order_acquire);
+                event.name = slot.name.load(std::memory_order_relaxed);
+                event.begin_ns = slot.begin_ns.load(std::memory_order_relaxed);
+                event.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                uint64_t after = slot.seq.load(std::memory_order_relaxed);
+                if (before == 2 * i + 2 && after == before)
+                    events.push_back(event);
+            }
+
+            if (buffer->name != NULL)
+            {
+                fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",", pid, buffer->id);
+                writeString(file, buffer->name);
+                fprintf(file, "}}");
+                first = false;
+            }
+            for (size_t i = 0; i < events.size(); i++)
+            {
+                fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+                writeString(file, events[i].name);
+                fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    events[i].begin_ns * 1e-3, events[i].duration_ns * 1e-3, pid, buffer->id);
+                first = false;
+            }
+        }
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+
+    void TraceRecorder::dumpOnSignal(int signum)
+    {
+        std::signal(signum, requestDump);
+    }
+
+    bool TraceRecorder::dumpRequested()
+    {
+        if (!dump_requested)
+            return false;
+        dump_requested = 0;
+        return true;
+    }
+}